@@ -3,11 +3,37 @@
 
 namespace NS_ADBLOCK {
 
-  Adblock::Adblock() {
+  Adblock::Adblock(): engine_(new Engine(std::vector<FilterPtr>())),
+    generation_(1), warm_up_(false)
+  {
   }
 
 
   Adblock::~Adblock() {
   }
 
+  EnginePtr Adblock::get_engine() const {
+    return boost::atomic_load(&engine_);
+  }
+
+  void Adblock::set_engine(const EnginePtr &engine) {
+    boost::atomic_store(&engine_, engine);
+    generation_.fetch_add(1, boost::memory_order_release);
+  }
+
+  void Adblock::load(const std::vector<std::string> &lines) {
+    EnginePtr engine = Engine::from_lines(lines);
+    if (warm_up_.load(boost::memory_order_relaxed)) {
+      Engine::WarmUpStats stats = engine->warm_up();
+      boost::mutex::scoped_lock lock(mutex_);
+      warm_up_stats_ = stats;
+    }
+    set_engine(engine);
+  }
+
+  Engine::WarmUpStats Adblock::get_warm_up_stats() const {
+    boost::mutex::scoped_lock lock(mutex_);
+    return warm_up_stats_;
+  }
+
 }
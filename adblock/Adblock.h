@@ -11,19 +11,106 @@
 
 
 #include "IAdblock.h"
+#include "Engine.h"
+#include <boost/atomic.hpp>
+#include <boost/thread/mutex.hpp>
 
 
 namespace NS_ADBLOCK {
 
   /**
    * Implementation of interface IAdblock
+   *
+   * Holds the engine currently in use. Publishing a new engine swaps the
+   * pointer atomically, queries that already hold the old engine finish on
+   * it and the old engine is freed when its last user drops it.
    */
   class Adblock: public IAdblock {
   public:
     Adblock();
     ~Adblock();
+
+    /**
+     * Engine currently in use, it stays valid for as long as the caller
+     * holds the pointer
+     */
+    EnginePtr get_engine() const;
+
+    /**
+     * Publishes a new engine to all readers
+     */
+    void set_engine(const EnginePtr &engine);
+
+    /**
+     * Parses a filter list and publishes the engine built from it, after
+     * Engine::warm_up() if it is enabled
+     */
+    void load(const std::vector<std::string> &lines);
+
+    /**
+     * Whether load() warms up new engines before publishing them, off by
+     * default
+     */
+    void set_warm_up(bool enabled) {
+      warm_up_.store(enabled, boost::memory_order_relaxed);
+    }
+
+    /**
+     * Result of the warm-up of the last engine published by load()
+     */
+    Engine::WarmUpStats get_warm_up_stats() const;
+
+    /**
+     * Incremented every time an engine is published
+     */
+    uint32_t get_generation() const {
+      return generation_.load(boost::memory_order_acquire);
+    }
+
+  private:
+    EnginePtr engine_;
+
+    boost::atomic<uint32_t> generation_;
+
+    boost::atomic<bool> warm_up_;
+
+    /**
+     * Guards warm_up_stats_
+     */
+    mutable boost::mutex mutex_;
+    Engine::WarmUpStats warm_up_stats_;
   };
 
-}
 
+  /**
+   * Per-thread view of the engine published by an Adblock.
+   *
+   * Copying a shared_ptr atomically goes through a small spinlock, a
+   * reader keeps its own reference instead and only reloads it when the
+   * generation of the Adblock changes. In the steady state a query costs
+   * one atomic load on top of the matching itself.
+   */
+  class EngineReader {
+  public:
+    explicit EngineReader(const Adblock &adblock):
+      adblock_(adblock), generation_(0) { }
 
+    /**
+     * Latest published engine
+     */
+    const Engine &get() {
+      uint32_t generation = adblock_.get_generation();
+      if (generation != generation_) {
+        engine_ = adblock_.get_engine();
+        generation_ = generation;
+      }
+      return *engine_;
+    }
+
+  private:
+    const Adblock &adblock_;
+    EnginePtr engine_;
+    uint32_t generation_;
+  };
+
+}
@@ -0,0 +1,660 @@
+#include "CompiledEngine.h"
+#include <cstring>
+#include <fstream>
+#include <algorithm>
+#include <boost/algorithm/string/case_conv.hpp>
+
+
+namespace NS_ADBLOCK {
+
+  namespace {
+
+    /**
+     * "ADBK" when read back in the byte order of the writer
+     */
+    const uint32_t Magic = 0x4B424441;
+
+    const uint32_t NoBucket = 0xFFFFFFFF;
+
+    inline uint32_t hash_keyword(boost::string_ref keyword) {
+      uint32_t hash = 2166136261U;
+      for (size_t idx = 0; idx < keyword.size(); ++idx) {
+        hash ^= static_cast<unsigned char>(keyword[idx]);
+        hash *= 16777619U;
+      }
+      return hash;
+    }
+
+    template<typename T>
+    void append(std::vector<char> &buffer, const std::vector<T> &items) {
+      if (items.size() > 0) {
+        const char *data = reinterpret_cast<const char *>(&items[0]);
+        buffer.insert(buffer.end(), data, data + items.size() * sizeof(T));
+      }
+    }
+
+  }
+
+  bool CompiledEngine::write(const Engine &engine, const std::string &path) {
+    std::vector<FilterRecord> filters;
+    std::vector<DomainRecord> domains;
+    std::vector<uint32_t> indexes;
+    std::vector<KeyRecord> keys;
+    std::vector<uint32_t> elem_filters;
+    std::vector<uint32_t> elem_exceptions;
+    std::vector<uint32_t> regexes;
+    std::string strings;
+
+    auto add_string = [&strings](boost::string_ref value) -> Str {
+      Str result;
+      result.offset = static_cast<uint32_t>(strings.size());
+      result.length = static_cast<uint32_t>(value.size());
+      strings.append(value.begin(), value.end());
+      return result;
+    };
+
+    boost::unordered_map<std::string, uint32_t> filter_by_key;
+    boost::unordered_map<std::string, uint32_t> known_filters;
+
+    const CombindMatcher &matcher = engine.get_matcher();
+    const std::vector<FilterPtr> &engine_filters = engine.get_filters();
+    for (auto iter = engine_filters.begin(); iter != engine_filters.end(); ++iter) {
+      if (!known_filters.insert(std::make_pair((*iter)->get_text(),
+        static_cast<uint32_t>(filters.size()))).second)
+      {
+        continue;
+      }
+
+      uint32_t idx = static_cast<uint32_t>(filters.size());
+      auto active = boost::static_pointer_cast<ActiveFilter>(*iter);
+      FilterRecord record;
+      record.text = add_string(active->get_text());
+      record.flags = 0;
+      record.content_type = 0;
+      record.third_party = 2;
+      record.regex = 0;
+
+      const ActiveFilter::DomainMap &domain_map = active->get_domains();
+      record.domain_begin = static_cast<uint32_t>(domains.size());
+      record.domain_count = 0;
+      record.domain_default = 1;
+      for (auto domain = domain_map.begin(); domain != domain_map.end(); ++domain) {
+        if (domain->first.length() == 0) {
+          record.domain_default = domain->second ? 1 : 0;
+        } else {
+          DomainRecord domain_record;
+          domain_record.name = add_string(domain->first);
+          domain_record.include = domain->second ? 1 : 0;
+          domains.push_back(domain_record);
+          ++record.domain_count;
+        }
+      }
+
+      FILTER_TYPE type = active->get_type();
+      if (type == BLOCKING_FILTER || type == WHITELIST_FILTER) {
+        auto filter = boost::static_pointer_cast<RegExpFilter>(active);
+        record.content_type = filter->get_content_types();
+        if (!boost::indeterminate(filter->get_third_party())) {
+          record.third_party = filter->get_third_party() ? 1 : 0;
+        }
+        if (filter->is_regex()) {
+          const std::string &source = filter->get_regex_source();
+          record.body = add_string(boost::string_ref(source).substr(1,
+            source.length() - 2));
+          record.flags = FLAG_REGEX |
+            (filter->get_match_case() ? Pattern::MATCH_CASE : 0);
+          record.regex = static_cast<uint32_t>(regexes.size());
+          regexes.push_back(idx);
+        } else {
+          record.body = add_string(filter->get_pattern().get_body());
+          record.flags = filter->get_pattern().get_flags();
+        }
+
+        if (type == WHITELIST_FILTER) {
+          record.flags |= FLAG_WHITELIST;
+        }
+        if (!matcher.has_filter(filter) && type == WHITELIST_FILTER) {
+          // Sitekey exception, the last filter wins like in CombindMatcher
+          auto wfilter = boost::static_pointer_cast<WhitelistFilter>(filter);
+          for (uint32_t key = 0; key < wfilter->get_key_num(); ++key) {
+            filter_by_key[wfilter->get_key(key)] = idx;
+          }
+        }
+      } else {
+        auto filter = boost::static_pointer_cast<ElemHideBase>(active);
+        record.body = add_string(filter->get_selector());
+        if (type == ELEM_HIDE_EXCEPTION) {
+          record.flags = FLAG_ELEMHIDE_EXCEPTION;
+          elem_exceptions.push_back(idx);
+        } else {
+          elem_filters.push_back(idx);
+        }
+      }
+      filters.push_back(record);
+    }
+
+    // Exceptions are looked up by selector with a binary search
+    std::stable_sort(elem_exceptions.begin(), elem_exceptions.end(),
+      [&](uint32_t lhs, uint32_t rhs) {
+        return strings.compare(filters[lhs].body.offset, filters[lhs].body.length,
+          strings, filters[rhs].body.offset, filters[rhs].body.length) < 0;
+      });
+
+    std::vector<std::pair<std::string, uint32_t> > sorted_keys(
+      filter_by_key.begin(), filter_by_key.end());
+    std::sort(sorted_keys.begin(), sorted_keys.end());
+    for (auto iter = sorted_keys.begin(); iter != sorted_keys.end(); ++iter) {
+      KeyRecord key;
+      key.key = add_string(iter->first);
+      key.filter = iter->second;
+      keys.push_back(key);
+    }
+
+    // Flattens buckets with their filters in the order the matchers check
+    // them and builds their lookup tables, returns the index of the
+    // bucket of the empty keyword
+    auto add_buckets = [&](const Matcher::Buckets &buckets,
+      std::vector<BucketRecord> &records, std::vector<uint32_t> &slots) -> uint32_t
+    {
+      uint32_t generic_bucket = NoBucket;
+      uint32_t slot_count = 1;
+      while (slot_count < buckets.size() * 2) {
+        slot_count <<= 1;
+      }
+      slots.assign(slot_count, 0);
+
+      for (uint32_t idx = 0; idx < buckets.size(); ++idx) {
+        const std::string &keyword = buckets[idx].first;
+        const Matcher::Filters &filters = buckets[idx].second;
+        BucketRecord record;
+        record.keyword = add_string(keyword);
+        record.index_begin = static_cast<uint32_t>(indexes.size());
+        record.index_count = static_cast<uint32_t>(filters.size());
+        for (auto iter = filters.begin(); iter != filters.end(); ++iter) {
+          indexes.push_back(known_filters[(*iter)->get_text()]);
+        }
+
+        if (keyword.length() == 0) {
+          generic_bucket = idx;
+        } else {
+          uint32_t slot = hash_keyword(keyword) & (slot_count - 1);
+          while (slots[slot] != 0) {
+            slot = (slot + 1) & (slot_count - 1);
+          }
+          slots[slot] = idx + 1;
+        }
+        records.push_back(record);
+      }
+      return generic_bucket;
+    };
+
+    // Index 0 is the whitelist
+    std::vector<BucketRecord> bucket_records[2];
+    std::vector<uint32_t> slots[2];
+    std::vector<BucketRecord> host_records[2];
+    std::vector<uint32_t> host_slots[2];
+    uint32_t generic_bucket[2];
+    const Matcher *matchers[] = { &matcher.get_whitelist(), &matcher.get_blacklist() };
+    for (uint32_t list = 0; list < 2; ++list) {
+      generic_bucket[list] = add_buckets(matchers[list]->get_buckets(),
+        bucket_records[list], slots[list]);
+
+      const HostTable::FiltersByHost &by_host =
+        matchers[list]->get_host_table().get_filters_by_host();
+      add_buckets(Matcher::Buckets(by_host.begin(), by_host.end()),
+        host_records[list], host_slots[list]);
+    }
+
+    // Every section is a multiple of 4 bytes, the strings come last
+    Header header;
+    std::memset(&header, 0, sizeof(header));
+    header.magic = Magic;
+    header.version = Version;
+    header.filter_count = static_cast<uint32_t>(filters.size());
+
+    uint32_t offset = sizeof(Header);
+    auto place = [&offset](Section &section, size_t count, size_t size) {
+      section.offset = offset;
+      section.count = static_cast<uint32_t>(count);
+      offset += static_cast<uint32_t>(count * size);
+    };
+    place(header.filters, filters.size(), sizeof(FilterRecord));
+    place(header.domains, domains.size(), sizeof(DomainRecord));
+    place(header.indexes, indexes.size(), sizeof(uint32_t));
+    place(header.whitelist.buckets, bucket_records[0].size(), sizeof(BucketRecord));
+    place(header.blacklist.buckets, bucket_records[1].size(), sizeof(BucketRecord));
+    place(header.whitelist.slots, slots[0].size(), sizeof(uint32_t));
+    place(header.blacklist.slots, slots[1].size(), sizeof(uint32_t));
+    place(header.whitelist.hosts, host_records[0].size(), sizeof(BucketRecord));
+    place(header.blacklist.hosts, host_records[1].size(), sizeof(BucketRecord));
+    place(header.whitelist.host_slots, host_slots[0].size(), sizeof(uint32_t));
+    place(header.blacklist.host_slots, host_slots[1].size(), sizeof(uint32_t));
+    header.whitelist.generic_bucket = generic_bucket[0];
+    header.blacklist.generic_bucket = generic_bucket[1];
+    place(header.keys, keys.size(), sizeof(KeyRecord));
+    place(header.elem_filters, elem_filters.size(), sizeof(uint32_t));
+    place(header.elem_exceptions, elem_exceptions.size(), sizeof(uint32_t));
+    place(header.regexes, regexes.size(), sizeof(uint32_t));
+    place(header.strings, strings.size(), 1);
+    header.file_size = offset;
+
+    std::vector<char> buffer;
+    buffer.reserve(offset);
+    const char *header_data = reinterpret_cast<const char *>(&header);
+    buffer.insert(buffer.end(), header_data, header_data + sizeof(header));
+    append(buffer, filters);
+    append(buffer, domains);
+    append(buffer, indexes);
+    append(buffer, bucket_records[0]);
+    append(buffer, bucket_records[1]);
+    append(buffer, slots[0]);
+    append(buffer, slots[1]);
+    append(buffer, host_records[0]);
+    append(buffer, host_records[1]);
+    append(buffer, host_slots[0]);
+    append(buffer, host_slots[1]);
+    append(buffer, keys);
+    append(buffer, elem_filters);
+    append(buffer, elem_exceptions);
+    append(buffer, regexes);
+    buffer.insert(buffer.end(), strings.begin(), strings.end());
+
+    std::ofstream file(path.c_str(), std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+      return false;
+    }
+    file.write(&buffer[0], buffer.size());
+    return file.good();
+  }
+
+  CompiledEnginePtr CompiledEngine::load(const std::string &path) {
+    boost::shared_ptr<CompiledEngine> engine(new CompiledEngine());
+    try {
+      engine->mapping_.reset(new boost::interprocess::file_mapping(path.c_str(),
+        boost::interprocess::read_only));
+      engine->region_.reset(new boost::interprocess::mapped_region(
+        *engine->mapping_, boost::interprocess::read_only));
+    } catch (const std::exception &) {
+      return nullptr;
+    }
+
+    uint64_t size = engine->region_->get_size();
+    engine->base_ = static_cast<const char *>(engine->region_->get_address());
+    engine->header_ = reinterpret_cast<const Header *>(engine->base_);
+    const Header &header = *engine->header_;
+    if (size < sizeof(Header) || header.magic != Magic ||
+      header.version != Version || header.file_size != size)
+    {
+      return nullptr;
+    }
+
+    // Sections must lie in the file, records are read in place so they
+    // must be aligned too
+    const std::pair<const Section *, size_t> sections[] = {
+      std::make_pair(&header.filters, sizeof(FilterRecord)),
+      std::make_pair(&header.domains, sizeof(DomainRecord)),
+      std::make_pair(&header.indexes, sizeof(uint32_t)),
+      std::make_pair(&header.whitelist.buckets, sizeof(BucketRecord)),
+      std::make_pair(&header.blacklist.buckets, sizeof(BucketRecord)),
+      std::make_pair(&header.whitelist.slots, sizeof(uint32_t)),
+      std::make_pair(&header.blacklist.slots, sizeof(uint32_t)),
+      std::make_pair(&header.whitelist.hosts, sizeof(BucketRecord)),
+      std::make_pair(&header.blacklist.hosts, sizeof(BucketRecord)),
+      std::make_pair(&header.whitelist.host_slots, sizeof(uint32_t)),
+      std::make_pair(&header.blacklist.host_slots, sizeof(uint32_t)),
+      std::make_pair(&header.keys, sizeof(KeyRecord)),
+      std::make_pair(&header.elem_filters, sizeof(uint32_t)),
+      std::make_pair(&header.elem_exceptions, sizeof(uint32_t)),
+      std::make_pair(&header.regexes, sizeof(uint32_t)),
+      std::make_pair(&header.strings, static_cast<size_t>(1))
+    };
+    for (uint32_t idx = 0; idx < sizeof(sections) / sizeof(sections[0]); ++idx) {
+      const Section &section = *sections[idx].first;
+      if (section.offset + static_cast<uint64_t>(section.count) * sections[idx].second > size ||
+        (sections[idx].second > 1 && section.offset % sizeof(uint32_t) != 0))
+      {
+        return nullptr;
+      }
+    }
+
+    // Queries don't check the records, every index, range and string
+    // reference is checked here once
+    if (!engine->is_valid()) {
+      return nullptr;
+    }
+
+    const uint32_t *regexes = engine->section<uint32_t>(header.regexes);
+    for (uint32_t idx = 0; idx < header.regexes.count; ++idx) {
+      const FilterRecord &record = engine->filter(regexes[idx]);
+      boost::string_ref body = engine->str(record.body);
+      try {
+        engine->regexes_.push_back(boost::regex(body.begin(), body.end(),
+          (record.flags & Pattern::MATCH_CASE) ? 0 : boost::regex::icase));
+      } catch (const std::exception &) {
+        return nullptr;
+      }
+    }
+    return engine;
+  }
+
+  bool CompiledEngine::is_valid() const {
+    const Header &header = *header_;
+    if (header.filter_count != header.filters.count) {
+      return false;
+    }
+
+    auto valid_str = [&header](const Str &value) {
+      return value.offset + static_cast<uint64_t>(value.length) <= header.strings.count;
+    };
+    auto valid_range = [](uint32_t begin, uint32_t count, const Section &target) {
+      return begin + static_cast<uint64_t>(count) <= target.count;
+    };
+    auto valid_filters = [&header](const uint32_t *indexes, uint32_t count) -> bool {
+      for (uint32_t idx = 0; idx < count; ++idx) {
+        if (indexes[idx] >= header.filter_count) {
+          return false;
+        }
+      }
+      return true;
+    };
+
+    const uint32_t *regexes = section<uint32_t>(header.regexes);
+    for (uint32_t idx = 0; idx < header.filters.count; ++idx) {
+      const FilterRecord &record = filter(idx);
+      if (!valid_str(record.text) || !valid_str(record.body) ||
+        !valid_range(record.domain_begin, record.domain_count, header.domains) ||
+        record.third_party > 2)
+      {
+        return false;
+      }
+      if ((record.flags & FLAG_REGEX) &&
+        (record.regex >= header.regexes.count || regexes[record.regex] != idx))
+      {
+        return false;
+      }
+    }
+
+    const DomainRecord *domains = section<DomainRecord>(header.domains);
+    for (uint32_t idx = 0; idx < header.domains.count; ++idx) {
+      if (!valid_str(domains[idx].name)) {
+        return false;
+      }
+    }
+
+    auto valid_buckets = [&](const Section &bucket_section,
+      const Section &slot_section) -> bool
+    {
+      const BucketRecord *buckets = section<BucketRecord>(bucket_section);
+      for (uint32_t idx = 0; idx < bucket_section.count; ++idx) {
+        if (!valid_str(buckets[idx].keyword) ||
+          !valid_range(buckets[idx].index_begin, buckets[idx].index_count, header.indexes))
+        {
+          return false;
+        }
+      }
+
+      // Probing stops at an empty slot, a full table would never end
+      uint32_t slot_count = slot_section.count;
+      if (slot_count == 0 || (slot_count & (slot_count - 1)) != 0) {
+        return false;
+      }
+      const uint32_t *slots = section<uint32_t>(slot_section);
+      uint32_t used = 0;
+      for (uint32_t slot = 0; slot < slot_count; ++slot) {
+        if (slots[slot] > bucket_section.count) {
+          return false;
+        }
+        used += slots[slot] != 0 ? 1 : 0;
+      }
+      return used < slot_count;
+    };
+
+    const MatcherRecord *matchers[] = { &header.whitelist, &header.blacklist };
+    for (uint32_t list = 0; list < 2; ++list) {
+      const MatcherRecord &matcher = *matchers[list];
+      if (!valid_buckets(matcher.buckets, matcher.slots) ||
+        !valid_buckets(matcher.hosts, matcher.host_slots))
+      {
+        return false;
+      }
+      if (matcher.generic_bucket != NoBucket &&
+        matcher.generic_bucket >= matcher.buckets.count)
+      {
+        return false;
+      }
+    }
+
+    const KeyRecord *keys = section<KeyRecord>(header.keys);
+    for (uint32_t idx = 0; idx < header.keys.count; ++idx) {
+      if (!valid_str(keys[idx].key) || keys[idx].filter >= header.filter_count) {
+        return false;
+      }
+    }
+
+    return valid_filters(section<uint32_t>(header.indexes), header.indexes.count) &&
+      valid_filters(section<uint32_t>(header.elem_filters), header.elem_filters.count) &&
+      valid_filters(section<uint32_t>(header.elem_exceptions), header.elem_exceptions.count) &&
+      valid_filters(regexes, header.regexes.count);
+  }
+
+  boost::string_ref CompiledEngine::get_filter_text(uint32_t idx) const {
+    return str(filter(idx).text);
+  }
+
+  bool CompiledEngine::is_whitelist(uint32_t idx) const {
+    return (filter(idx).flags & FLAG_WHITELIST) != 0;
+  }
+
+  uint32_t CompiledEngine::matches_any(const Request &request) const {
+    // Exception rules win over any blocking rule, same as CombindMatcher
+    uint32_t result = matches_list(header_->whitelist, request);
+    if (result != NoFilter) {
+      return result;
+    }
+    return matches_list(header_->blacklist, request);
+  }
+
+  uint32_t CompiledEngine::matches_list(
+    const MatcherRecord &matcher,
+    const Request &request
+    ) const
+  {
+    // Same order as Matcher: the host table, one probe per sub-domain,
+    // then the keyword buckets
+    if (matcher.hosts.count > 0) {
+      for (uint32_t idx = 0; idx < request.get_host_key_count(); ++idx) {
+        const BucketRecord *bucket = find_bucket(matcher.hosts, matcher.host_slots,
+          request.get_host_key(idx));
+        if (bucket != nullptr) {
+          uint32_t result = check_bucket_match(*bucket, request);
+          if (result != NoFilter) {
+            return result;
+          }
+        }
+      }
+    }
+
+    for (uint32_t idx = 0; idx < request.get_token_count(); ++idx) {
+      const BucketRecord *bucket = find_bucket(matcher.buckets, matcher.slots,
+        request.get_token(idx));
+      if (bucket != nullptr) {
+        uint32_t result = check_bucket_match(*bucket, request);
+        if (result != NoFilter) {
+          return result;
+        }
+      }
+    }
+
+    // Filters without a keyword are checked against every URL
+    if (matcher.generic_bucket != NoBucket) {
+      return check_bucket_match(
+        section<BucketRecord>(matcher.buckets)[matcher.generic_bucket], request);
+    }
+    return NoFilter;
+  }
+
+  const CompiledEngine::BucketRecord *CompiledEngine::find_bucket(
+    const Section &buckets,
+    const Section &slots,
+    boost::string_ref keyword
+    ) const
+  {
+    const BucketRecord *records = section<BucketRecord>(buckets);
+    const uint32_t *table = section<uint32_t>(slots);
+    uint32_t slot_mask = slots.count - 1;
+    uint32_t slot = hash_keyword(keyword) & slot_mask;
+    while (table[slot] != 0) {
+      const BucketRecord &bucket = records[table[slot] - 1];
+      if (str(bucket.keyword) == keyword) {
+        return &bucket;
+      }
+      slot = (slot + 1) & slot_mask;
+    }
+    return nullptr;
+  }
+
+  uint32_t CompiledEngine::check_bucket_match(
+    const BucketRecord &bucket,
+    const Request &request
+    ) const
+  {
+    const uint32_t *indexes = section<uint32_t>(header_->indexes) + bucket.index_begin;
+    for (uint32_t idx = 0; idx < bucket.index_count; ++idx) {
+      if (matches_filter(filter(indexes[idx]), request)) {
+        return indexes[idx];
+      }
+    }
+    return NoFilter;
+  }
+
+  bool CompiledEngine::matches_filter(
+    const FilterRecord &record,
+    const Request &request
+    ) const
+  {
+    // Same order of checks as RegExpFilter::matches
+    if ((request.get_content_type() & record.content_type) == 0) {
+      return false;
+    }
+    if (record.third_party != 2 &&
+      (record.third_party == 1) != request.get_third_party())
+    {
+      return false;
+    }
+    if (!is_active_on_upper_domain(record, request.get_doc_domain(), true)) {
+      return false;
+    }
+
+    boost::string_ref location = request.get_location();
+    if (record.flags & FLAG_REGEX) {
+      return boost::regex_search(location.begin(), location.end(),
+        regexes_[record.regex]);
+    }
+    return Pattern::matches(str(record.body), record.flags & 0xFF, location);
+  }
+
+  bool CompiledEngine::is_active_on_upper_domain(
+    const FilterRecord &record,
+    boost::string_ref doc_domain,
+    bool ignore_trailing_dot
+    ) const
+  {
+    // Same as ActiveFilter::is_active_on_upper_domain
+    if (record.domain_count == 0) {
+      return true;
+    }
+
+    if (doc_domain.length() == 0) {
+      return record.domain_default != 0;
+    }
+
+    if (ignore_trailing_dot) {
+      while (doc_domain.length() > 0 && doc_domain.back() == '.') {
+        doc_domain.remove_suffix(1);
+      }
+    }
+
+    const DomainRecord *domains = section<DomainRecord>(header_->domains) +
+      record.domain_begin;
+    while (true) {
+      for (uint32_t idx = 0; idx < record.domain_count; ++idx) {
+        if (str(domains[idx].name) == doc_domain) {
+          return domains[idx].include != 0;
+        }
+      }
+
+      size_t next_dot = doc_domain.find('.');
+      if (next_dot == boost::string_ref::npos) {
+        break;
+      }
+      doc_domain.remove_prefix(next_dot + 1);
+    }
+    return record.domain_default != 0;
+  }
+
+  uint32_t CompiledEngine::matches_by_key(
+    const std::string &location,
+    const std::string &key,
+    const std::string &doc_domain
+    ) const
+  {
+    std::string upper_key = boost::to_upper_copy(key);
+    const KeyRecord *keys = section<KeyRecord>(header_->keys);
+    const KeyRecord *end = keys + header_->keys.count;
+    const KeyRecord *iter = std::lower_bound(keys, end, upper_key,
+      [this](const KeyRecord &record, const std::string &value) {
+        return str(record.key).compare(value) < 0;
+      });
+    if (iter != end && str(iter->key) == upper_key &&
+      matches_filter(filter(iter->filter),
+        Request(location, TYPE_DOCUMENT, doc_domain, false)))
+    {
+      return iter->filter;
+    }
+    return NoFilter;
+  }
+
+  bool CompiledEngine::has_exception(
+    boost::string_ref selector,
+    boost::string_ref doc_domain
+    ) const
+  {
+    const uint32_t *exceptions = section<uint32_t>(header_->elem_exceptions);
+    const uint32_t *end = exceptions + header_->elem_exceptions.count;
+    const uint32_t *iter = std::lower_bound(exceptions, end, selector,
+      [this](uint32_t idx, boost::string_ref value) {
+        return str(filter(idx).body).compare(value) < 0;
+      });
+    for (; iter != end && str(filter(*iter).body) == selector; ++iter) {
+      if (is_active_on_upper_domain(filter(*iter), doc_domain, false)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  std::vector<std::string> CompiledEngine::get_selectors(
+    const std::string &domain,
+    bool specific
+    ) const
+  {
+    std::string upper_domain = boost::to_upper_copy(domain);
+    std::vector<std::string> result;
+    const uint32_t *elem_filters = section<uint32_t>(header_->elem_filters);
+    for (uint32_t idx = 0; idx < header_->elem_filters.count; ++idx) {
+      const FilterRecord &record = filter(elem_filters[idx]);
+      if (specific && (record.domain_count == 0 || record.domain_default != 0)) {
+        continue;
+      }
+
+      boost::string_ref selector = str(record.body);
+      if (is_active_on_upper_domain(record, upper_domain, false) &&
+        !has_exception(selector, upper_domain))
+      {
+        result.push_back(selector.to_string());
+      }
+    }
+    return result;
+  }
+
+}
@@ -0,0 +1,280 @@
+/*!
+ * \file CompiledEngine.h
+ *
+ * \author yorath
+ * \date October 30, 2013
+ *
+ * \details Binary form of a built engine that is queried straight from
+ * a memory mapping of the file.
+ */
+
+#pragma once
+
+
+#include "Engine.h"
+#include "Request.h"
+#include <boost/noncopyable.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+
+namespace NS_ADBLOCK {
+
+  class CompiledEngine;
+
+  typedef boost::shared_ptr<const CompiledEngine> CompiledEnginePtr;
+
+  /**
+   * Engine loaded from the file written by CompiledEngine::write().
+   *
+   * The file holds everything Engine builds at startup: the parsed
+   * options, domain restrictions and normalized patterns of the filters,
+   * the keyword buckets and host tables with their lookup tables, the
+   * sitekey table and the element hiding rules. Loading it maps the file and checks every
+   * record against the section it points into once, queries then read
+   * the records in place without checks. Only filters given as regular
+   * expressions are compiled when the file is loaded.
+   *
+   * Records are stored in the byte order of the machine that wrote the
+   * file, the header rejects files from a different byte order or
+   * version. Filters are identified by their index in the file, results
+   * are reported as such an index or NoFilter.
+   */
+  class CompiledEngine: private boost::noncopyable {
+  public:
+    /**
+     * Serializes an engine, returns false if the file can't be written
+     */
+    static bool write(const Engine &engine, const std::string &path);
+
+    /**
+     * Maps a file written by write(), returns null if it can't be opened,
+     * was written by an incompatible version or has a record pointing
+     * outside its section
+     */
+    static CompiledEnginePtr load(const std::string &path);
+
+    /**
+     * @see Engine#matches_any
+     */
+    uint32_t matches_any(const Request &request) const;
+
+    /**
+     * @see Engine#matches_by_key
+     */
+    uint32_t matches_by_key(const std::string &location,
+      const std::string &key, const std::string &doc_domain) const;
+
+    /**
+     * @see Engine#get_selectors
+     */
+    std::vector<std::string> get_selectors(const std::string &domain,
+      bool specific) const;
+
+    /**
+     * Number of filters stored in the file
+     */
+    uint32_t get_filter_count() const { return header_->filter_count; }
+
+    /**
+     * Text of the filter with the given index
+     */
+    boost::string_ref get_filter_text(uint32_t idx) const;
+
+    /**
+     * Checks whether the filter with the given index is an exception rule
+     */
+    bool is_whitelist(uint32_t idx) const;
+
+    /**
+     * Result of the queries when no filter matches
+     */
+    static const uint32_t NoFilter = 0xFFFFFFFF;
+
+    /**
+     * Increased whenever the layout of the file changes
+     */
+    static const uint32_t Version = 2;
+
+  private:
+    /**
+     * Reference to a string in the string pool of the file
+     */
+    struct Str {
+      uint32_t offset;
+      uint32_t length;
+    };
+
+    /**
+     * Filter record, element hiding rules keep their selector in body
+     */
+    struct FilterRecord {
+      Str text;
+      Str body;
+
+      /**
+       * Pattern flags in the low byte combined with the FLAG_* values
+       */
+      uint32_t flags;
+      uint32_t content_type;
+
+      /**
+       * Domain restrictions, domain_count is 0 if there are none
+       */
+      uint32_t domain_begin;
+      uint32_t domain_count;
+
+      /**
+       * Value of the "" entry of the domain map
+       */
+      uint32_t domain_default;
+
+      /**
+       * 0 for first-party only, 1 for third-party only, 2 for both
+       */
+      uint32_t third_party;
+
+      /**
+       * Index of the compiled regular expression for FLAG_REGEX filters
+       */
+      uint32_t regex;
+    };
+
+    enum {
+      FLAG_REGEX = 0x0100,
+      FLAG_WHITELIST = 0x0200,
+      FLAG_ELEMHIDE_EXCEPTION = 0x0400
+    };
+
+    struct DomainRecord {
+      Str name;
+      uint32_t include;
+    };
+
+    struct BucketRecord {
+      Str keyword;
+      uint32_t index_begin;
+      uint32_t index_count;
+    };
+
+    struct KeyRecord {
+      Str key;
+      uint32_t filter;
+    };
+
+    struct Section {
+      uint32_t offset;
+      uint32_t count;
+    };
+
+    /**
+     * Keyword buckets of a Matcher, slots is an open addressing table of
+     * bucket indexes plus one (0 for empty slots) with a power of two size
+     */
+    struct MatcherRecord {
+      Section buckets;
+      Section slots;
+
+      /**
+       * Index of the bucket of the filters without a keyword, 0xFFFFFFFF
+       * if there is none
+       */
+      uint32_t generic_bucket;
+
+      /**
+       * Host table of the Matcher, buckets keyed by host with their own
+       * lookup table, checked before the keyword buckets
+       */
+      Section hosts;
+      Section host_slots;
+    };
+
+    struct Header {
+      uint32_t magic;
+      uint32_t version;
+      uint32_t file_size;
+      uint32_t filter_count;
+
+      Section filters;
+      Section domains;
+      Section indexes;
+      MatcherRecord whitelist;
+      MatcherRecord blacklist;
+      Section keys;
+
+      /**
+       * Element hiding filters and exceptions, the exceptions sorted by
+       * selector
+       */
+      Section elem_filters;
+      Section elem_exceptions;
+
+      /**
+       * Filters given as regular expressions
+       */
+      Section regexes;
+      Section strings;
+    };
+
+    CompiledEngine() { }
+
+    /**
+     * Checks the indexes, ranges and string references of all records
+     * and the lookup tables of the keyword buckets
+     */
+    bool is_valid() const;
+
+    template<typename T>
+    const T *section(const Section &section) const {
+      return reinterpret_cast<const T *>(base_ + section.offset);
+    }
+
+    boost::string_ref str(const Str &value) const {
+      return boost::string_ref(base_ + header_->strings.offset + value.offset,
+        value.length);
+    }
+
+    const FilterRecord &filter(uint32_t idx) const {
+      return section<FilterRecord>(header_->filters)[idx];
+    }
+
+    uint32_t matches_list(const MatcherRecord &matcher,
+      const Request &request) const;
+
+    uint32_t check_bucket_match(const BucketRecord &bucket,
+      const Request &request) const;
+
+    /**
+     * Looks up a keyword or host in a lookup table, null if it has no
+     * bucket
+     */
+    const BucketRecord *find_bucket(const Section &buckets,
+      const Section &slots, boost::string_ref keyword) const;
+
+    bool matches_filter(const FilterRecord &record,
+      const Request &request) const;
+
+    bool is_active_on_upper_domain(const FilterRecord &record,
+      boost::string_ref doc_domain, bool ignore_trailing_dot) const;
+
+    /**
+     * Checks whether an element hiding exception applies to a selector
+     */
+    bool has_exception(boost::string_ref selector,
+      boost::string_ref doc_domain) const;
+
+    boost::scoped_ptr<boost::interprocess::file_mapping> mapping_;
+    boost::scoped_ptr<boost::interprocess::mapped_region> region_;
+
+    const char *base_;
+    const Header *header_;
+
+    /**
+     * Regular expressions can't be stored in the file, they are the only
+     * filters compiled at load time
+     */
+    std::vector<boost::regex> regexes_;
+  };
+
+}
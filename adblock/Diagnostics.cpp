@@ -0,0 +1,64 @@
+#include "Diagnostics.h"
+
+
+namespace NS_ADBLOCK {
+
+  DiagnosticsCollector::DiagnosticsCollector(uint32_t sample_capacity):
+    capacity_(sample_capacity), next_(0)
+  {
+    for (uint32_t idx = 0; idx < INVALID_REASON_COUNT; ++idx) {
+      counts_[idx].store(0, boost::memory_order_relaxed);
+    }
+    samples_.reserve(capacity_);
+  }
+
+  void DiagnosticsCollector::on_invalid_filter(const InvalidFilter &filter) {
+    counts_[filter.get_reason()].fetch_add(1, boost::memory_order_relaxed);
+    if (capacity_ == 0) {
+      return;
+    }
+
+    boost::mutex::scoped_lock lock(mutex_);
+    if (samples_.size() < capacity_) {
+      samples_.push_back(Sample());
+    }
+    Sample &sample = samples_[next_];
+    sample.reason = filter.get_reason();
+    sample.text = filter.get_text();
+    sample.message = filter.get_message();
+    next_ = (next_ + 1) % capacity_;
+  }
+
+  uint64_t DiagnosticsCollector::get_count(INVALID_REASON reason) const {
+    return counts_[reason].load(boost::memory_order_relaxed);
+  }
+
+  uint64_t DiagnosticsCollector::get_total() const {
+    uint64_t total = 0;
+    for (uint32_t idx = 0; idx < INVALID_REASON_COUNT; ++idx) {
+      total += counts_[idx].load(boost::memory_order_relaxed);
+    }
+    return total;
+  }
+
+  std::vector<DiagnosticsCollector::Sample> DiagnosticsCollector::get_samples() const {
+    boost::mutex::scoped_lock lock(mutex_);
+    if (samples_.size() < capacity_) {
+      return samples_;
+    }
+    // Full ring, the oldest sample is the next one to be overwritten
+    std::vector<Sample> result(samples_.begin() + next_, samples_.end());
+    result.insert(result.end(), samples_.begin(), samples_.begin() + next_);
+    return result;
+  }
+
+  void DiagnosticsCollector::clear() {
+    for (uint32_t idx = 0; idx < INVALID_REASON_COUNT; ++idx) {
+      counts_[idx].store(0, boost::memory_order_relaxed);
+    }
+    boost::mutex::scoped_lock lock(mutex_);
+    samples_.clear();
+    next_ = 0;
+  }
+
+}
@@ -0,0 +1,97 @@
+/*!
+ * \file Diagnostics.h
+ *
+ * \author yorath
+ * \date November 8, 2013
+ *
+ * \details Reporting of filters that failed to parse
+ */
+
+#pragma once
+
+
+#include "Filter.h"
+#include <vector>
+#include <boost/atomic.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/thread/mutex.hpp>
+
+
+namespace NS_ADBLOCK {
+
+  /**
+   * Sink for the problems found while parsing filter lists, installed
+   * with Filter::set_diagnostics(). The default implementation ignores
+   * everything. Lists loaded on several threads call it concurrently.
+   */
+  class ParseDiagnostics {
+  public:
+    virtual ~ParseDiagnostics() { }
+
+    /**
+     * Called for every invalid filter of a loaded list, once per list
+     */
+    virtual void on_invalid_filter(const InvalidFilter & /*filter*/) { }
+  };
+
+
+  /**
+   * Diagnostics that count invalid filters by reason and keep the last
+   * few of them as samples.
+   *
+   * Counting takes no lock. The samples are kept in a ring buffer of
+   * fixed capacity, so a broken list can't grow it without bound.
+   */
+  class DiagnosticsCollector: public ParseDiagnostics, private boost::noncopyable {
+  public:
+    struct Sample {
+      INVALID_REASON reason;
+      std::string text;
+      std::string message;
+    };
+
+    /**
+     * \param sample_capacity number of samples kept, 0 only counts
+     */
+    explicit DiagnosticsCollector(uint32_t sample_capacity = DefaultSampleCapacity);
+
+    void on_invalid_filter(const InvalidFilter &filter);
+
+    /**
+     * Number of invalid filters reported for a reason
+     */
+    uint64_t get_count(INVALID_REASON reason) const;
+
+    /**
+     * Number of invalid filters reported for any reason
+     */
+    uint64_t get_total() const;
+
+    /**
+     * Latest samples, oldest first
+     */
+    std::vector<Sample> get_samples() const;
+
+    /**
+     * Drops counters and samples
+     */
+    void clear();
+
+    static const uint32_t DefaultSampleCapacity = 64;
+
+  private:
+    boost::atomic<uint64_t> counts_[INVALID_REASON_COUNT];
+
+    mutable boost::mutex mutex_;
+
+    /**
+     * Ring buffer, next_ is the slot overwritten by the next sample
+     */
+    std::vector<Sample> samples_;
+    uint32_t capacity_;
+    uint32_t next_;
+  };
+
+  typedef boost::shared_ptr<DiagnosticsCollector> DiagnosticsCollectorPtr;
+
+}
@@ -0,0 +1,133 @@
+#include "DomainIndex.h"
+#include <algorithm>
+
+
+namespace NS_ADBLOCK {
+
+  namespace {
+
+    struct MatchLess {
+      template<typename Match>
+      bool operator()(const Match &lhs, const Match &rhs) const {
+        return lhs.filter < rhs.filter ||
+          (lhs.filter == rhs.filter && lhs.depth < rhs.depth);
+      }
+    };
+
+    struct SameFilter {
+      template<typename Match>
+      bool operator()(const Match &lhs, const Match &rhs) const {
+        return lhs.filter == rhs.filter;
+      }
+    };
+
+  }
+
+  boost::tribool DomainMatches::find(const ActiveFilter *filter) const {
+    Match key;
+    key.filter = filter;
+    key.depth = 0;
+    auto iter = std::lower_bound(rules_.begin(), rules_.end(), key, MatchLess());
+    if (iter != rules_.end() && iter->filter == filter) {
+      return iter->include;
+    }
+    return boost::indeterminate;
+  }
+
+
+  boost::atomic<uint64_t> DomainIndex::next_stamp_(1);
+
+  DomainIndex::DomainIndex(): stamp_(next_stamp_++) {
+  }
+
+  DomainIndex::DomainIndex(const DomainIndex &other):
+    rules_by_domain_(other.rules_by_domain_), stamp_(next_stamp_++)
+  {
+  }
+
+  DomainIndex &DomainIndex::operator=(const DomainIndex &other) {
+    if (this != &other) {
+      rules_by_domain_ = other.rules_by_domain_;
+      stamp_ = next_stamp_++;
+    }
+    return *this;
+  }
+
+  void DomainIndex::add(const ActiveFilter *filter) {
+    const ActiveFilter::DomainMap &domains = filter->get_domains();
+    for (auto iter = domains.begin(); iter != domains.end(); ++iter) {
+      if (iter->first.length() > 0) {
+        Rule rule;
+        rule.filter = filter;
+        rule.include = iter->second;
+        rules_by_domain_[iter->first].push_back(rule);
+      }
+    }
+    stamp_ = next_stamp_++;
+  }
+
+  void DomainIndex::remove(const ActiveFilter *filter) {
+    const ActiveFilter::DomainMap &domains = filter->get_domains();
+    for (auto iter = domains.begin(); iter != domains.end(); ++iter) {
+      auto rules = rules_by_domain_.find(iter->first);
+      if (rules == rules_by_domain_.end()) {
+        continue;
+      }
+      for (auto rule = rules->second.begin(); rule != rules->second.end(); ++rule) {
+        if (rule->filter == filter) {
+          rules->second.erase(rule);
+          break;
+        }
+      }
+      if (rules->second.empty()) {
+        rules_by_domain_.erase(rules);
+      }
+    }
+    stamp_ = next_stamp_++;
+  }
+
+  void DomainIndex::clear() {
+    rules_by_domain_.clear();
+    stamp_ = next_stamp_++;
+  }
+
+  void DomainIndex::resolve(
+    boost::string_ref doc_domain,
+    DomainMatches &matches
+    ) const
+  {
+    matches.rules_.clear();
+    if (rules_by_domain_.empty()) {
+      return;
+    }
+
+    // Same walk as ActiveFilter::is_active_on_upper_domain but for all
+    // filters at once
+    DomainMatches::Match match;
+    match.depth = 0;
+    while (doc_domain.length() > 0) {
+      auto rules = rules_by_domain_.find(doc_domain, StringHash(), StringEqual());
+      if (rules != rules_by_domain_.end()) {
+        for (auto rule = rules->second.begin(); rule != rules->second.end(); ++rule) {
+          match.filter = rule->filter;
+          match.include = rule->include;
+          matches.rules_.push_back(match);
+        }
+      }
+
+      size_t next_dot = doc_domain.find('.');
+      if (next_dot == boost::string_ref::npos) {
+        break;
+      }
+      doc_domain.remove_prefix(next_dot + 1);
+      ++match.depth;
+    }
+
+    // Keep only the most specific rule of every filter, std::sort works
+    // in place so resolving doesn't allocate once the storage has grown
+    std::sort(matches.rules_.begin(), matches.rules_.end(), MatchLess());
+    matches.rules_.erase(std::unique(matches.rules_.begin(), matches.rules_.end(),
+      SameFilter()), matches.rules_.end());
+  }
+
+}
@@ -0,0 +1,123 @@
+/*!
+ * \file DomainIndex.h
+ *
+ * \author yorath
+ * \date November 2, 2013
+ *
+ * \details Shared index of the domain restrictions of a set of filters.
+ */
+
+#pragma once
+
+
+#include "Filter.h"
+#include <vector>
+#include <boost/atomic.hpp>
+
+
+namespace NS_ADBLOCK {
+
+  /**
+   * Domain rules that apply to one document domain: for every filter that
+   * restricts the domain or one of its parent domains, whether the most
+   * specific of those domains includes or excludes it.
+   */
+  class DomainMatches {
+  public:
+    void clear() { rules_.clear(); }
+
+    /**
+     * Whether a filter is included or excluded by the rules, indeterminate
+     * if it has no rule for the domain
+     */
+    boost::tribool find(const ActiveFilter *filter) const;
+
+    uint32_t size() const { return static_cast<uint32_t>(rules_.size()); }
+
+    /**
+     * Filter of the rule at index idx, rules are ordered by filter address
+     */
+    const ActiveFilter *get_filter(uint32_t idx) const {
+      return rules_[idx].filter;
+    }
+
+    /**
+     * Whether the rule at index idx includes its filter
+     */
+    bool get_include(uint32_t idx) const { return rules_[idx].include; }
+
+  private:
+    friend class DomainIndex;
+
+    struct Match {
+      const ActiveFilter *filter;
+
+      /**
+       * Number of labels removed from the document domain, lower is more
+       * specific
+       */
+      uint32_t depth;
+      bool include;
+    };
+
+    std::vector<Match> rules_;
+  };
+
+
+  /**
+   * Maps every domain named in the domain restrictions of the filters to
+   * the filters naming it.
+   *
+   * Instead of every candidate filter walking the labels of the document
+   * domain against its own DomainMap, the index walks them once and
+   * collects the answer for all filters in a DomainMatches.
+   */
+  class DomainIndex {
+  public:
+    DomainIndex();
+    DomainIndex(const DomainIndex &other);
+    DomainIndex &operator=(const DomainIndex &other);
+
+    /**
+     * Adds the domain restrictions of a filter, filters without any are
+     * ignored
+     */
+    void add(const ActiveFilter *filter);
+
+    /**
+     * Removes the domain restrictions of a filter
+     */
+    void remove(const ActiveFilter *filter);
+
+    void clear();
+
+    /*!
+     * Collects the rules that apply to a document domain
+     *
+     * \param doc_domain uppercase domain, trailing dots are not stripped
+     * \param matches receives the rules, its storage is reused
+     */
+    void resolve(boost::string_ref doc_domain, DomainMatches &matches) const;
+
+    /**
+     * Changes whenever the index is modified, unique among all indexes so
+     * a resolved DomainMatches can be reused as long as it is the same
+     */
+    uint64_t get_stamp() const { return stamp_; }
+
+  private:
+    struct Rule {
+      const ActiveFilter *filter;
+      bool include;
+    };
+
+    typedef std::vector<Rule> Rules;
+    typedef boost::unordered_map<std::string, Rules, StringHash> RulesByDomain;
+    RulesByDomain rules_by_domain_;
+
+    uint64_t stamp_;
+
+    static boost::atomic<uint64_t> next_stamp_;
+  };
+
+}
@@ -1,81 +1,288 @@
 #include "ElemHide.h"
+#include <algorithm>
+#include <boost/algorithm/string/case_conv.hpp>
 
 
 namespace NS_ADBLOCK {
 
+  ElemHide::ElemHide(): index_ready_(false) {
+  }
 
   void ElemHide::clear() {
     elem_filters_.clear();
     known_exceptions_.clear();
     exceptions_.clear();
+    domains_.clear();
+    invalidate();
   }
 
   void ElemHide::add(const ElemHideBasePtr &filter) {
+    invalidate();
     if (filter->get_type() == ELEM_HIDE_EXCEPTION) {
       if (known_exceptions_.insert(filter->get_text()).second == true) {
-        exceptions_[filter->get_selector()].push_back(
-          boost::dynamic_pointer_cast<ElemHideException>(filter));
+        auto exception = boost::dynamic_pointer_cast<ElemHideException>(filter);
+        SelectorExceptions &exceptions = exceptions_[filter->get_selector()];
+        exceptions.all.push_back(exception);
+
+        const ActiveFilter::DomainMap &domains = exception->get_domains();
+        if (domains.size() == 0 || domains.find("")->second) {
+          exceptions.generic.push_back(exception);
+        }
+        for (auto iter = domains.begin(); iter != domains.end(); ++iter) {
+          if (iter->first.length() > 0 && iter->second) {
+            exceptions.by_domain[iter->first].push_back(exception);
+          }
+        }
       }
     } else {
-      elem_filters_.insert(boost::dynamic_pointer_cast<ElemHideFilter>(filter));
+      if (elem_filters_.insert(boost::dynamic_pointer_cast<ElemHideFilter>(filter)).second) {
+        domains_.add(filter.get());
+      }
     }
   }
 
   void ElemHide::remove(const ElemHideBasePtr &filter) {
+    invalidate();
     if (filter->get_type() == ELEM_HIDE_EXCEPTION) {
       if (known_exceptions_.erase(filter->get_text()) == 1) {
-        exceptions_.erase(filter->get_selector());
+        auto exceptions = exceptions_.find(filter->get_selector());
+        if (exceptions == exceptions_.end()) {
+          return;
+        }
+
+        SelectorExceptions &entry = exceptions->second;
+        entry.all.erase(std::remove(entry.all.begin(), entry.all.end(), filter),
+          entry.all.end());
+        entry.generic.erase(std::remove(entry.generic.begin(), entry.generic.end(), filter),
+          entry.generic.end());
+        for (auto iter = entry.by_domain.begin(); iter != entry.by_domain.end();) {
+          iter->second.erase(std::remove(iter->second.begin(), iter->second.end(), filter),
+            iter->second.end());
+          if (iter->second.empty()) {
+            iter = entry.by_domain.erase(iter);
+          } else {
+            ++iter;
+          }
+        }
+        if (entry.all.empty()) {
+          exceptions_.erase(exceptions);
+        }
       }
     } else {
-      elem_filters_.erase(boost::dynamic_pointer_cast<ElemHideFilter>(filter));
+      if (elem_filters_.erase(boost::dynamic_pointer_cast<ElemHideFilter>(filter)) == 1) {
+        domains_.remove(filter.get());
+      }
+    }
+  }
+
+  void ElemHide::update(const Filters &removed, const Filters &added) {
+    for (auto iter = removed.begin(); iter != removed.end(); ++iter) {
+      remove(*iter);
+    }
+    for (auto iter = added.begin(); iter != added.end(); ++iter) {
+      add(*iter);
     }
   }
 
   NS_ADBLOCK::ElemHideExceptionPtr ElemHide::get_exception(
     const ElemHideBasePtr &filter,
     const std::string &doc_domain
-    )
+    ) const
   {
-    auto exceptions = exceptions_.find(filter->get_selector());
+    return find_exception(filter->get_selector(),
+      boost::to_upper_copy(doc_domain));
+  }
+
+  NS_ADBLOCK::ElemHideExceptionPtr ElemHide::find_exception(
+    boost::string_ref selector,
+    boost::string_ref doc_domain
+    ) const
+  {
+    auto exceptions = exceptions_.find(selector, StringHash(), StringEqual());
     if (exceptions == exceptions_.end()) {
       return nullptr;
     }
+    const SelectorExceptions &entry = exceptions->second;
 
-    for (auto exception = exceptions->second.begin();
-      exception != exceptions->second.end(); ++exception)
-    {
-      if ((*exception)->is_active_on_domain(doc_domain)) {
-        return *exception;
+    // An exception listed under one of the labels still has to be checked
+    // against the whole domain, a more specific label can exclude it
+    boost::string_ref label = doc_domain;
+    while (label.length() > 0 && entry.by_domain.size() > 0) {
+      auto list = entry.by_domain.find(label, StringHash(), StringEqual());
+      if (list != entry.by_domain.end()) {
+        for (auto iter = list->second.begin(); iter != list->second.end(); ++iter) {
+          if ((*iter)->is_active_on_upper_domain(doc_domain)) {
+            return *iter;
+          }
+        }
+      }
+
+      size_t next_dot = label.find('.');
+      if (next_dot == boost::string_ref::npos) {
+        break;
       }
+      label.remove_prefix(next_dot + 1);
     }
 
+    for (auto iter = entry.generic.begin(); iter != entry.generic.end(); ++iter) {
+      if ((*iter)->is_active_on_upper_domain(doc_domain)) {
+        return *iter;
+      }
+    }
     return nullptr;
   }
 
   std::vector<std::string> ElemHide::get_selectors(
     const std::string &domain,
     bool specific
-    )
+    ) const
   {
+    update_index();
+
     std::vector<std::string> result;
-    for (auto iter = elem_filters_.begin();
-      iter != elem_filters_.end(); ++iter)
-    {
-      auto filter = *iter;
-      if (specific) {
-        auto domains = filter->get_domains();
-        if (domains.size() == 0 || domains.find("")->second) {
-          continue;
+    std::string upper_domain = boost::to_upper_copy(domain);
+    DomainMatches domains;
+    domains_.resolve(upper_domain, domains);
+    if (!specific) {
+      result = generic_selectors_;
+      for (auto iter = conditional_filters_.begin();
+        iter != conditional_filters_.end(); ++iter)
+      {
+        if ((*iter)->is_active_on(domains) &&
+          find_exception((*iter)->get_selector(), upper_domain) == nullptr)
+        {
+          result.push_back((*iter)->get_selector());
         }
       }
+    }
 
-      if (filter->is_active_on_domain(domain) &&
-        get_exception(filter, domain) != nullptr)
+    // Filters restricted to some domains are only active if one of the
+    // labels of the domain includes them, those are the rules resolved by
+    // the index. Generic filters never have an including rule.
+    for (uint32_t idx = 0; idx < domains.size(); ++idx) {
+      const ActiveFilter *filter = domains.get_filter(idx);
+      if (domains.get_include(idx) &&
+        filter->get_type() == ELEM_HIDE_FILTER)
       {
-        result.push_back(filter->get_selector());
+        const ElemHideFilter &elem_filter =
+          static_cast<const ElemHideFilter &>(*filter);
+        if (find_exception(elem_filter.get_selector(), upper_domain) == nullptr) {
+          result.push_back(elem_filter.get_selector());
+        }
       }
     }
     return result;
   }
 
+  boost::shared_ptr<const std::string> ElemHide::get_stylesheet(
+    const std::string &domain
+    ) const
+  {
+    std::string key = boost::to_upper_copy(domain);
+    size_t hash = StringHash()(key);
+    StylesheetShard &shard = stylesheet_shards_[hash % StylesheetShardCount];
+    {
+      boost::mutex::scoped_lock lock(shard.mutex);
+      StylesheetEntry *entry = shard.find(hash, key);
+      if (entry != nullptr) {
+        entry->referenced = true;
+        return entry->stylesheet;
+      }
+    }
+
+    std::vector<std::string> selectors = get_selectors(domain, false);
+    boost::shared_ptr<std::string> stylesheet(new std::string());
+    for (auto iter = selectors.begin(); iter != selectors.end(); ++iter) {
+      stylesheet->append(*iter);
+      stylesheet->append(" { display: none !important; }\n");
+    }
+
+    boost::mutex::scoped_lock lock(shard.mutex);
+    StylesheetEntry *target = shard.find(hash, key);
+    if (target != nullptr) {
+      // Built by another thread in the meantime
+      return target->stylesheet;
+    }
+    for (uint32_t way = 0; way < StylesheetWays && target == nullptr; ++way) {
+      if (shard.entries[way].stylesheet == nullptr) {
+        target = &shard.entries[way];
+      }
+    }
+    if (target == nullptr) {
+      // Second chance: skip and clear referenced entries until the hand
+      // finds one that hasn't been hit since its last pass
+      while (shard.entries[shard.hand].referenced) {
+        shard.entries[shard.hand].referenced = false;
+        shard.hand = (shard.hand + 1) % StylesheetWays;
+      }
+      target = &shard.entries[shard.hand];
+      shard.hand = (shard.hand + 1) % StylesheetWays;
+    }
+    target->hash = hash;
+    target->domain.swap(key);
+    target->stylesheet = stylesheet;
+    target->referenced = false;
+    return stylesheet;
+  }
+
+  ElemHide::StylesheetEntry *ElemHide::StylesheetShard::find(
+    size_t hash,
+    const std::string &domain
+    )
+  {
+    for (uint32_t way = 0; way < StylesheetWays; ++way) {
+      StylesheetEntry &entry = entries[way];
+      if (entry.stylesheet != nullptr && entry.hash == hash &&
+        entry.domain == domain)
+      {
+        return &entry;
+      }
+    }
+    return nullptr;
+  }
+
+  void ElemHide::update_index() const {
+    if (index_ready_.load(boost::memory_order_acquire)) {
+      return;
+    }
+
+    boost::mutex::scoped_lock lock(mutex_);
+    if (index_ready_.load(boost::memory_order_relaxed)) {
+      return;
+    }
+
+    generic_selectors_.clear();
+    conditional_filters_.clear();
+    for (auto iter = elem_filters_.begin(); iter != elem_filters_.end(); ++iter) {
+      const ElemHideFilter *filter = iter->get();
+      const ActiveFilter::DomainMap &domains = filter->get_domains();
+      if (domains.size() > 0 && !domains.find("")->second) {
+        // Found through the domain index
+        continue;
+      }
+
+      if (domains.size() == 0 &&
+        exceptions_.find(filter->get_selector()) == exceptions_.end())
+      {
+        generic_selectors_.push_back(filter->get_selector());
+      } else {
+        conditional_filters_.push_back(filter);
+      }
+    }
+    index_ready_.store(true, boost::memory_order_release);
+  }
+
+  void ElemHide::invalidate() {
+    index_ready_.store(false, boost::memory_order_relaxed);
+    generic_selectors_.clear();
+    conditional_filters_.clear();
+    for (uint32_t idx = 0; idx < StylesheetShardCount; ++idx) {
+      StylesheetShard &shard = stylesheet_shards_[idx];
+      for (uint32_t way = 0; way < StylesheetWays; ++way) {
+        shard.entries[way] = StylesheetEntry();
+      }
+      shard.hand = 0;
+    }
+  }
+
 }
@@ -11,13 +11,30 @@
 
 
 #include "Filter.h"
+#include "DomainIndex.h"
+#include <boost/atomic.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/thread/mutex.hpp>
 #include <boost/unordered_set.hpp>
 
 
 namespace NS_ADBLOCK {
 
-  class ElemHide {
+  /**
+   * Element hiding rules indexed for lookups by document domain.
+   *
+   * Selectors of filters without domain restrictions and without any
+   * exception are kept in a prebuilt list, the domain restrictions of the
+   * other filters are kept in a DomainIndex. A lookup resolves the labels
+   * of the domain once and only visits the filters naming one of them,
+   * plus the few generic filters that can be switched off by an exception
+   * or an excluded domain. The lists are rebuilt by the first lookup after
+   * a change, lookups from several threads are safe as long as nobody
+   * modifies the rules at the same time.
+   */
+  class ElemHide: private boost::noncopyable {
   public:
+    ElemHide();
 
     /**
      * Removes all known filters
@@ -34,22 +51,57 @@ namespace NS_ADBLOCK {
      */
     void remove(const ElemHideBasePtr &filter);
 
+    typedef std::vector<ElemHideBasePtr> Filters;
+
+    /**
+     * Removes and adds filters in one batch, the style sheets are
+     * rebuilt once by the next lookup
+     */
+    void update(const Filters &removed, const Filters &added);
+
     /**
      * Checks whether an exception rule is registered for a filter
      * on a particular domain
      */
     ElemHideExceptionPtr get_exception(const ElemHideBasePtr &filter,
-      const std::string &doc_domain);
+      const std::string &doc_domain) const;
 
     /**
      * Returns a list of all selectors active on a particular domain
      * (currently used only in Chrome).
      */
     std::vector<std::string> get_selectors(const std::string &domain,
-      bool specific);
+      bool specific) const;
+
+    /**
+     * Style sheet hiding all selectors active on a particular domain.
+     * Up to StylesheetCacheSize style sheets are cached until the rules
+     * change, spread over StylesheetShardCount shards by the hash of the
+     * domain. A lookup only locks the shard of its domain and a hit only
+     * sets a reference bit; a full shard drops an entry with the CLOCK
+     * (second chance) policy to make room for a new domain.
+     */
+    boost::shared_ptr<const std::string> get_stylesheet(
+      const std::string &domain) const;
+
+    /**
+     * Builds the lists get_selectors() and get_stylesheet() would build
+     * on their first call
+     */
+    void prepare() const { update_index(); }
+
+    static const uint32_t StylesheetCacheSize = 256;
+
+    static const uint32_t StylesheetShardCount = 16;
 
   private:
 
+    /**
+     * Same as get_exception() for a selector and an uppercase domain
+     */
+    ElemHideExceptionPtr find_exception(boost::string_ref selector,
+      boost::string_ref doc_domain) const;
+
     typedef boost::unordered_set<ElemHideFilterPtr> ElemFilters;
     /**
      * Element hiding filters
@@ -62,11 +114,122 @@ namespace NS_ADBLOCK {
      */
     KnownExceptions known_exceptions_;
 
-    typedef boost::unordered_map<std::string, std::vector<ElemHideExceptionPtr>> Exceptions;
+    typedef std::vector<ElemHideExceptionPtr> ExceptionList;
+
     /**
-     * Lookup table, lists of element hiding exceptions by selector
+     * Exceptions of one selector. An exception with domain restrictions
+     * is listed under every domain it includes, exceptions that don't
+     * include any domain are active everywhere except on the domains
+     * they exclude.
+     */
+    struct SelectorExceptions {
+      ExceptionList all;
+
+      typedef boost::unordered_map<std::string, ExceptionList, StringHash> ByDomain;
+      ByDomain by_domain;
+
+      ExceptionList generic;
+    };
+
+    typedef boost::unordered_map<std::string, SelectorExceptions, StringHash> Exceptions;
+    /**
+     * Lookup table of element hiding exceptions by selector and domain,
+     * finding the exception of a selector on a domain takes one probe
+     * for the selector and one per label of the domain
      */
     Exceptions exceptions_;
+
+    /**
+     * Domain restrictions of the filters, get_selectors() resolves the
+     * domain once for all of them
+     */
+    DomainIndex domains_;
+
+    /**
+     * Builds generic_selectors_ and conditional_filters_ if the rules
+     * changed since the last lookup
+     */
+    void update_index() const;
+
+    /**
+     * Drops the prebuilt lists and the cached style sheets
+     */
+    void invalidate();
+
+    /**
+     * Selectors active on every domain
+     */
+    mutable std::vector<std::string> generic_selectors_;
+
+    typedef std::vector<const ElemHideFilter *> FilterList;
+    /**
+     * Filters active on every domain except the ones they exclude, or
+     * with a selector that has exceptions
+     */
+    mutable FilterList conditional_filters_;
+
+    /**
+     * Whether the lists above match the current rules
+     */
+    mutable boost::atomic<bool> index_ready_;
+
+    /**
+     * Guards the lazy rebuild of the lists
+     */
+    mutable boost::mutex mutex_;
+
+    /**
+     * Number of style sheets in a shard
+     */
+    static const uint32_t StylesheetWays = StylesheetCacheSize / StylesheetShardCount;
+
+    struct StylesheetEntry {
+      StylesheetEntry(): hash(0), referenced(false) { }
+
+      size_t hash;
+
+      /**
+       * Uppercase domain
+       */
+      std::string domain;
+
+      /**
+       * Null if the entry is free
+       */
+      boost::shared_ptr<const std::string> stylesheet;
+
+      /**
+       * CLOCK reference bit, set on every hit
+       */
+      bool referenced;
+    };
+
+    struct StylesheetShard {
+      StylesheetShard(): hand(0) { }
+
+      /**
+       * Entry of an uppercase domain, null if it is not cached
+       */
+      StylesheetEntry *find(size_t hash, const std::string &domain);
+
+      StylesheetEntry entries[StylesheetWays];
+
+      /**
+       * CLOCK hand
+       */
+      uint32_t hand;
+
+      /**
+       * Guards the entries and the hand
+       */
+      boost::mutex mutex;
+    };
+
+    /**
+     * Cached style sheets, the shard of a domain is picked by the hash
+     * of its uppercase form
+     */
+    mutable StylesheetShard stylesheet_shards_[StylesheetShardCount];
   };
 
 }
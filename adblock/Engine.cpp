@@ -0,0 +1,99 @@
+#include "Engine.h"
+#include "ListParser.h"
+
+
+namespace NS_ADBLOCK {
+
+  Engine::Engine(const std::vector<FilterPtr> &filters):
+    // The const queries go through matches_any_internal(), never the cache
+    matcher_(0)
+  {
+    for (auto iter = filters.begin(); iter != filters.end(); ++iter) {
+      switch ((*iter)->get_type()) {
+      case BLOCKING_FILTER:
+      case WHITELIST_FILTER:
+        matcher_.add(boost::static_pointer_cast<RegExpFilter>(*iter));
+        filters_.push_back(*iter);
+        break;
+      case ELEM_HIDE_FILTER:
+      case ELEM_HIDE_EXCEPTION:
+        elem_hide_.add(boost::static_pointer_cast<ElemHideBase>(*iter));
+        filters_.push_back(*iter);
+        break;
+      default:
+        break;
+      }
+    }
+
+    // Keywords picked one filter at a time depend on the list order
+    matcher_.rebalance();
+  }
+
+  EnginePtr Engine::from_lines(const std::vector<std::string> &lines) {
+    std::vector<FilterPtr> filters;
+    filters.reserve(lines.size());
+    for (auto iter = lines.begin(); iter != lines.end(); ++iter) {
+      FilterPtr filter = Filter::from_text(*iter);
+      if (filter != nullptr) {
+        filters.push_back(filter);
+      }
+    }
+    Filter::report_invalid(filters);
+    return EnginePtr(new Engine(filters));
+  }
+
+  EnginePtr Engine::from_buffer(
+    boost::string_ref buffer,
+    uint32_t thread_count
+    )
+  {
+    return EnginePtr(new Engine(ListParser::parse(buffer, thread_count)));
+  }
+
+  Engine::WarmUpStats Engine::warm_up() const {
+    boost::chrono::high_resolution_clock::time_point start =
+      boost::chrono::high_resolution_clock::now();
+    WarmUpStats stats;
+
+    // Filters compile their patterns and RegExps when they are parsed,
+    // only the element hiding lists are left to the first query
+    elem_hide_.prepare();
+
+    stats.elapsed = boost::chrono::duration_cast<boost::chrono::microseconds>(
+      boost::chrono::high_resolution_clock::now() - start);
+    return stats;
+  }
+
+  RegExpFilterPtr Engine::matches_any(const Request &request) const {
+    return matcher_.matches_any_internal(request);
+  }
+
+  void Engine::matches_page(PageBatch &batch) const {
+    matcher_.matches_page(batch);
+  }
+
+  RegExpFilterPtr Engine::matches_by_key(
+    const std::string &location,
+    const std::string &key,
+    const std::string &doc_domain
+    ) const
+  {
+    return matcher_.matches_by_key(location, key, doc_domain);
+  }
+
+  std::vector<std::string> Engine::get_selectors(
+    const std::string &domain,
+    bool specific
+    ) const
+  {
+    return elem_hide_.get_selectors(domain, specific);
+  }
+
+  boost::shared_ptr<const std::string> Engine::get_stylesheet(
+    const std::string &domain
+    ) const
+  {
+    return elem_hide_.get_stylesheet(domain);
+  }
+
+}
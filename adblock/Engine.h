@@ -0,0 +1,140 @@
+/*!
+ * \file Engine.h
+ *
+ * \author yorath
+ * \date October 29, 2013
+ *
+ * \details Immutable snapshot of a filter list that can be queried from
+ * any number of threads.
+ */
+
+#pragma once
+
+
+#include "Filter.h"
+#include "Matcher.h"
+#include "ElemHide.h"
+#include "Request.h"
+#include <boost/chrono.hpp>
+#include <boost/noncopyable.hpp>
+
+
+namespace NS_ADBLOCK {
+
+  class Engine;
+
+  /**
+   * Engines are never modified once built, hence the const
+   */
+  typedef boost::shared_ptr<const Engine> EnginePtr;
+
+  /**
+   * A fully built filter list.
+   *
+   * Everything the blocking queries need is materialized by the
+   * constructor: filters parse their domains and compile their patterns
+   * when they are created, and the keyword tables are filled here. All
+   * queries are const, blocking queries don't use any cache so they take
+   * no locks. The element hiding lists are built by the first element
+   * hiding query or by warm_up(), and a style sheet lookup only locks one
+   * shard of the style sheet cache. A new filter list is applied by
+   * building a new engine and publishing it with Adblock::set_engine().
+   */
+  class Engine: private boost::noncopyable {
+  public:
+    /**
+     * Builds an engine from parsed filters, comments and invalid
+     * filters are skipped
+     */
+    explicit Engine(const std::vector<FilterPtr> &filters);
+
+    /**
+     * Parses a filter list and builds an engine from it, the invalid
+     * filters are reported to Filter::get_diagnostics()
+     */
+    static EnginePtr from_lines(const std::vector<std::string> &lines);
+
+    /**
+     * Parses a filter list buffer with ListParser and builds an engine
+     * from it, 0 threads means one per core
+     */
+    static EnginePtr from_buffer(boost::string_ref buffer,
+      uint32_t thread_count = 0);
+
+    /**
+     * @see CombindMatcher#matches_any_internal
+     */
+    RegExpFilterPtr matches_any(const Request &request) const;
+
+    /**
+     * @see CombindMatcher#matches_page
+     */
+    void matches_page(PageBatch &batch) const;
+
+    /**
+     * @see CombindMatcher#matches_by_key
+     */
+    RegExpFilterPtr matches_by_key(const std::string &location,
+      const std::string &key, const std::string &doc_domain) const;
+
+    /**
+     * @see ElemHide#get_selectors
+     */
+    std::vector<std::string> get_selectors(const std::string &domain,
+      bool specific) const;
+
+    /**
+     * @see ElemHide#get_stylesheet
+     */
+    boost::shared_ptr<const std::string> get_stylesheet(
+      const std::string &domain) const;
+
+    /**
+     * Result of warm_up()
+     */
+    struct WarmUpStats {
+      WarmUpStats(): elapsed(0) { }
+
+      boost::chrono::microseconds elapsed;
+    };
+
+    /**
+     * Does ahead of time what the first queries would otherwise do:
+     * builds the element hiding lists. Patterns and RegExps are compiled
+     * when the filters are parsed, matching never compiles anything.
+     * Meant to be called before the engine is published.
+     */
+    WarmUpStats warm_up() const;
+
+    /**
+     * Number of active filters in the engine
+     */
+    uint32_t get_filter_count() const {
+      return static_cast<uint32_t>(filters_.size());
+    }
+
+    /**
+     * Active filters in the order they were added
+     */
+    const std::vector<FilterPtr> &get_filters() const { return filters_; }
+
+    /**
+     * Blocking and exception rules, used to serialize the keyword buckets
+     */
+    const CombindMatcher &get_matcher() const { return matcher_; }
+
+  private:
+    /**
+     * Blocking and exception rules, built without a result cache
+     */
+    CombindMatcher matcher_;
+
+    /**
+     * Element hiding rules
+     */
+    ElemHide elem_hide_;
+
+    std::vector<FilterPtr> filters_;
+  };
+
+}
@@ -1,9 +1,16 @@
 #include "Filter.h"
+#include "Request.h"
+#include "DomainIndex.h"
+#include "FilterOptions.h"
+#include "Diagnostics.h"
+#include "FilterProfiler.h"
 #include <boost/algorithm/string/split.hpp>
 #include <boost/algorithm/string/case_conv.hpp>
 #include <boost/algorithm/string/classification.hpp>
 #include <boost/assign/list_of.hpp>
-#include <boost/logic/tribool_io.hpp>
+#include <boost/chrono.hpp>
+#include <boost/unordered_set.hpp>
+#include <algorithm>
 
 
 namespace NS_ADBLOCK {
@@ -22,79 +29,322 @@ namespace NS_ADBLOCK {
   }
 
 
-  Filter::KnownFilters Filter::known_filters_;
+  FilterPtr FilterRegistry::find(const std::string &text) const {
+    const Shard &shard = get_shard(text);
+    boost::mutex::scoped_lock lock(shard.mutex);
+    auto iter = shard.filters.find(text);
+    return iter != shard.filters.end() ? iter->second : nullptr;
+  }
+
+  FilterPtr FilterRegistry::insert(const FilterPtr &filter) {
+    Shard &shard = get_shard(filter->get_text());
+    boost::mutex::scoped_lock lock(shard.mutex);
+    return shard.filters.insert(std::make_pair(filter->get_text(), filter)).first->second;
+  }
+
+  void FilterRegistry::clear() {
+    for (uint32_t idx = 0; idx < ShardCount; ++idx) {
+      boost::mutex::scoped_lock lock(shards_[idx].mutex);
+      shards_[idx].filters.clear();
+    }
+  }
+
+  size_t FilterRegistry::size() const {
+    size_t result = 0;
+    for (uint32_t idx = 0; idx < ShardCount; ++idx) {
+      boost::mutex::scoped_lock lock(shards_[idx].mutex);
+      result += shards_[idx].filters.size();
+    }
+    return result;
+  }
+
+
+  FilterRegistry Filter::known_filters_;
 
-  const std::string &Filter::get_text() {
+  ParseDiagnosticsPtr Filter::diagnostics_;
+
+  const std::string &Filter::get_text() const {
     return text_;
   }
 
+  namespace {
+
+    /**
+     * \s of the regular expressions, in the C locale
+     */
+    inline bool is_space(char ch) {
+      return ch == ' ' || (ch >= '\t' && ch <= '\r');
+    }
+
+    /**
+     * [\w\-] of the regular expressions, in the C locale
+     */
+    inline bool is_word(char ch) {
+      return (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') ||
+        (ch >= '0' && ch <= '9') || ch == '_' || ch == '-';
+    }
+
+    /**
+     * Tests ^\|?[\w\-]+: , filters starting with a protocol name
+     */
+    bool starts_with_protocol(const std::string &text) {
+      size_t pos = (text.length() > 0 && text[0] == '|') ? 1 : 0;
+      size_t begin = pos;
+      while (pos < text.length() && is_word(text[pos])) {
+        ++pos;
+      }
+      return pos > begin && pos < text.length() && text[pos] == ':';
+    }
+
+    void remove_spaces(std::string &text, size_t begin, size_t end) {
+      text.erase(std::remove(text.begin() + begin, text.begin() + end, ' '),
+        text.begin() + end);
+    }
+
+    void trim_spaces(std::string &text, size_t begin) {
+      size_t first = text.find_first_not_of(' ', begin);
+      if (first == std::string::npos) {
+        text.erase(begin);
+        return;
+      }
+      text.erase(text.find_last_not_of(' ') + 1);
+      text.erase(begin, first - begin);
+    }
+
+    /**
+     * Matches the part of ElemHideRegex after the domain, text[pos] is
+     * the first '#'
+     */
+    bool parse_elem_hide_rule(
+      boost::string_ref text,
+      size_t pos,
+      Filter::ElemHideParts &parts
+      )
+    {
+      size_t length = text.length();
+      ++pos;
+      parts.is_exception = pos < length && text[pos] == '@';
+      if (parts.is_exception) {
+        ++pos;
+      }
+
+      // #([^{}]+)
+      if (pos < length && text[pos] == '#') {
+        ++pos;
+        if (pos == length) {
+          return false;
+        }
+        for (size_t idx = pos; idx < length; ++idx) {
+          if (text[idx] == '{' || text[idx] == '}') {
+            return false;
+          }
+        }
+        parts.tag_name.clear();
+        parts.attr_rules.clear();
+        parts.selector = text.substr(pos);
+        return true;
+      }
+
+      // ([\w\-]+|\*)
+      size_t tag_begin = pos;
+      if (pos < length && text[pos] == '*') {
+        ++pos;
+      } else {
+        while (pos < length && is_word(text[pos])) {
+          ++pos;
+        }
+      }
+      if (pos == tag_begin) {
+        return false;
+      }
+      parts.tag_name = text.substr(tag_begin, pos - tag_begin);
+
+      // ((?:\([\w\-]+(?:[$^*]?=[^\(\)"]*)?\))*)
+      size_t attr_begin = pos;
+      while (pos < length) {
+        if (text[pos++] != '(') {
+          return false;
+        }
+        size_t name_begin = pos;
+        while (pos < length && is_word(text[pos])) {
+          ++pos;
+        }
+        if (pos == name_begin) {
+          return false;
+        }
+        if (pos < length && (text[pos] == '$' || text[pos] == '^' || text[pos] == '*')) {
+          if (++pos == length || text[pos] != '=') {
+            return false;
+          }
+        }
+        if (pos < length && text[pos] == '=') {
+          ++pos;
+          while (pos < length && text[pos] != '(' && text[pos] != ')' && text[pos] != '"') {
+            ++pos;
+          }
+        }
+        if (pos == length || text[pos++] != ')') {
+          return false;
+        }
+      }
+      parts.attr_rules = text.substr(attr_begin);
+      parts.selector.clear();
+      return true;
+    }
+
+  }
+
+  bool Filter::parse_elem_hide(boost::string_ref text, ElemHideParts &parts) {
+    // The domain is the shortest prefix without /*|@"! that lets the rest
+    // match, so every '#' is tried in turn
+    for (size_t pos = 0; pos < text.length(); ++pos) {
+      char ch = text[pos];
+      if (ch == '#') {
+        if (parse_elem_hide_rule(text, pos, parts)) {
+          parts.domain = text.substr(0, pos);
+          return true;
+        }
+      } else if (ch == '/' || ch == '*' || ch == '|' || ch == '@' || ch == '"' || ch == '!') {
+        return false;
+      }
+    }
+    return false;
+  }
+
   std::string Filter::normalize(std::string text) {
+    ElemHideParts parts;
+    normalize(text, parts);
+    return text;
+  }
+
+  FILTER_TYPE Filter::normalize(std::string &text, ElemHideParts &parts) {
     if (text.length() == 0) {
-      return text;
+      return REGEXP_FILTER;
     }
 
-    // Remove line breaks and such
-    text = boost::regex_replace(text, boost::regex("[^\\S ]"), "");
+    // Remove line breaks and such, remembering where the text starts and
+    // where the first '#' is
+    size_t length = 0;
+    size_t first = std::string::npos;
+    size_t hash = std::string::npos;
+    for (size_t idx = 0; idx < text.length(); ++idx) {
+      char ch = text[idx];
+      if (ch != ' ' && is_space(ch)) {
+        continue;
+      }
+      if (first == std::string::npos && ch != ' ') {
+        first = length;
+      }
+      if (hash == std::string::npos && ch == '#') {
+        hash = length;
+      }
+      text[length++] = ch;
+    }
+    text.resize(length);
 
-    if (boost::regex_search(text, boost::regex("^\\s*!"))) {
+    if (first != std::string::npos && text[first] == '!') {
       // Don't remove spaces inside comments
-      return boost::regex_replace(
-        boost::regex_replace(text, boost::regex("^\\s+"), ""),
-        boost::regex("\\s+$"),
-        "");
-    } else if (boost::regex_search(text, Filter::ElemHideRegex)) {
-      // Special treatment for element hiding filters, right side is allowed to contain spaces
-      boost::smatch match;
-      if (boost::regex_search(text, match, boost::regex("^(.*?)(#\\@?#?)(.*)$"))) {
-        //std::cout << match[1].str() << " " << match[2].str() << " " << match[3].str() << std::endl;
-        return boost::regex_replace(match[1].str(), boost::regex("\\s"), "")
-          + match[2].str() + boost::regex_replace(
-          boost::regex_replace(match[3].str(), boost::regex("^\\s+"), ""),
-          boost::regex("\\s+$"),
-          "");
+      trim_spaces(text, 0);
+      return COMMENT_FILTER;
+    }
+    if (hash == std::string::npos) {
+      remove_spaces(text, 0, text.length());
+      return REGEXP_FILTER;
+    }
+
+    bool elem_hide = parse_elem_hide(text, parts);
+    if (elem_hide) {
+      // Special treatment for element hiding filters, right side is
+      // allowed to contain spaces
+      size_t rule = hash + 1;
+      if (rule < text.length() && text[rule] == '@') {
+        ++rule;
       }
+      if (rule < text.length() && text[rule] == '#') {
+        ++rule;
+      }
+      trim_spaces(text, rule);
+      remove_spaces(text, 0, hash);
+    } else {
+      remove_spaces(text, 0, text.length());
+    }
+
+    if (text.length() != length) {
+      // Removed spaces moved the parts or changed what matches, the
+      // filter is classified by its normalized text
+      elem_hide = parse_elem_hide(text, parts);
     }
-    return boost::regex_replace(text, boost::regex("\\s"), "");
+    return elem_hide ? ELEM_HIDE_BASE : REGEXP_FILTER;
   }
 
   FilterPtr Filter::from_text(std::string text) {
     FilterPtr result = nullptr;
 
-    text = normalize(text);
+    ElemHideParts parts;
+    FILTER_TYPE type = normalize(text, parts);
     if (text.length() == 0) {
       return nullptr;
     }
 
-    auto iter = known_filters_.find(text);
-    if (iter != known_filters_.end()) {
-      return iter->second;
+    result = known_filters_.find(text);
+    if (result != nullptr) {
+      return result;
     }
 
-    if (text.front() == '!') {
+    if (type == COMMENT_FILTER) {
       result = FilterPtr(new CommentFilter(text));
-      goto done;
-    } else if (text.find('#') != std::string::npos) {
-      boost::smatch match;
-      if (boost::regex_search(text, match, ElemHideRegex)) {
-        result = ElemHideBase::from_text(text, match[1].str(),
-          match[2].matched, match[3].str(), match[4].str(), match[5].str());
-        goto done;
-      }
+    } else if (type == ELEM_HIDE_BASE) {
+      std::string tag_name(parts.tag_name.begin(), parts.tag_name.end());
+      std::string selector(parts.selector.begin(), parts.selector.end());
+      result = ElemHideBase::from_text(text,
+        std::string(parts.domain.begin(), parts.domain.end()), parts.is_exception,
+        tag_name, std::string(parts.attr_rules.begin(), parts.attr_rules.end()),
+        selector);
+    } else {
+      result = RegExpFilter::from_text(text);
     }
-    result = RegExpFilter::from_text(text);
 
-  done:
-    known_filters_[result->text_] = result;
-    return result;
+    // Another thread may have registered the same text in the meantime
+    return known_filters_.insert(result);
+  }
+
+  void Filter::set_diagnostics(const ParseDiagnosticsPtr &diagnostics) {
+    boost::atomic_store(&diagnostics_, diagnostics);
   }
 
+  ParseDiagnosticsPtr Filter::get_diagnostics() {
+    return boost::atomic_load(&diagnostics_);
+  }
+
+  void Filter::report_invalid(const std::vector<FilterPtr> &filters) {
+    ParseDiagnosticsPtr diagnostics = get_diagnostics();
+    if (diagnostics == nullptr) {
+      return;
+    }
+
+    boost::unordered_set<const Filter *> reported;
+    for (auto iter = filters.begin(); iter != filters.end(); ++iter) {
+      if ((*iter)->get_type() == INVALID_FILTER && reported.insert(iter->get()).second) {
+        diagnostics->on_invalid_filter(static_cast<const InvalidFilter &>(**iter));
+      }
+    }
+  }
+
+
+  boost::atomic<uint32_t> ActiveFilter::next_id_(0);
 
   ActiveFilter::ActiveFilter(
     const std::string &text,
-    const std::string &domains
-    ): Filter(text)
+    const std::string &domains,
+    const std::string &domain_separator,
+    bool ignore_trailing_dot
+    ): Filter(text), id_(next_id_.fetch_add(1, boost::memory_order_relaxed)),
+    disabled_(false), hit_count_(0), last_hit_(0)
   {
-    domain_source_ = domains;
+    domain_separator_ = domain_separator;
+    ignore_trailong_dot_ = ignore_trailing_dot;
+    domain_default_ = true;
+    parse_domains(domains);
   }
 
   bool ActiveFilter::get_disabled() const {
@@ -102,11 +352,7 @@ namespace NS_ADBLOCK {
   }
 
   void ActiveFilter::set_disabled(bool disabled) {
-    if (disabled_ != disabled) {
-      bool old = disabled_;
-      disabled_ = disabled;
-      // TODO
-    }
+    disabled_ = disabled;
   }
 
   uint32_t ActiveFilter::get_hit_count() const {
@@ -114,11 +360,7 @@ namespace NS_ADBLOCK {
   }
 
   void ActiveFilter::set_hit_count(uint32_t hit_count) {
-    if (hit_count_ != hit_count) {
-      uint32_t old = hit_count_;
-      hit_count_ = hit_count;
-      // TODO
-    }
+    hit_count_ = hit_count;
   }
 
   time_t ActiveFilter::get_last_hit() const {
@@ -126,55 +368,54 @@ namespace NS_ADBLOCK {
   }
 
   void ActiveFilter::set_last_hit(time_t last_hit) {
-    if (last_hit_ != last_hit) {
-      time_t old = last_hit_;
-      last_hit_ = last_hit;
-      // TODO
-    }
-  }
-
-  const ActiveFilter::DomainMap & ActiveFilter::get_domains() {
-    if (domain_source_.length() > 0) {
-      std::vector<std::string> list;
-      boost::split(list, domain_source_, boost::is_any_of(domain_separator_), boost::token_compress_on);
-      if (list.size() == 1 && list.front().front() != '~') {
-        // Fast track for the common one-domain scenario
-        domains_[""] = false;
-        if (ignore_trailong_dot_) {
-          list.front() = boost::regex_replace(list.front(), boost::regex("\\.+$"), "");
-        }
-        domains_[list.front()] = true;
-      } else {
-        bool hasIncludes = false;
-        for (auto iter = list.begin(); iter != list.end(); ++iter) {
-          std::string domain = *iter;
-          if (ignore_trailong_dot_) {
-            domain = boost::regex_replace(domain, boost::regex("\\.+$"), "");
-          }
-          if (domain.length() == 0) {
-            continue;
-          }
+    last_hit_ = last_hit;
+  }
 
-          bool include = false;
-          if (domain.front() == '~') {
-            include = false;
-            domain = domain.substr(1);
-          } else {
-            include = true;
-            hasIncludes = true;
-          }
+  const ActiveFilter::DomainMap &ActiveFilter::get_domains() const {
+    return domains_;
+  }
 
-          domains_[domain] = include;
-        }
-        domains_[""] = !hasIncludes;
+  void ActiveFilter::parse_domains(const std::string &domains) {
+    if (domains.length() == 0) {
+      return;
+    }
+
+    std::vector<std::string> list;
+    boost::split(list, domains, boost::is_any_of(domain_separator_), boost::token_compress_on);
+    bool hasIncludes = false;
+    for (auto iter = list.begin(); iter != list.end(); ++iter) {
+      std::string &domain = *iter;
+      if (ignore_trailong_dot_) {
+        domain.erase(domain.find_last_not_of('.') + 1);
+      }
+      if (domain.length() == 0) {
+        continue;
       }
-      domain_source_.clear();
+
+      bool include = false;
+      if (domain.front() == '~') {
+        include = false;
+        domain = domain.substr(1);
+      } else {
+        include = true;
+        hasIncludes = true;
+      }
+
+      domains_[domain] = include;
     }
-    return domains_;
+    domains_[""] = !hasIncludes;
+    domain_default_ = !hasIncludes;
+  }
+
+  bool ActiveFilter::is_active_on_domain(const std::string &doc_domain) const {
+    return is_active_on_upper_domain(boost::to_upper_copy(doc_domain));
   }
 
-  bool ActiveFilter::is_active_on_domain(std::string doc_domain) {
-    const DomainMap &domains = get_domains();
+  bool ActiveFilter::is_active_on_upper_domain(
+    boost::string_ref doc_domain
+    ) const
+  {
+    const DomainMap &domains = domains_;
     if (domains.size() == 0) {
       return true;
     }
@@ -184,46 +425,38 @@ namespace NS_ADBLOCK {
     }
 
     if (ignore_trailong_dot_) {
-      doc_domain = boost::regex_replace(doc_domain, boost::regex("\\.+$"), "");
+      while (doc_domain.length() > 0 && doc_domain.back() == '.') {
+        doc_domain.remove_suffix(1);
+      }
     }
-    boost::to_upper(doc_domain);
 
     while (true) {
-      auto iter = domains.find(doc_domain);
+      auto iter = domains.find(doc_domain, StringHash(), StringEqual());
       if (iter != domains.end()) {
         return iter->second;
       }
 
       size_t next_dot = doc_domain.find('.');
-      if (next_dot == std::string::npos) {
+      if (next_dot == boost::string_ref::npos) {
         break;
       }
-      doc_domain = doc_domain.substr(next_dot + 1);
+      doc_domain.remove_prefix(next_dot + 1);
     }
     return domains.find("")->second;
   }
 
+  bool ActiveFilter::is_active_on(const DomainMatches &matches) const {
+    if (domains_.size() == 0) {
+      return true;
+    }
+
+    boost::tribool include = matches.find(this);
+    if (boost::indeterminate(include)) {
+      return domain_default_;
+    }
+    return include ? true : false;
+  }
 
-#define TYPE_OTHER              0x00000001
-#define TYPE_SCRIPT             0x00000002
-#define TYPE_IMAGE              0x00000004
-#define TYPE_STYLESHEET         0x00000008
-#define TYPE_OBJECT             0x00000010
-#define TYPE_SUBDOCUMENT        0x00000020
-#define TYPE_DOCUMENT           0x00000040
-#define TYPE_XBL                0x00000001
-#define TYPE_PING               0x00000001
-#define TYPE_XMLHTTPREQUEST     0x00000800
-#define TYPE_OBJECT_SUBREQUEST  0x00001000
-#define TYPE_DTD                0x00000001
-#define TYPE_MEDIA              0x00004000
-#define TYPE_FONT               0x00008000
-#define TYPE_BACKGROUND         0x00000004
-#define TYPE_POPUP              0x10000000
-#define TYPE_ELEMHIDE           0x40000000
-
-#define ALL_CONTENT_TYPE        0x7FFFFFFF
-#define DEFAULT_CONTENT_TYPE    ALL_CONTENT_TYPE & ~(TYPE_POPUP | TYPE_ELEMHIDE)
 
   const RegExpFilter::TypeMap RegExpFilter::type_map_ = boost::assign::map_list_of
     ("OTHER", TYPE_OTHER)
@@ -244,6 +477,14 @@ namespace NS_ADBLOCK {
     ("POPUP", TYPE_POPUP)
     ("ELEMHIDE", TYPE_ELEMHIDE);
 
+  CONTENT_TYPE RegExpFilter::get_content_type(const std::string &content_type) {
+    auto iter = type_map_.find(content_type);
+    if (iter == type_map_.end()) {
+      return static_cast<CONTENT_TYPE>(0);
+    }
+    return static_cast<CONTENT_TYPE>(iter->second);
+  }
+
   RegExpFilter::RegExpFilter(
     const std::string &text,
     const std::string &regex_source,
@@ -251,31 +492,47 @@ namespace NS_ADBLOCK {
     bool match_case,
     const std::string &domains,
     const boost::tribool &third_party
-    ): ActiveFilter(text, domains)
+    ): ActiveFilter(text, domains, "|", true)
   {
-    domain_separator_ = "|";
-
     content_type_ = content_type;
     match_case_ = match_case;
     third_party_ = third_party;
+    regex_source_ = regex_source;
 
     if (regex_source.length() >= 2 && regex_source.front() == '/'
       && regex_source.back() == '/')
     {
       // The filter is a regular expression - convert it immediately to
       // catch syntax errors
-      regex_ = boost::regex(regex_source.substr(1, regex_source.length() - 2),
-        match_case_ ? 0 : boost::regex::icase);
+      is_regex_ = true;
+      regex_.reset(new boost::regex(translate_regex(),
+        match_case_ ? 0 : boost::regex::icase));
     } else {
-      // No need to convert this filter to regular expression yet, do it on demand
-      regex_source_ = regex_source;
+      // Compiling the native pattern is cheap, do it now so that matching
+      // never has to modify the filter
+      is_regex_ = false;
+      pattern_.compile(regex_source_, match_case_);
     }
   }
 
-  const boost::regex &RegExpFilter::get_regex() {
+  RegexPtr RegExpFilter::get_regex() const {
+    if (is_regex_) {
+      return regex_;
+    }
+
+    return RegexPtr(new boost::regex(translate_regex(),
+      match_case_ ? 0 : boost::regex::icase));
+  }
+
+  std::string RegExpFilter::translate_regex() const {
+    if (is_regex_) {
+      return regex_source_.substr(1, regex_source_.length() - 2);
+    }
+
+    std::string source;
     if (regex_source_.length() > 0) {
       // Remove multiple wildcards
-      std::string source = boost::regex_replace(regex_source_, boost::regex("\\*+"), "*");
+      source = boost::regex_replace(regex_source_, boost::regex("\\*+"), "*");
 
       // Remove leading wildcards
       if (source.front() == '*') {
@@ -291,23 +548,25 @@ namespace NS_ADBLOCK {
       // remove anchors following separator placeholder
       source = boost::regex_replace(source, boost::regex("\\^\\|$"), "^");
       // escape special symbols
-      source = boost::regex_replace(source, boost::regex("\\W"), "\\$&");
+      source = boost::regex_replace(source, boost::regex("\\W"), "\\\\$&");
       // replace wildcards by .*
-      source = boost::regex_replace(source, boost::regex("\\\\\\*"), ".*");
+      source = boost::regex_replace(source, boost::regex("\\\\\\*"), ".*",
+        boost::regex_constants::format_literal);
       // process separator placeholders (all ANSI characters but
       // alphanumeric characters and _%.-)
-      source = boost::regex_replace(source, boost::regex("\\\\\\^"), "(?:[\\x00-\\x24\\x26-\\x2C\\x2F\\x3A-\\x40\\x5B-\\x5E\\x60\\x7B-\\x80]|$)");
+      source = boost::regex_replace(source, boost::regex("\\\\\\^"), "(?:[\\x00-\\x24\\x26-\\x2C\\x2F\\x3A-\\x40\\x5B-\\x5E\\x60\\x7B-\\x80]|$)",
+        boost::regex_constants::format_literal);
       // process extended anchor at expression start
-      source = boost::regex_replace(source, boost::regex("^\\\\\\|\\\\\\|"), "^[\\w\\-]+:\\/+(?!\\/)(?:[^.\\/]+\\.)*?");
+      source = boost::regex_replace(source, boost::regex("^\\\\\\|\\\\\\|"), "^[\\w\\-]+:\\/+(?!\\/)(?:[^.\\/]+\\.)*?",
+        boost::regex_constants::format_literal);
       // process anchor at expression start
-      source = boost::regex_replace(source, boost::regex("^\\\\\\|"), "^");
+      source = boost::regex_replace(source, boost::regex("^\\\\\\|"), "^",
+        boost::regex_constants::format_literal);
       // process anchor at expression end
-      source = boost::regex_replace(source, boost::regex("\\\\\\|$"), "$");
-
-      regex_ = boost::regex(source, match_case_ ? 0 : boost::regex::icase);
-      regex_source_.clear();
+      source = boost::regex_replace(source, boost::regex("\\\\\\|$"), "$",
+        boost::regex_constants::format_literal);
     }
-    return RegexRegex;
+    return source;
   }
 
   FilterPtr RegExpFilter::from_text(const std::string &text) {
@@ -319,70 +578,34 @@ namespace NS_ADBLOCK {
       regex_source = regex_source.substr(2);
     }
 
-    std::vector<std::string> options;
-    uint32_t content_type = ALL_CONTENT_TYPE;
-    bool match_case = false;
+    FilterOptions options;
     std::string domains;
-    boost::tribool third_party = boost::indeterminate;
-    bool collapse = true;
     std::vector<std::string> site_keys;
-    if (regex_source.find('$') != std::string::npos) {
-      boost::smatch match;
-      if (boost::regex_search(regex_source, match, OptionsRegex)) {
-        boost::split(options, boost::to_upper_copy(match[1].str()),
-          boost::is_any_of(","), boost::token_compress_on);
-        regex_source = std::string(regex_source.begin(), match[0].first);
-
-        for (auto option = options.begin(); option != options.end(); ++option) {
-          std::string value;
-          size_t separator_idx = option->find('=');
-          if (separator_idx != std::string::npos) {
-            value = option->substr(separator_idx + 1);
-            *option = option->substr(0, separator_idx);
-          }
-          *option = boost::regex_replace(*option, boost::regex("-"), "_");
-
-          auto type_value = type_map_.find(*option);
-          if (type_value != type_map_.end()) {
-            if (content_type == ALL_CONTENT_TYPE) {
-              content_type = 0;
-            }
-            content_type |= type_value->second;
-          } else if (option->front() == '~' &&
-            (type_value = type_map_.find(option->substr(1))) != type_map_.end())
-          {
-            if (content_type == ALL_CONTENT_TYPE) {
-              content_type = DEFAULT_CONTENT_TYPE;
-            }
-            content_type &= ~type_value->second;
-          } else if (*option == "MATCH_CASE") {
-            match_case = true;
-          } else if (*option == "~MATCH_CASE") {
-            match_case = false;
-          } else if (*option == "DOMAIN" && value.length() > 0) {
-            domains = value;
-          } else if (*option == "THIRD_PARTY") {
-            third_party = true;
-          } else if (*option == "~THIRD_PARTY") {
-            third_party = false;
-          } else if (*option == "COLLAPSE") {
-            collapse = true;
-          } else if (*option == "~COLLAPSE") {
-            collapse = false;
-          } else if (*option == "SITEKEY" && value.length() > 0) {
-            boost::split(site_keys, value, boost::is_any_of("|"),
-              boost::token_compress_on);
-          } else {
-            return FilterPtr(new InvalidFilter(text,
-              "Unknown option" + boost::to_lower_copy(*option)));
-          }
-        }
+    size_t options_idx = FilterOptions::find(regex_source);
+    if (options_idx != std::string::npos) {
+      boost::string_ref options_text(regex_source);
+      if (!options.parse(options_text.substr(options_idx + 1))) {
+        std::string option(options.unknown.begin(), options.unknown.end());
+        std::replace(option.begin(), option.end(), '-', '_');
+        return FilterPtr(new InvalidFilter(text, INVALID_UNKNOWN_OPTION,
+          "Unknown option" + boost::to_lower_copy(option)));
+      }
+      domains.assign(options.domains.begin(), options.domains.end());
+      boost::to_upper(domains);
+      if (options.site_keys.length() > 0) {
+        std::string value(options.site_keys.begin(), options.site_keys.end());
+        boost::split(site_keys, boost::to_upper_copy(value),
+          boost::is_any_of("|"), boost::token_compress_on);
       }
+      regex_source.erase(options_idx);
     }
+    uint32_t content_type = options.content_type;
+    bool match_case = options.match_case;
+    boost::tribool third_party = options.third_party;
+    bool collapse = options.collapse;
 
     if (!blocking && (content_type == ALL_CONTENT_TYPE || (content_type & TYPE_DOCUMENT)) &&
-      (options.size() == 0 || std::find(options.begin(), options.end(), "DOCUMENT") == options.end()) &&
-      !boost::regex_search(regex_source, boost::regex("^\\|?[\\w\\-]+:")))
+      !options.has_document && !starts_with_protocol(regex_source))
     {
       // Exception filters shouldn't apply to pages by default unless
       // they start with a protocol name
@@ -397,18 +620,14 @@ namespace NS_ADBLOCK {
 
     try {
       if (blocking) {
-        std::cout << std::boolalpha << BLOCKING_FILTER << regex_source <<
-          std::hex << content_type << match_case << domains << third_party << std::endl;
         return FilterPtr(new BlockingFilter(text, regex_source,
           content_type, match_case, domains, third_party, collapse));
       } else {
-        std::cout << std::boolalpha << WHITELIST_FILTER << regex_source <<
-          std::hex << content_type << match_case << domains << third_party << std::endl;
         return FilterPtr(new WhitelistFilter(text, regex_source,
           content_type, match_case, domains, third_party, site_keys));
       }
     } catch (const std::exception &e) {
-      return FilterPtr(new InvalidFilter(text, e.what()));
+      return FilterPtr(new InvalidFilter(text, INVALID_REGEX_SYNTAX, e.what()));
     }
   }
 
@@ -417,18 +636,122 @@ namespace NS_ADBLOCK {
     const std::string &content_type,
     const std::string &doc_domain,
     bool third_party
-    )
+    ) const
   {
-    if (boost::regex_search(location, get_regex()) &&
-      (third_party_ == boost::indeterminate || third_party_ == third_party) &&
-      is_active_on_domain(doc_domain))
-    {
-      auto iter = type_map_.find(content_type);
-      if (iter != type_map_.end() && (iter->second & content_type_) != 0) {
-        return true;
+    return matches(Request(location, content_type, doc_domain, third_party));
+  }
+
+  bool RegExpFilter::matches(
+    const std::string &location,
+    CONTENT_TYPE content_type,
+    const std::string &doc_domain,
+    bool third_party
+    ) const
+  {
+    return matches(Request(location, content_type, doc_domain, third_party));
+  }
+
+  bool RegExpFilter::matches(const Request &request) const {
+    if (FilterProfiler::is_enabled()) {
+      return matches_profiled(request, nullptr);
+    }
+    // Cheap checks first, the pattern is only tested if they all pass
+    return matches_options(request) &&
+      is_active_on_upper_domain(request.get_doc_domain()) &&
+      matches_location(request);
+  }
+
+  bool RegExpFilter::matches(
+    const Request &request,
+    const DomainMatches &domains
+    ) const
+  {
+    if (FilterProfiler::is_enabled()) {
+      return matches_profiled(request, &domains);
+    }
+    return matches_options(request) && is_active_on(domains) &&
+      matches_location(request);
+  }
+
+  namespace {
+
+    typedef boost::chrono::high_resolution_clock Clock;
+
+    inline uint64_t nanoseconds(Clock::duration duration) {
+      return boost::chrono::duration_cast<boost::chrono::nanoseconds>(duration).count();
+    }
+
+  }
+
+  bool RegExpFilter::matches_profiled(
+    const Request &request,
+    const DomainMatches *domains
+    ) const
+  {
+    uint64_t elapsed[3] = { 0, 0, 0 };
+    bool result = false;
+
+    Clock::time_point start = Clock::now();
+    if (matches_options(request)) {
+      Clock::time_point options_end = Clock::now();
+      elapsed[0] = nanoseconds(options_end - start);
+      bool active = domains != nullptr ? is_active_on(*domains) :
+        is_active_on_upper_domain(request.get_doc_domain());
+      Clock::time_point domains_end = Clock::now();
+      elapsed[1] = nanoseconds(domains_end - options_end);
+      if (active) {
+        result = matches_location(request);
+        elapsed[2] = nanoseconds(Clock::now() - domains_end);
       }
+    } else {
+      elapsed[0] = nanoseconds(Clock::now() - start);
     }
-    return false;
+
+    FilterProfiler::record(*this, elapsed[0], elapsed[1], elapsed[2], result);
+    return result;
+  }
+
+  bool RegExpFilter::matches_except_location(
+    const Request &request,
+    const DomainMatches &domains
+    ) const
+  {
+    if (!FilterProfiler::is_enabled()) {
+      return matches_options(request) && is_active_on(domains);
+    }
+
+    uint64_t elapsed[2] = { 0, 0 };
+    Clock::time_point start = Clock::now();
+    bool result = matches_options(request);
+    Clock::time_point options_end = Clock::now();
+    elapsed[0] = nanoseconds(options_end - start);
+    if (result) {
+      result = is_active_on(domains);
+      elapsed[1] = nanoseconds(Clock::now() - options_end);
+    }
+
+    FilterProfiler::record(*this, elapsed[0], elapsed[1], 0, result);
+    return result;
+  }
+
+  bool RegExpFilter::matches_options(const Request &request) const {
+    if ((request.get_content_type() & content_type_) == 0) {
+      return false;
+    }
+    if (!boost::indeterminate(third_party_) &&
+      third_party_ != request.get_third_party())
+    {
+      return false;
+    }
+    return true;
+  }
+
+  bool RegExpFilter::matches_location(const Request &request) const {
+    if (is_regex_) {
+      boost::string_ref location = request.get_location();
+      return boost::regex_search(location.begin(), location.end(), *regex_);
+    }
+    return pattern_.matches(request.get_location());
   }
 
 
@@ -472,15 +795,13 @@ namespace NS_ADBLOCK {
     const std::string &text,
     const std::string &domains,
     const std::string &selector
-    ): ActiveFilter(text, boost::to_upper_copy(domains))
+    ): ActiveFilter(text, boost::to_upper_copy(domains), ",", false)
   {
     selector_domain_ = boost::regex_replace(domains, boost::regex(",~[^,]+"), "");
     selector_domain_ = boost::regex_replace(selector_domain_, boost::regex("^~[^,]+,?"), "");
     boost::to_lower(selector_domain_);
 
     selector_ = selector;
-    domain_separator_ = ",";
-    ignore_trailong_dot_ = false;
   }
 
   const std::string & ElemHideBase::get_selector() const {
@@ -518,7 +839,8 @@ namespace NS_ADBLOCK {
             additional += ("[" + rule + "]");
           } else {
             if (id.length() > 0) {
-              return FilterPtr(new InvalidFilter(text, "filter_elemhide_duplicate_id"));
+              return FilterPtr(new InvalidFilter(text, INVALID_DUPLICATE_ID,
+                "filter_elemhide_duplicate_id"));
             } else {
               id = rule;
             }
@@ -529,15 +851,14 @@ namespace NS_ADBLOCK {
       if (id.length() > 0) {
         selector = tag_name + "." + id + additional + "," + tag_name + "#" + id + additional;
       } else {
-        return FilterPtr(new InvalidFilter(text, "filter_elemhide_nocriteria"));
+        return FilterPtr(new InvalidFilter(text, INVALID_NO_CRITERIA,
+          "filter_elemhide_nocriteria"));
       }
     }
 
     if (is_exception) {
-      std::cout << ELEM_HIDE_EXCEPTION << domain << selector << std::endl;
       return FilterPtr(new ElemHideException(text, domain, selector));
     }
-    std::cout << ELEM_HIDE_FILTER << domain << selector << std::endl;
     return FilterPtr(new ElemHideFilter(text, domain, selector));
   }
 
@@ -16,6 +16,11 @@
 #include <boost/shared_ptr.hpp>
 #include <boost/regex.hpp>
 #include <boost/logic/tribool.hpp>
+#include <boost/functional/hash.hpp>
+#include <boost/utility/string_ref.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/atomic.hpp>
+#include "Pattern.h"
 
 
 namespace NS_ADBLOCK {
@@ -33,13 +38,131 @@ namespace NS_ADBLOCK {
     WHITELIST_FILTER
   } FILTER_TYPE;
 
+  /**
+   * Why a filter text was turned into an InvalidFilter
+   */
+  typedef enum {
+    INVALID_UNKNOWN_OPTION,
+    INVALID_DUPLICATE_ID,
+    INVALID_NO_CRITERIA,
+    INVALID_REGEX_SYNTAX,
+
+    INVALID_REASON_COUNT
+  } INVALID_REASON;
+
+  /**
+   * Content type bit masks, combinations of them are used by RegExpFilter
+   */
+  typedef enum {
+    TYPE_OTHER              = 0x00000001,
+    TYPE_SCRIPT             = 0x00000002,
+    TYPE_IMAGE              = 0x00000004,
+    TYPE_STYLESHEET         = 0x00000008,
+    TYPE_OBJECT             = 0x00000010,
+    TYPE_SUBDOCUMENT        = 0x00000020,
+    TYPE_DOCUMENT           = 0x00000040,
+    TYPE_XBL                = 0x00000001,
+    TYPE_PING               = 0x00000001,
+    TYPE_XMLHTTPREQUEST     = 0x00000800,
+    TYPE_OBJECT_SUBREQUEST  = 0x00001000,
+    TYPE_DTD                = 0x00000001,
+    TYPE_MEDIA              = 0x00004000,
+    TYPE_FONT               = 0x00008000,
+    TYPE_BACKGROUND         = 0x00000004,
+    TYPE_POPUP              = 0x10000000,
+    TYPE_ELEMHIDE           = 0x40000000,
+
+    ALL_CONTENT_TYPE        = 0x7FFFFFFF,
+    DEFAULT_CONTENT_TYPE    = ALL_CONTENT_TYPE & ~(TYPE_POPUP | TYPE_ELEMHIDE)
+  } CONTENT_TYPE;
+
   class Filter;
+  class Request;
+  class DomainMatches;
+  class ParseDiagnostics;
+
+  typedef boost::shared_ptr<ParseDiagnostics> ParseDiagnosticsPtr;
+
+  /**
+   * Hash of std::string keys that gives the same value for a
+   * boost::string_ref, so maps can be searched without building a string
+   */
+  struct StringHash {
+    size_t operator()(boost::string_ref str) const {
+      return boost::hash_range(str.begin(), str.end());
+    }
+  };
+
+  /**
+   * Equality predicate used with StringHash for string_ref lookups
+   */
+  struct StringEqual {
+    bool operator()(boost::string_ref lhs, boost::string_ref rhs) const {
+      return lhs == rhs;
+    }
+  };
 
   /**
    * shared_ptr of Filter to help manage the memory
    */
   typedef boost::shared_ptr<Filter> FilterPtr;
 
+  /**
+   * Compiled regular expression shared between threads
+   */
+  typedef boost::shared_ptr<const boost::regex> RegexPtr;
+
+  /**
+   * Thread-safe text -> filter mapping.
+   *
+   * Filters are spread over ShardCount maps by the hash of their text,
+   * each map has its own mutex so threads parsing different filters
+   * rarely wait for each other.
+   */
+  class FilterRegistry {
+  public:
+    /**
+     * Returns the filter registered for a text, null if there is none
+     */
+    FilterPtr find(const std::string &text) const;
+
+    /**
+     * Registers a filter unless one with the same text is already known,
+     * returns the filter that is registered for the text
+     */
+    FilterPtr insert(const FilterPtr &filter);
+
+    /**
+     * Forgets all filters
+     */
+    void clear();
+
+    /**
+     * Number of registered filters
+     */
+    size_t size() const;
+
+    static const uint32_t ShardCount = 16;
+
+  private:
+    typedef boost::unordered_map<std::string, FilterPtr> Filters;
+
+    struct Shard {
+      mutable boost::mutex mutex;
+      Filters filters;
+    };
+
+    Shard &get_shard(const std::string &text) {
+      return shards_[boost::hash<std::string>()(text) % ShardCount];
+    }
+
+    const Shard &get_shard(const std::string &text) const {
+      return shards_[boost::hash<std::string>()(text) % ShardCount];
+    }
+
+    Shard shards_[ShardCount];
+  };
+
   /**
    * Base Filter class
    */
@@ -53,27 +176,40 @@ namespace NS_ADBLOCK {
      */
     virtual FILTER_TYPE get_type() const { return FILTER; }
 
-    /**
-     * text -> filter mapping
-     */
-    typedef boost::unordered_map<std::string, FilterPtr> KnownFilters;
-
     /**
      * Retrieve text representation of filter
      */
-    const std::string &get_text();
+    const std::string &get_text() const;
 
     /**
      * parsed filters is stored in it
      */
-    static KnownFilters known_filters_;
+    static FilterRegistry known_filters_;
 
     /**
      * Creates a filter of correct type from its text representation
      * - does the basic parsing and calls the right constructor then.
+     * Can be called from several threads, a text parsed by two threads
+     * at once still ends up as one filter.
      */
     static FilterPtr from_text(std::string text);
 
+    /**
+     * Installs the sink that the list loaders report invalid filters to,
+     * null (the default) reports nothing. Can be swapped while other
+     * threads parse.
+     */
+    static void set_diagnostics(const ParseDiagnosticsPtr &diagnostics);
+
+    static ParseDiagnosticsPtr get_diagnostics();
+
+    /**
+     * Reports the invalid filters of a loaded list to the diagnostics,
+     * every distinct filter once, whether or not its text was parsed
+     * before
+     */
+    static void report_invalid(const std::vector<FilterPtr> &filters);
+
     friend std::ostream &operator<<(std::ostream &, const Filter &);
 
     /**
@@ -91,6 +227,40 @@ namespace NS_ADBLOCK {
      */
     static const boost::regex OptionsRegex;
 
+    /**
+     * Removes unnecessary whitespace from filter text, will only return
+     * null if the input parameter is null.
+     */
+    static std::string normalize(std::string text);
+
+    /**
+     * Groups of ElemHideRegex, pointing into the parsed text
+     */
+    struct ElemHideParts {
+      boost::string_ref domain;
+      bool is_exception;
+      boost::string_ref tag_name;
+      boost::string_ref attr_rules;
+      boost::string_ref selector;
+    };
+
+    /**
+     * Tests a filter text against ElemHideRegex with a hand-written
+     * scanner, fills parts if it matches
+     */
+    static bool parse_elem_hide(boost::string_ref text, ElemHideParts &parts);
+
+    /*!
+     * Same as normalize(), in place, and classifies the filter on the way
+     *
+     * \param text filter text, normalized on return
+     * \param parts filled for element hiding filters, points into text
+     *
+     * \return COMMENT_FILTER, ELEM_HIDE_BASE or REGEXP_FILTER, empty
+     * texts are classified as REGEXP_FILTER
+     */
+    static FILTER_TYPE normalize(std::string &text, ElemHideParts &parts);
+
   protected:
     /**
      * string representation of the Filter
@@ -98,12 +268,7 @@ namespace NS_ADBLOCK {
     std::string text_;
 
   private:
-    /**
-     * Removes unnecessary whitespace from filter text, will only return
-     * null if the input parameter is null.
-     */
-    static std::string normalize(std::string text);
-
+    static ParseDiagnosticsPtr diagnostics_;
   };
 
 
@@ -112,16 +277,27 @@ namespace NS_ADBLOCK {
    */
   class InvalidFilter: public Filter {
   public:
-    InvalidFilter(const std::string &text, const std::string &reason):
-        Filter(text) { reason_ = reason; }
+    InvalidFilter(const std::string &text, INVALID_REASON reason,
+      const std::string &message): Filter(text), reason_(reason)
+    {
+      message_ = message;
+    }
 
     /**
      * @see Filter#type
      */
     FILTER_TYPE get_type() const { return INVALID_FILTER; }
 
+    INVALID_REASON get_reason() const { return reason_; }
+
+    /**
+     * Details of the error, like the unknown option or the regex error
+     */
+    const std::string &get_message() const { return message_; }
+
   private:
-    std::string reason_;
+    INVALID_REASON reason_;
+    std::string message_;
   };
 
 
@@ -144,7 +320,15 @@ namespace NS_ADBLOCK {
    */
   class ActiveFilter: public Filter {
   public:
-    ActiveFilter(const std::string &text, const std::string &domains);
+    /*!
+     * \param text same as in Filter()
+     * \param domains domain restrictions, parsed immediately
+     * \param domain_separator separator character used in domains
+     * \param ignore_trailing_dot whether trailing dots in domain names
+     * should be ignored
+     */
+    ActiveFilter(const std::string &text, const std::string &domains,
+      const std::string &domain_separator, bool ignore_trailing_dot);
 
     /**
      * @see Filter#type
@@ -160,26 +344,46 @@ namespace NS_ADBLOCK {
     time_t get_last_hit() const;
     void set_last_hit(time_t last_hit);
 
+    /**
+     * Number given to the filter on construction, unique among all
+     * active filters, HitCounters are indexed by it
+     */
+    uint32_t get_id() const { return id_; }
+
     /** \brief Used for element hiding
      *
      * std::string: domain name
      * 
      * bool: true if the domain is active
      */
-    typedef boost::unordered_map<std::string, bool> DomainMap;
+    typedef boost::unordered_map<std::string, bool, StringHash> DomainMap;
 
     /**
-     * Parse domains from class member domain_source_
+     * Domains parsed from the domain restrictions of the filter
      */
-    const DomainMap &get_domains();
+    const DomainMap &get_domains() const;
 
     /**
      * Test if this doc_domain is active according to
      * class member domains_
      */
-    bool is_active_on_domain(std::string doc_domain);
+    bool is_active_on_domain(const std::string &doc_domain) const;
+
+    /**
+     * Same as is_active_on_domain() for a document domain that is
+     * already uppercase, does not allocate
+     */
+    bool is_active_on_upper_domain(boost::string_ref doc_domain) const;
+
+    /**
+     * Same as is_active_on_upper_domain() with the rules resolved by a
+     * DomainIndex that contains this filter
+     */
+    bool is_active_on(const DomainMatches &matches) const;
 
   protected:
+    uint32_t id_;
+
     /**
      * Defines whether the filter is disabled
      */
@@ -213,8 +417,18 @@ namespace NS_ADBLOCK {
      */
     DomainMap domains_;
 
+    /**
+     * Value of the "" entry of domains_, used when no domain applies
+     */
+    bool domain_default_;
+
   private:
-    std::string domain_source_;
+    /**
+     * Fills domains_ from the domain restrictions of the filter
+     */
+    void parse_domains(const std::string &domains);
+
+    static boost::atomic<uint32_t> next_id_;
   };
 
 
@@ -232,7 +446,41 @@ namespace NS_ADBLOCK {
      */
     FILTER_TYPE get_type() const { return REGEXP_FILTER; }
 
-    const boost::regex &get_regex();
+    /**
+     * Regular expression equivalent of the filter. Only filters specified
+     * as RegExps are matched with it, they own the one compiled by the
+     * constructor. For the other ones it is built from the translated
+     * filter text on every call; matching never needs it.
+     */
+    RegexPtr get_regex() const;
+
+    /**
+     * Native pattern used to test filters not specified as RegExps
+     */
+    const Pattern &get_pattern() const { return pattern_; }
+
+    /**
+     * Check if the filter is specified as a RegExp (/.../)
+     */
+    bool is_regex() const { return is_regex_; }
+
+    /**
+     * Filter part that the regular expression or pattern is built from
+     */
+    const std::string &get_regex_source() const { return regex_source_; }
+
+    /**
+     * Content types the filter applies to
+     */
+    uint32_t get_content_types() const { return content_type_; }
+
+    bool get_match_case() const { return match_case_; }
+
+    /**
+     * Whether the filter applies to third-party (true), first-party (false)
+     * or all requests (indeterminate)
+     */
+    boost::tribool get_third_party() const { return third_party_; }
 
     /**
      * Creates a RegExp filter from its text representation
@@ -250,7 +498,34 @@ namespace NS_ADBLOCK {
      * \return true if match
      */
     bool matches(const std::string &location, const std::string &content_type,
-      const std::string &doc_domain, bool third_party);
+      const std::string &doc_domain, bool third_party) const;
+
+    /**
+     * Same as above with the content type already resolved to its mask
+     */
+    bool matches(const std::string &location, CONTENT_TYPE content_type,
+      const std::string &doc_domain, bool third_party) const;
+
+    /**
+     * Tests whether the request matches this filter. Content type,
+     * third-party and domain restrictions are checked before the pattern.
+     * Everything it reads is built by the constructor, so any number of
+     * threads can test the same filter.
+     */
+    bool matches(const Request &request) const;
+
+    /**
+     * Same as above with the domain rules already resolved by the
+     * DomainIndex of the matcher holding this filter
+     */
+    bool matches(const Request &request, const DomainMatches &domains) const;
+
+    /**
+     * Same as above for a request whose location is already known to
+     * match the pattern, only the options and domains are checked
+     */
+    bool matches_except_location(const Request &request,
+      const DomainMatches &domains) const;
 
     typedef boost::unordered_map<std::string, uint32_t> TypeMap;
 
@@ -259,6 +534,11 @@ namespace NS_ADBLOCK {
      */
     const static TypeMap type_map_;
 
+    /**
+     * Resolves a content type string like "SCRIPT", 0 if it is unknown
+     */
+    static CONTENT_TYPE get_content_type(const std::string &content_type);
+
   protected:
     /**
      * Content types the filter applies to, combination of values from
@@ -284,9 +564,43 @@ namespace NS_ADBLOCK {
     std::string regex_source_;
 
     /**
-     * Regular expression to be used when testing against this filter
+     * Defines whether the filter is specified as a RegExp
+     */
+    bool is_regex_;
+
+    /**
+     * Compiled RegExp of filters specified as RegExps, set by the
+     * constructor and never changed, so matching reads it without locks
+     */
+    RegexPtr regex_;
+
+    /**
+     * Native pattern to be used when testing against this filter
+     */
+    Pattern pattern_;
+
+  private:
+    /**
+     * Source of the regular expression equivalent of the filter
+     */
+    std::string translate_regex() const;
+
+    /**
+     * Checks the content type and third-party options
+     */
+    bool matches_options(const Request &request) const;
+
+    /**
+     * Tests the location against the pattern or regular expression
+     */
+    bool matches_location(const Request &request) const;
+
+    /**
+     * matches() timing every phase for FilterProfiler, domains is null
+     * if the filter resolves its domain restrictions itself
      */
-    boost::regex regex_;
+    bool matches_profiled(const Request &request,
+      const DomainMatches *domains) const;
   };
 
   typedef boost::shared_ptr<RegExpFilter> RegExpFilterPtr;
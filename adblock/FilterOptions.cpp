@@ -0,0 +1,233 @@
+#include "FilterOptions.h"
+#include "Filter.h"
+
+
+namespace NS_ADBLOCK {
+
+  // Laid out by hash(), see FilterOptionsTest.PerfectHash
+  const FilterOptions::Entry FilterOptions::table_[32] = {
+    { "STYLESHEET", 10, OPTION_TYPE, TYPE_STYLESHEET },
+    { "MEDIA", 5, OPTION_TYPE, TYPE_MEDIA },
+    { "ELEMHIDE", 8, OPTION_TYPE, TYPE_ELEMHIDE },
+    { nullptr, 0, OPTION_UNKNOWN, 0 },
+    { nullptr, 0, OPTION_UNKNOWN, 0 },
+    { "XBL", 3, OPTION_TYPE, TYPE_XBL },
+    { nullptr, 0, OPTION_UNKNOWN, 0 },
+    { "OTHER", 5, OPTION_TYPE, TYPE_OTHER },
+    { "MATCH_CASE", 10, OPTION_MATCH_CASE, 0 },
+    { nullptr, 0, OPTION_UNKNOWN, 0 },
+    { "PING", 4, OPTION_TYPE, TYPE_PING },
+    { "THIRD_PARTY", 11, OPTION_THIRD_PARTY, 0 },
+    { "SCRIPT", 6, OPTION_TYPE, TYPE_SCRIPT },
+    { "POPUP", 5, OPTION_TYPE, TYPE_POPUP },
+    { "COLLAPSE", 8, OPTION_COLLAPSE, 0 },
+    { "SITEKEY", 7, OPTION_SITEKEY, 0 },
+    { nullptr, 0, OPTION_UNKNOWN, 0 },
+    { nullptr, 0, OPTION_UNKNOWN, 0 },
+    { "DOMAIN", 6, OPTION_DOMAIN, 0 },
+    { "IMAGE", 5, OPTION_TYPE, TYPE_IMAGE },
+    { "DOCUMENT", 8, OPTION_TYPE, TYPE_DOCUMENT },
+    { nullptr, 0, OPTION_UNKNOWN, 0 },
+    { "FONT", 4, OPTION_TYPE, TYPE_FONT },
+    { nullptr, 0, OPTION_UNKNOWN, 0 },
+    { nullptr, 0, OPTION_UNKNOWN, 0 },
+    { "DTD", 3, OPTION_TYPE, TYPE_DTD },
+    { "OBJECT", 6, OPTION_TYPE, TYPE_OBJECT },
+    { "OBJECT_SUBREQUEST", 17, OPTION_TYPE, TYPE_OBJECT_SUBREQUEST },
+    { "XMLHTTPREQUEST", 14, OPTION_TYPE, TYPE_XMLHTTPREQUEST },
+    { nullptr, 0, OPTION_UNKNOWN, 0 },
+    { "BACKGROUND", 10, OPTION_TYPE, TYPE_BACKGROUND },
+    { "SUBDOCUMENT", 11, OPTION_TYPE, TYPE_SUBDOCUMENT }
+  };
+
+  namespace {
+
+    /**
+     * Uppercases a name character and turns - into _
+     */
+    inline char fold(char ch) {
+      if (ch >= 'a' && ch <= 'z') {
+        return ch - ('a' - 'A');
+      }
+      return ch == '-' ? '_' : ch;
+    }
+
+    /**
+     * [\w\-] of OptionsRegex, in the C locale
+     */
+    inline bool is_word(char ch) {
+      return (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') ||
+        (ch >= '0' && ch <= '9') || ch == '_' || ch == '-';
+    }
+
+    /**
+     * \s of OptionsRegex, in the C locale
+     */
+    inline bool is_space(char ch) {
+      return ch == ' ' || (ch >= '\t' && ch <= '\r');
+    }
+
+    /**
+     * Characters in front of which $ matches besides the end of the text
+     */
+    inline bool is_line_end(char ch) {
+      return ch == '\n' || ch == '\r' || ch == '\f';
+    }
+
+    /**
+     * Checks that text[pos..] is a complete option list, that is
+     * ~?[\w\-]+(?:=[^,\s]+)? separated by commas up to the end of a line
+     */
+    bool is_option_list(boost::string_ref text, size_t pos) {
+      size_t length = text.length();
+      for (;;) {
+        if (pos < length && text[pos] == '~') {
+          ++pos;
+        }
+        size_t name_begin = pos;
+        while (pos < length && is_word(text[pos])) {
+          ++pos;
+        }
+        if (pos == name_begin) {
+          return false;
+        }
+        if (pos < length && text[pos] == '=') {
+          size_t value_begin = ++pos;
+          while (pos < length && text[pos] != ',' && !is_space(text[pos])) {
+            ++pos;
+          }
+          if (pos == value_begin) {
+            return false;
+          }
+        }
+        if (pos == length || is_line_end(text[pos])) {
+          return true;
+        }
+        if (text[pos++] != ',') {
+          return false;
+        }
+      }
+    }
+
+  }
+
+  FilterOptions::FilterOptions()
+    : content_type(ALL_CONTENT_TYPE),
+      match_case(false),
+      third_party(boost::indeterminate),
+      collapse(true),
+      has_document(false)
+  {
+  }
+
+  uint32_t FilterOptions::hash(boost::string_ref name) {
+    return (2 * static_cast<unsigned char>(fold(name[1])) +
+      10 * static_cast<unsigned char>(fold(name[2])) +
+      3 * static_cast<uint32_t>(name.length())) & 31;
+  }
+
+  FilterOptions::OPTION FilterOptions::lookup(boost::string_ref name, uint32_t &type) {
+    // All option names have at least 3 characters, which hash() reads
+    if (name.length() < 3) {
+      return OPTION_UNKNOWN;
+    }
+    const Entry &entry = table_[hash(name)];
+    if (entry.name == nullptr || entry.length != name.length()) {
+      return OPTION_UNKNOWN;
+    }
+    for (size_t idx = 0; idx < name.length(); ++idx) {
+      if (fold(name[idx]) != entry.name[idx]) {
+        return OPTION_UNKNOWN;
+      }
+    }
+    type = entry.type;
+    return entry.option;
+  }
+
+  size_t FilterOptions::find(boost::string_ref text) {
+    // The leftmost $ wins, values may contain $ themselves
+    for (size_t pos = 0; pos < text.length(); ++pos) {
+      if (text[pos] == '$' && is_option_list(text, pos + 1)) {
+        return pos;
+      }
+    }
+    return boost::string_ref::npos;
+  }
+
+  bool FilterOptions::parse(boost::string_ref options) {
+    size_t pos = 0;
+    size_t length = options.length();
+    while (pos < length && !is_line_end(options[pos])) {
+      size_t option_begin = pos;
+      bool negated = options[pos] == '~';
+      if (negated) {
+        ++pos;
+      }
+      size_t name_begin = pos;
+      while (pos < length && options[pos] != ',' && options[pos] != '=' &&
+        !is_line_end(options[pos]))
+      {
+        ++pos;
+      }
+      boost::string_ref name = options.substr(name_begin, pos - name_begin);
+      boost::string_ref value;
+      if (pos < length && options[pos] == '=') {
+        size_t value_begin = ++pos;
+        while (pos < length && options[pos] != ',' && !is_line_end(options[pos])) {
+          ++pos;
+        }
+        value = options.substr(value_begin, pos - value_begin);
+      }
+      boost::string_ref option = options.substr(option_begin,
+        name_begin + name.length() - option_begin);
+      if (pos < length && options[pos] == ',') {
+        ++pos;
+      }
+
+      uint32_t type = 0;
+      switch (lookup(name, type)) {
+      case OPTION_TYPE:
+        if (negated) {
+          if (content_type == ALL_CONTENT_TYPE) {
+            content_type = DEFAULT_CONTENT_TYPE;
+          }
+          content_type &= ~type;
+        } else {
+          if (content_type == ALL_CONTENT_TYPE) {
+            content_type = 0;
+          }
+          content_type |= type;
+          has_document = has_document || type == TYPE_DOCUMENT;
+        }
+        continue;
+      case OPTION_MATCH_CASE:
+        match_case = !negated;
+        continue;
+      case OPTION_THIRD_PARTY:
+        third_party = !negated;
+        continue;
+      case OPTION_COLLAPSE:
+        collapse = !negated;
+        continue;
+      case OPTION_DOMAIN:
+        if (!negated && value.length() > 0) {
+          domains = value;
+          continue;
+        }
+        break;
+      case OPTION_SITEKEY:
+        if (!negated && value.length() > 0) {
+          site_keys = value;
+          continue;
+        }
+        break;
+      default:
+        break;
+      }
+      unknown = option;
+      return false;
+    }
+    return true;
+  }
+
+}
@@ -0,0 +1,120 @@
+/*!
+ * \file FilterOptions.h
+ *
+ * \author yorath
+ * \date November 7, 2013
+ *
+ * \details Parser for the $options part of blocking and whitelist filters
+ */
+
+#pragma once
+
+
+#include <cstdint>
+#include <string>
+#include <boost/utility/string_ref.hpp>
+#include <boost/logic/tribool.hpp>
+
+
+namespace NS_ADBLOCK {
+
+  /**
+   * Parsed $options of a RegExpFilter.
+   *
+   * The options are scanned in place, values are views into the filter
+   * text and names are resolved through a perfect hash, so parsing does
+   * no heap allocation. Values are left in their original case, the
+   * caller uppercases them like the rest of the filter options.
+   */
+  struct FilterOptions {
+    enum OPTION {
+      OPTION_UNKNOWN,
+      OPTION_TYPE,
+      OPTION_MATCH_CASE,
+      OPTION_DOMAIN,
+      OPTION_THIRD_PARTY,
+      OPTION_COLLAPSE,
+      OPTION_SITEKEY
+    };
+
+    FilterOptions();
+
+    /**
+     * Content types the filter applies to, ALL_CONTENT_TYPE if no type
+     * option is given
+     */
+    uint32_t content_type;
+
+    bool match_case;
+
+    boost::tribool third_party;
+
+    bool collapse;
+
+    /**
+     * Whether one of the options is exactly $document (not negated)
+     */
+    bool has_document;
+
+    /**
+     * Value of the last $domain option, empty if there is none
+     */
+    boost::string_ref domains;
+
+    /**
+     * Value of the last $sitekey option, keys are separated by |
+     */
+    boost::string_ref site_keys;
+
+    /**
+     * Unknown option that stopped the parser, as written
+     */
+    boost::string_ref unknown;
+
+    /*!
+     * Parses the options following the $ of a filter
+     *
+     * \param options text after the $, as located by find()
+     *
+     * \return false if an option is unknown, it is stored in unknown
+     */
+    bool parse(boost::string_ref options);
+
+    /*!
+     * Locates the options of a filter, the same way OptionsRegex does
+     *
+     * \param text filter text
+     *
+     * \return position of the $ starting the options, npos if the filter
+     * has no options
+     */
+    static size_t find(boost::string_ref text);
+
+    /*!
+     * Resolves an option name without the ~ prefix. Names are case
+     * insensitive and - is the same as _.
+     *
+     * \param name option name
+     * \param type receives the content type mask if it is a type option
+     *
+     * \return kind of the option, OPTION_UNKNOWN if it doesn't exist
+     */
+    static OPTION lookup(boost::string_ref name, uint32_t &type);
+
+  private:
+    struct Entry {
+      const char *name;
+      uint32_t length;
+      OPTION option;
+      uint32_t type;
+    };
+
+    /**
+     * Option names laid out by hash(), empty slots have a null name
+     */
+    static const Entry table_[32];
+
+    static uint32_t hash(boost::string_ref name);
+  };
+
+}
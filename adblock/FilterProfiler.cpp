@@ -0,0 +1,152 @@
+#include "FilterProfiler.h"
+#include <algorithm>
+#include <iomanip>
+#include <ostream>
+
+
+namespace NS_ADBLOCK {
+
+  boost::atomic<bool> FilterProfiler::enabled_(false);
+  boost::mutex FilterProfiler::mutex_;
+  boost::atomic<FilterProfiler::Chunk *> FilterProfiler::chunks_[MaxChunks];
+
+  FilterProfiler::Chunk::Chunk() {
+    for (uint32_t idx = 0; idx < ChunkSize; ++idx) {
+      Slot &slot = slots[idx];
+      slot.evaluations.store(0, boost::memory_order_relaxed);
+      slot.matches.store(0, boost::memory_order_relaxed);
+      slot.options_ns.store(0, boost::memory_order_relaxed);
+      slot.domains_ns.store(0, boost::memory_order_relaxed);
+      slot.location_ns.store(0, boost::memory_order_relaxed);
+      slot.has_text.store(false, boost::memory_order_relaxed);
+    }
+  }
+
+  void FilterProfiler::set_enabled(bool enabled) {
+    enabled_.store(enabled, boost::memory_order_relaxed);
+  }
+
+  void FilterProfiler::record(
+    const RegExpFilter &filter,
+    uint64_t options_ns,
+    uint64_t domains_ns,
+    uint64_t location_ns,
+    bool matched
+    )
+  {
+    uint32_t id = filter.get_id();
+    if (id >= ChunkSize * MaxChunks) {
+      return;
+    }
+
+    boost::atomic<Chunk *> &entry = chunks_[id / ChunkSize];
+    Chunk *chunk = entry.load(boost::memory_order_acquire);
+    if (chunk == nullptr) {
+      boost::mutex::scoped_lock lock(mutex_);
+      chunk = entry.load(boost::memory_order_relaxed);
+      if (chunk == nullptr) {
+        chunk = new Chunk();
+        entry.store(chunk, boost::memory_order_release);
+      }
+    }
+
+    Slot &slot = chunk->slots[id % ChunkSize];
+    if (!slot.has_text.load(boost::memory_order_acquire)) {
+      boost::mutex::scoped_lock lock(mutex_);
+      if (!slot.has_text.load(boost::memory_order_relaxed)) {
+        slot.text = filter.get_text();
+        slot.has_text.store(true, boost::memory_order_release);
+      }
+    }
+
+    slot.evaluations.fetch_add(1, boost::memory_order_relaxed);
+    if (matched) {
+      slot.matches.fetch_add(1, boost::memory_order_relaxed);
+    }
+    slot.options_ns.fetch_add(options_ns, boost::memory_order_relaxed);
+    slot.domains_ns.fetch_add(domains_ns, boost::memory_order_relaxed);
+    slot.location_ns.fetch_add(location_ns, boost::memory_order_relaxed);
+  }
+
+  FilterProfiler::Cost FilterProfiler::read(const Slot &slot) {
+    Cost cost;
+    if (slot.has_text.load(boost::memory_order_acquire)) {
+      cost.text = slot.text;
+    }
+    cost.evaluations = slot.evaluations.load(boost::memory_order_relaxed);
+    cost.matches = slot.matches.load(boost::memory_order_relaxed);
+    cost.options_ns = slot.options_ns.load(boost::memory_order_relaxed);
+    cost.domains_ns = slot.domains_ns.load(boost::memory_order_relaxed);
+    cost.location_ns = slot.location_ns.load(boost::memory_order_relaxed);
+    return cost;
+  }
+
+  FilterProfiler::Cost FilterProfiler::get_cost(const ActiveFilter &filter) {
+    uint32_t id = filter.get_id();
+    if (id >= ChunkSize * MaxChunks) {
+      return Cost();
+    }
+    const Chunk *chunk = chunks_[id / ChunkSize].load(boost::memory_order_acquire);
+    if (chunk == nullptr) {
+      return Cost();
+    }
+    return read(chunk->slots[id % ChunkSize]);
+  }
+
+  std::vector<FilterProfiler::Cost> FilterProfiler::get_top(uint32_t count) {
+    std::vector<Cost> result;
+    for (uint32_t chunk_idx = 0; chunk_idx < MaxChunks; ++chunk_idx) {
+      const Chunk *chunk = chunks_[chunk_idx].load(boost::memory_order_acquire);
+      if (chunk == nullptr) {
+        continue;
+      }
+      for (uint32_t idx = 0; idx < ChunkSize; ++idx) {
+        if (chunk->slots[idx].evaluations.load(boost::memory_order_relaxed) > 0) {
+          result.push_back(read(chunk->slots[idx]));
+        }
+      }
+    }
+
+    auto by_total = [](const Cost &lhs, const Cost &rhs) {
+      return lhs.total_ns() > rhs.total_ns();
+    };
+    if (result.size() > count) {
+      std::partial_sort(result.begin(), result.begin() + count, result.end(), by_total);
+      result.resize(count);
+    } else {
+      std::sort(result.begin(), result.end(), by_total);
+    }
+    return result;
+  }
+
+  void FilterProfiler::dump(std::ostream &stream, uint32_t count) {
+    std::vector<Cost> top = get_top(count);
+    stream << "total_us\tevaluations\tmatch_rate\toptions_us\tdomains_us\tlocation_us\tfilter" << std::endl;
+    for (auto iter = top.begin(); iter != top.end(); ++iter) {
+      stream << std::fixed << std::setprecision(1) <<
+        iter->total_ns() / 1000.0 << '\t' << iter->evaluations << '\t' <<
+        std::setprecision(4) << iter->match_rate() << '\t' <<
+        std::setprecision(1) << iter->options_ns / 1000.0 << '\t' <<
+        iter->domains_ns / 1000.0 << '\t' << iter->location_ns / 1000.0 << '\t' <<
+        iter->text << std::endl;
+    }
+  }
+
+  void FilterProfiler::clear() {
+    for (uint32_t chunk_idx = 0; chunk_idx < MaxChunks; ++chunk_idx) {
+      Chunk *chunk = chunks_[chunk_idx].load(boost::memory_order_acquire);
+      if (chunk == nullptr) {
+        continue;
+      }
+      for (uint32_t idx = 0; idx < ChunkSize; ++idx) {
+        Slot &slot = chunk->slots[idx];
+        slot.evaluations.store(0, boost::memory_order_relaxed);
+        slot.matches.store(0, boost::memory_order_relaxed);
+        slot.options_ns.store(0, boost::memory_order_relaxed);
+        slot.domains_ns.store(0, boost::memory_order_relaxed);
+        slot.location_ns.store(0, boost::memory_order_relaxed);
+      }
+    }
+  }
+
+}
@@ -0,0 +1,127 @@
+/*!
+ * \file FilterProfiler.h
+ *
+ * \author yorath
+ * \date November 12, 2013
+ *
+ * \details Opt-in profiling of the time spent testing each filter
+ */
+
+#pragma once
+
+
+#include "Filter.h"
+#include <iosfwd>
+#include <boost/atomic.hpp>
+#include <boost/thread/mutex.hpp>
+
+
+namespace NS_ADBLOCK {
+
+  /**
+   * Cost of the filters in RegExpFilter::matches().
+   *
+   * While enabled, every test of a filter is timed in three phases:
+   * the content type and third-party checks, the domain restrictions and
+   * the pattern or regular expression. The costs are summed per filter,
+   * indexed by ActiveFilter::get_id() like HitCounters. Disabled, the
+   * matching path pays one relaxed load.
+   */
+  class FilterProfiler {
+  public:
+    static void set_enabled(bool enabled);
+
+    static bool is_enabled() {
+      return enabled_.load(boost::memory_order_relaxed);
+    }
+
+    /**
+     * Accumulated cost of one filter, times in nanoseconds
+     */
+    struct Cost {
+      Cost(): evaluations(0), matches(0), options_ns(0), domains_ns(0),
+        location_ns(0) { }
+
+      std::string text;
+      uint64_t evaluations;
+      uint64_t matches;
+      uint64_t options_ns;
+      uint64_t domains_ns;
+      uint64_t location_ns;
+
+      uint64_t total_ns() const {
+        return options_ns + domains_ns + location_ns;
+      }
+
+      double match_rate() const {
+        return evaluations > 0 ? static_cast<double>(matches) / evaluations : 0;
+      }
+    };
+
+    /**
+     * Adds one test of a filter, called by RegExpFilter::matches()
+     */
+    static void record(const RegExpFilter &filter, uint64_t options_ns,
+      uint64_t domains_ns, uint64_t location_ns, bool matched);
+
+    /**
+     * Cost of a filter so far, zero if it was never tested while enabled
+     */
+    static Cost get_cost(const ActiveFilter &filter);
+
+    /**
+     * The count filters with the highest total time, most expensive first
+     */
+    static std::vector<Cost> get_top(uint32_t count);
+
+    /**
+     * Writes get_top(count) as a table, one filter per line
+     */
+    static void dump(std::ostream &stream, uint32_t count);
+
+    /**
+     * Drops all recorded costs
+     */
+    static void clear();
+
+    /**
+     * CombindMatcher::is_slow_filter() reports filters with a higher
+     * average time per test as slow
+     */
+    static const uint64_t SlowFilterNanoseconds = 20000;
+
+    static const uint32_t ChunkSize = 4096;
+    static const uint32_t MaxChunks = 1024;
+
+  private:
+    struct Slot {
+      boost::atomic<uint64_t> evaluations;
+      boost::atomic<uint64_t> matches;
+      boost::atomic<uint64_t> options_ns;
+      boost::atomic<uint64_t> domains_ns;
+      boost::atomic<uint64_t> location_ns;
+
+      /**
+       * Set once by the first record(), under mutex_
+       */
+      std::string text;
+      boost::atomic<bool> has_text;
+    };
+
+    struct Chunk {
+      Chunk();
+      Slot slots[ChunkSize];
+    };
+
+    static Cost read(const Slot &slot);
+
+    static boost::atomic<bool> enabled_;
+
+    /**
+     * Guards the allocation of chunks and the texts
+     */
+    static boost::mutex mutex_;
+    static boost::atomic<Chunk *> chunks_[MaxChunks];
+  };
+
+}
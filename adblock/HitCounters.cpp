@@ -0,0 +1,188 @@
+#include "HitCounters.h"
+#include <algorithm>
+#include <boost/chrono.hpp>
+
+
+namespace NS_ADBLOCK {
+
+  namespace {
+
+    int64_t current_time() {
+      return boost::chrono::duration_cast<boost::chrono::milliseconds>(
+        boost::chrono::system_clock::now().time_since_epoch()).count();
+    }
+
+  }
+
+  boost::mutex HitCounters::mutex_;
+  std::vector<boost::shared_ptr<HitCounters::Shard>> HitCounters::shards_;
+  std::vector<uint64_t> HitCounters::hit_counts_;
+  std::vector<time_t> HitCounters::last_hits_;
+  std::vector<uint64_t> HitCounters::retired_hit_counts_;
+  std::vector<time_t> HitCounters::retired_last_hits_;
+  boost::atomic<int64_t> HitCounters::now_(0);
+
+  // Defined last so that it is destroyed first, its destructor retires
+  // the shard of the main thread while the members above still exist
+  boost::thread_specific_ptr<HitCounters::Shard> HitCounters::local_shard_(
+    &HitCounters::retire_shard);
+
+  HitCounters::Chunk::Chunk() {
+    for (uint32_t idx = 0; idx < ChunkSize; ++idx) {
+      counters[idx].hits.store(0, boost::memory_order_relaxed);
+      counters[idx].last_hit.store(0, boost::memory_order_relaxed);
+    }
+  }
+
+  HitCounters::Shard::Shard() {
+    for (uint32_t idx = 0; idx < MaxChunks; ++idx) {
+      chunks[idx].store(nullptr, boost::memory_order_relaxed);
+    }
+  }
+
+  HitCounters::Shard::~Shard() {
+    for (uint32_t idx = 0; idx < MaxChunks; ++idx) {
+      delete chunks[idx].load(boost::memory_order_relaxed);
+    }
+  }
+
+  HitCounters::Shard &HitCounters::get_shard() {
+    Shard *shard = local_shard_.get();
+    if (shard == nullptr) {
+      boost::shared_ptr<Shard> created(new Shard());
+      {
+        boost::mutex::scoped_lock lock(mutex_);
+        shards_.push_back(created);
+      }
+      shard = created.get();
+      local_shard_.reset(shard);
+    }
+    return *shard;
+  }
+
+  void HitCounters::retire_shard(Shard *shard) {
+    boost::mutex::scoped_lock lock(mutex_);
+    add_shard(*shard, retired_hit_counts_, retired_last_hits_);
+    for (auto iter = shards_.begin(); iter != shards_.end(); ++iter) {
+      if (iter->get() == shard) {
+        shards_.erase(iter);
+        break;
+      }
+    }
+  }
+
+  void HitCounters::add_shard(
+    const Shard &shard,
+    std::vector<uint64_t> &hit_counts,
+    std::vector<time_t> &last_hits
+    )
+  {
+    for (uint32_t chunk_idx = 0; chunk_idx < MaxChunks; ++chunk_idx) {
+      const Chunk *chunk = shard.chunks[chunk_idx].load(boost::memory_order_acquire);
+      if (chunk == nullptr) {
+        continue;
+      }
+
+      size_t base = chunk_idx * ChunkSize;
+      if (hit_counts.size() < base + ChunkSize) {
+        hit_counts.resize(base + ChunkSize, 0);
+        last_hits.resize(base + ChunkSize, 0);
+      }
+      for (uint32_t idx = 0; idx < ChunkSize; ++idx) {
+        const Counter &counter = chunk->counters[idx];
+        hit_counts[base + idx] += counter.hits.load(boost::memory_order_relaxed);
+        last_hits[base + idx] = std::max<time_t>(last_hits[base + idx],
+          counter.last_hit.load(boost::memory_order_relaxed));
+      }
+    }
+  }
+
+  void HitCounters::record(const ActiveFilter &filter) {
+    uint32_t id = filter.get_id();
+    if (id >= MaxFilters) {
+      return;
+    }
+
+    Shard &shard = get_shard();
+    Chunk *chunk = shard.chunks[id / ChunkSize].load(boost::memory_order_acquire);
+    if (chunk == nullptr) {
+      chunk = new Chunk();
+      shard.chunks[id / ChunkSize].store(chunk, boost::memory_order_release);
+    }
+
+    int64_t now = now_.load(boost::memory_order_relaxed);
+    if (now == 0) {
+      now = current_time();
+      now_.store(now, boost::memory_order_relaxed);
+    }
+
+    // Only this thread writes to the counter, a load and a store are
+    // enough and aggregate() never reads a torn value
+    Counter &counter = chunk->counters[id % ChunkSize];
+    counter.hits.store(counter.hits.load(boost::memory_order_relaxed) + 1,
+      boost::memory_order_relaxed);
+    counter.last_hit.store(now, boost::memory_order_relaxed);
+  }
+
+  void HitCounters::aggregate() {
+    now_.store(current_time(), boost::memory_order_relaxed);
+
+    boost::mutex::scoped_lock lock(mutex_);
+    hit_counts_ = retired_hit_counts_;
+    last_hits_ = retired_last_hits_;
+    for (auto shard = shards_.begin(); shard != shards_.end(); ++shard) {
+      add_shard(**shard, hit_counts_, last_hits_);
+    }
+  }
+
+  uint64_t HitCounters::get_hit_count(uint32_t id) {
+    boost::mutex::scoped_lock lock(mutex_);
+    return id < hit_counts_.size() ? hit_counts_[id] : 0;
+  }
+
+  time_t HitCounters::get_last_hit(uint32_t id) {
+    boost::mutex::scoped_lock lock(mutex_);
+    return id < last_hits_.size() ? last_hits_[id] : 0;
+  }
+
+  size_t HitCounters::get_shard_count() {
+    boost::mutex::scoped_lock lock(mutex_);
+    return shards_.size();
+  }
+
+  void HitCounters::export_to(const std::vector<FilterPtr> &filters) {
+    boost::mutex::scoped_lock lock(mutex_);
+    for (auto iter = filters.begin(); iter != filters.end(); ++iter) {
+      ActiveFilter *filter = dynamic_cast<ActiveFilter *>(iter->get());
+      if (filter == nullptr || filter->get_id() >= hit_counts_.size()) {
+        continue;
+      }
+      filter->set_hit_count(static_cast<uint32_t>(hit_counts_[filter->get_id()]));
+      filter->set_last_hit(last_hits_[filter->get_id()]);
+    }
+  }
+
+
+  HitAggregator::HitAggregator(uint32_t interval_ms):
+    thread_(&HitAggregator::run, this, interval_ms)
+  {
+  }
+
+  HitAggregator::~HitAggregator() {
+    thread_.interrupt();
+    thread_.join();
+  }
+
+  void HitAggregator::run(uint32_t interval_ms) {
+    try {
+      for (;;) {
+        boost::this_thread::sleep_for(boost::chrono::milliseconds(interval_ms));
+        HitCounters::aggregate();
+      }
+    } catch (const boost::thread_interrupted &) {
+      // Fold the hits since the last pass before stopping
+      HitCounters::aggregate();
+    }
+  }
+
+}
@@ -0,0 +1,160 @@
+/*!
+ * \file HitCounters.h
+ *
+ * \author yorath
+ * \date November 11, 2013
+ *
+ * \details Hit statistics of the filters, counted per thread
+ */
+
+#pragma once
+
+
+#include "Filter.h"
+#include <ctime>
+#include <boost/atomic.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/tss.hpp>
+
+
+namespace NS_ADBLOCK {
+
+  /**
+   * Hit counts and last hit times of the active filters.
+   *
+   * Every thread that records hits gets its own shard of counters indexed
+   * by ActiveFilter::get_id(). Only the owner writes to a shard, with
+   * plain stores, so the matching path never waits on other threads or
+   * bounces cache lines between cores. aggregate() sums the shards into
+   * totals that can be queried or copied into the filters. When a thread
+   * exits its shard is folded into the counts of finished threads and
+   * freed, so only live threads have a shard.
+   *
+   * Last hit times come from a clock that aggregate() advances, they are
+   * as precise as the aggregation interval.
+   */
+  class HitCounters {
+  public:
+    /**
+     * Counts a hit on a filter from the calling thread
+     */
+    static void record(const ActiveFilter &filter);
+
+    /**
+     * Sums the shards of all threads into the totals
+     */
+    static void aggregate();
+
+    /**
+     * Total hits of a filter as of the last aggregate()
+     */
+    static uint64_t get_hit_count(uint32_t id);
+
+    /**
+     * Last hit of a filter as of the last aggregate(), in milliseconds
+     * since the epoch, 0 if it was never hit
+     */
+    static time_t get_last_hit(uint32_t id);
+
+    /**
+     * Copies the totals into the hit count and last hit of the active
+     * filters of a list
+     */
+    static void export_to(const std::vector<FilterPtr> &filters);
+
+    /**
+     * Number of threads with a shard of counters
+     */
+    static size_t get_shard_count();
+
+    /**
+     * Filters with an id of MaxFilters or above aren't counted
+     */
+    static const uint32_t ChunkSize = 4096;
+    static const uint32_t MaxChunks = 1024;
+    static const uint32_t MaxFilters = ChunkSize * MaxChunks;
+
+  private:
+    struct Counter {
+      boost::atomic<uint32_t> hits;
+      boost::atomic<int64_t> last_hit;
+    };
+
+    struct Chunk {
+      Chunk();
+      Counter counters[ChunkSize];
+    };
+
+    /**
+     * Counters of one thread, chunks are allocated when the thread
+     * first hits one of their filters
+     */
+    struct Shard: private boost::noncopyable {
+      Shard();
+      ~Shard();
+      boost::atomic<Chunk *> chunks[MaxChunks];
+    };
+
+    static Shard &get_shard();
+
+    /**
+     * Cleanup of local_shard_, run when a thread exits: folds the shard
+     * into the counts of finished threads and frees it
+     */
+    static void retire_shard(Shard *shard);
+
+    /**
+     * Adds the counters of a shard to hit counts and last hits
+     */
+    static void add_shard(const Shard &shard, std::vector<uint64_t> &hit_counts,
+      std::vector<time_t> &last_hits);
+
+    /**
+     * Shard of the calling thread, owned by shards_
+     */
+    static boost::thread_specific_ptr<Shard> local_shard_;
+
+    /**
+     * Guards shards_ and the totals
+     */
+    static boost::mutex mutex_;
+    static std::vector<boost::shared_ptr<Shard>> shards_;
+    static std::vector<uint64_t> hit_counts_;
+    static std::vector<time_t> last_hits_;
+
+    /**
+     * Counts of the threads that exited, aggregate() starts from them
+     */
+    static std::vector<uint64_t> retired_hit_counts_;
+    static std::vector<time_t> retired_last_hits_;
+
+    /**
+     * Coarse clock stored with every hit, in milliseconds since the epoch
+     */
+    static boost::atomic<int64_t> now_;
+  };
+
+
+  /**
+   * Background thread calling HitCounters::aggregate() periodically,
+   * stopped by the destructor
+   */
+  class HitAggregator: private boost::noncopyable {
+  public:
+    /**
+     * \param interval_ms time between two aggregations
+     */
+    explicit HitAggregator(uint32_t interval_ms = DefaultInterval);
+    ~HitAggregator();
+
+    static const uint32_t DefaultInterval = 1000;
+
+  private:
+    void run(uint32_t interval_ms);
+
+    boost::thread thread_;
+  };
+
+}
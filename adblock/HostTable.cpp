@@ -0,0 +1,98 @@
+#include "HostTable.h"
+
+
+namespace NS_ADBLOCK {
+
+  std::string HostTable::get_host(const RegExpFilter &filter) {
+    if (filter.is_regex()) {
+      return std::string();
+    }
+
+    // The body is stored lowercase unless the filter is case sensitive
+    const Pattern &pattern = filter.get_pattern();
+    const std::string &body = pattern.get_body();
+    if (pattern.get_flags() != Pattern::ANCHOR_HOST || body.length() < 2 ||
+      body[body.length() - 1] != '^')
+    {
+      return std::string();
+    }
+    for (size_t idx = 0; idx + 1 < body.length(); ++idx) {
+      // Covers the * wildcards and ^ placeholders too
+      if (Pattern::is_separator(body[idx])) {
+        return std::string();
+      }
+    }
+    return body.substr(0, body.length() - 1);
+  }
+
+  void HostTable::clear() {
+    filters_by_host_.clear();
+    size_ = 0;
+  }
+
+  void HostTable::add(const std::string &host, const RegExpFilterPtr &filter) {
+    filters_by_host_[host].push_back(filter);
+    ++size_;
+  }
+
+  RegExpFilterPtr HostTable::remove(
+    const std::string &host,
+    const RegExpFilterPtr &filter
+    )
+  {
+    RegExpFilterPtr result;
+    auto bucket = filters_by_host_.find(host);
+    if (bucket == filters_by_host_.end()) {
+      return result;
+    }
+
+    // The registered filter may be another object with the same text
+    Filters &filters = bucket->second;
+    for (auto iter = filters.begin(); iter != filters.end(); ++iter) {
+      if ((*iter)->get_text() == filter->get_text()) {
+        result = *iter;
+        filters.erase(iter);
+        --size_;
+        break;
+      }
+    }
+    if (filters.size() == 0) {
+      filters_by_host_.erase(bucket);
+    }
+    return result;
+  }
+
+  RegExpFilterPtr HostTable::matches_any(
+    const Request &request,
+    const DomainMatches &domains
+    ) const
+  {
+    if (size_ == 0) {
+      return nullptr;
+    }
+    for (uint32_t idx = 0; idx < request.get_host_key_count(); ++idx) {
+      auto bucket = filters_by_host_.find(request.get_host_key(idx),
+        StringHash(), StringEqual());
+      if (bucket == filters_by_host_.end()) {
+        continue;
+      }
+      const Filters &filters = bucket->second;
+      for (auto iter = filters.begin(); iter != filters.end(); ++iter) {
+        if ((*iter)->matches_except_location(request, domains)) {
+          return *iter;
+        }
+      }
+    }
+    return nullptr;
+  }
+
+  HostTable::Filters HostTable::get_filters() const {
+    Filters result;
+    result.reserve(size_);
+    for (auto bucket = filters_by_host_.begin(); bucket != filters_by_host_.end(); ++bucket) {
+      result.insert(result.end(), bucket->second.begin(), bucket->second.end());
+    }
+    return result;
+  }
+
+}
@@ -0,0 +1,85 @@
+/*!
+ * \file HostTable.h
+ *
+ * \author yorath
+ * \date November 15, 2013
+ *
+ * \details Lookup table of the filters anchored on a host name (||host^)
+ */
+
+#pragma once
+
+
+#include "Filter.h"
+#include "Request.h"
+
+
+namespace NS_ADBLOCK {
+
+  /**
+   * Filters of the form ||host^ with any options, by host.
+   *
+   * Most rules of the common lists only block a host and its
+   * sub-domains. Instead of sharing the keyword buckets with the other
+   * filters and running their pattern, they are found by looking up the
+   * host keys of the request (see Pattern#find_host_keys), one probe per
+   * sub-domain. The location is matched by construction, only the
+   * options and domains of the filters found are checked.
+   */
+  class HostTable {
+  public:
+    HostTable(): size_(0) { }
+
+    typedef std::vector<RegExpFilterPtr> Filters;
+
+    /**
+     * Host a filter is anchored on, empty if the filter can't be stored
+     * here: RegExps, case sensitive filters and patterns with anything
+     * but a host name between || and ^
+     */
+    static std::string get_host(const RegExpFilter &filter);
+
+    void clear();
+
+    /**
+     * Adds a filter under the host returned by get_host()
+     */
+    void add(const std::string &host, const RegExpFilterPtr &filter);
+
+    /**
+     * Removes the filter with the same text from the host, returns the
+     * object that was stored or null
+     */
+    RegExpFilterPtr remove(const std::string &host, const RegExpFilterPtr &filter);
+
+    /**
+     * Number of filters in the table
+     */
+    uint32_t size() const { return size_; }
+
+    /**
+     * First filter of the table matching a request, domains are the
+     * domain rules resolved by the DomainIndex holding the filters
+     */
+    RegExpFilterPtr matches_any(const Request &request,
+      const DomainMatches &domains) const;
+
+    /**
+     * All filters of the table, for the rebalancing of the matcher
+     */
+    Filters get_filters() const;
+
+    typedef boost::unordered_map<std::string, Filters, StringHash> FiltersByHost;
+
+    /**
+     * Filters by host, each list in the order matches_any() checks it
+     */
+    const FiltersByHost &get_filters_by_host() const { return filters_by_host_; }
+
+  private:
+    FiltersByHost filters_by_host_;
+
+    uint32_t size_;
+  };
+
+}
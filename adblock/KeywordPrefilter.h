@@ -0,0 +1,96 @@
+/*!
+ * \file KeywordPrefilter.h
+ *
+ * \author yorath
+ * \date November 14, 2013
+ *
+ * \details Bloom filter rejecting URL tokens that are not keywords before
+ * the keyword buckets are probed.
+ */
+
+#pragma once
+
+
+#include <cstdint>
+#include <vector>
+
+
+namespace NS_ADBLOCK {
+
+  /**
+   * Blocked Bloom filter over the keyword hashes of a matcher
+   * (Tokenizer::hash()).
+   *
+   * Most tokens of a URL are not keywords. The two bits of a hash lie in
+   * the same 64-bit word, so a token is rejected with one memory access
+   * instead of a bucket probe. Keywords can't be removed: a removed
+   * keyword only costs false positives until the owner rebuilds the
+   * filter. With BitsPerKeyword bits per keyword about 5% of the tokens
+   * that are not keywords get through.
+   */
+  class KeywordPrefilter {
+  public:
+    KeywordPrefilter() { clear(); }
+
+    /**
+     * Removes all keywords and shrinks to the minimum size
+     */
+    void clear() {
+      reset(0);
+    }
+
+    /**
+     * Removes all keywords and sizes the filter for a number of keywords
+     */
+    void reset(uint32_t expected) {
+      size_t words = MinWords;
+      while (words * 64 < static_cast<size_t>(expected) * BitsPerKeyword) {
+        words *= 2;
+      }
+      words_.assign(words, 0);
+      count_ = 0;
+    }
+
+    void insert(uint32_t hash) {
+      words_[hash & (words_.size() - 1)] |= mask(hash);
+      ++count_;
+    }
+
+    /**
+     * False if the keyword was never inserted
+     */
+    bool may_contain(uint32_t hash) const {
+      uint64_t bits = mask(hash);
+      return (words_[hash & (words_.size() - 1)] & bits) == bits;
+    }
+
+    /**
+     * Number of insertions since the last reset
+     */
+    uint32_t get_count() const { return count_; }
+
+    /**
+     * Number of keywords the filter is sized for, beyond it the false
+     * positive rate grows
+     */
+    uint32_t get_capacity() const {
+      return static_cast<uint32_t>(words_.size() * 64 / BitsPerKeyword);
+    }
+
+    static const uint32_t BitsPerKeyword = 8;
+    static const uint32_t MinWords = 64;
+
+  private:
+    /**
+     * The low bits pick the word, the high bits the two bits in it
+     */
+    static uint64_t mask(uint32_t hash) {
+      return (static_cast<uint64_t>(1) << ((hash >> 20) & 63)) |
+        (static_cast<uint64_t>(1) << ((hash >> 26) & 63));
+    }
+
+    std::vector<uint64_t> words_;
+    uint32_t count_;
+  };
+
+}
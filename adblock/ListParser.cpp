@@ -0,0 +1,97 @@
+#include "ListParser.h"
+#include <boost/atomic.hpp>
+#include <boost/thread.hpp>
+
+
+namespace NS_ADBLOCK {
+
+  namespace {
+
+    typedef std::vector<FilterPtr> Filters;
+
+    void parse_chunk(boost::string_ref chunk, Filters &filters) {
+      while (chunk.size() > 0) {
+        size_t end = chunk.find('\n');
+        if (end == boost::string_ref::npos) {
+          end = chunk.size();
+        }
+        FilterPtr filter = Filter::from_text(std::string(chunk.begin(),
+          chunk.begin() + end));
+        if (filter != nullptr) {
+          filters.push_back(filter);
+        }
+        chunk.remove_prefix(end < chunk.size() ? end + 1 : end);
+      }
+    }
+
+    /**
+     * Worker thread, parses chunks until there are none left
+     */
+    class ChunkWorker {
+    public:
+      ChunkWorker(const std::vector<boost::string_ref> &chunks,
+        std::vector<Filters> &results, boost::atomic<uint32_t> &next):
+        chunks_(&chunks), results_(&results), next_(&next) { }
+
+      void operator()() {
+        while (true) {
+          uint32_t idx = next_->fetch_add(1, boost::memory_order_relaxed);
+          if (idx >= chunks_->size()) {
+            break;
+          }
+          parse_chunk((*chunks_)[idx], (*results_)[idx]);
+        }
+      }
+
+    private:
+      const std::vector<boost::string_ref> *chunks_;
+      std::vector<Filters> *results_;
+      boost::atomic<uint32_t> *next_;
+    };
+
+  }
+
+  std::vector<FilterPtr> ListParser::parse(
+    boost::string_ref buffer,
+    uint32_t thread_count
+    )
+  {
+    if (thread_count == 0) {
+      thread_count = std::max(boost::thread::hardware_concurrency(), 1u);
+    }
+
+    // Split at line breaks close to equal sizes
+    std::vector<boost::string_ref> chunks;
+    size_t chunk_size = buffer.size() / (thread_count * ChunksPerThread) + 1;
+    while (buffer.size() > 0) {
+      size_t end = std::min(chunk_size, buffer.size());
+      while (end < buffer.size() && buffer[end - 1] != '\n') {
+        ++end;
+      }
+      chunks.push_back(buffer.substr(0, end));
+      buffer.remove_prefix(end);
+    }
+
+    std::vector<Filters> results(chunks.size());
+    if (thread_count == 1) {
+      for (uint32_t idx = 0; idx < chunks.size(); ++idx) {
+        parse_chunk(chunks[idx], results[idx]);
+      }
+    } else {
+      boost::atomic<uint32_t> next(0);
+      boost::thread_group threads;
+      for (uint32_t idx = 0; idx < thread_count; ++idx) {
+        threads.create_thread(ChunkWorker(chunks, results, next));
+      }
+      threads.join_all();
+    }
+
+    Filters filters;
+    for (auto iter = results.begin(); iter != results.end(); ++iter) {
+      filters.insert(filters.end(), iter->begin(), iter->end());
+    }
+    Filter::report_invalid(filters);
+    return filters;
+  }
+
+}
@@ -0,0 +1,49 @@
+/*!
+ * \file ListParser.h
+ *
+ * \author yorath
+ * \date November 1, 2013
+ *
+ * \details Parsing of whole filter lists on several threads.
+ */
+
+#pragma once
+
+
+#include "Filter.h"
+
+
+namespace NS_ADBLOCK {
+
+  /**
+   * Bulk loader for filter lists.
+   *
+   * The buffer is split into chunks of whole lines that the worker
+   * threads take one at a time. Every chunk keeps its own result list and
+   * the lists are joined in chunk order, so the result doesn't depend on
+   * the number of threads or how the chunks were scheduled. Duplicates
+   * are merged by Filter::known_filters_ exactly like with serial calls of
+   * Filter::from_text().
+   */
+  class ListParser {
+  public:
+    /*!
+     * Parses a filter list, one filter per line
+     *
+     * \param buffer content of the list, \n or \r\n line endings
+     * \param thread_count number of worker threads, 0 for one per core
+     *
+     * \return filters in line order, empty lines are skipped. The invalid
+     * ones are reported to Filter::get_diagnostics() in that order.
+     */
+    static std::vector<FilterPtr> parse(boost::string_ref buffer,
+      uint32_t thread_count = 0);
+
+    /**
+     * Number of chunks handed to every thread, more chunks balance the
+     * load better when some lines are slower to parse than others
+     */
+    static const uint32_t ChunksPerThread = 8;
+  };
+
+}
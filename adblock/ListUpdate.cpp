@@ -0,0 +1,153 @@
+#include "ListUpdate.h"
+#include <boost/unordered_set.hpp>
+
+
+namespace NS_ADBLOCK {
+
+  namespace {
+
+    typedef boost::unordered_set<boost::string_ref, StringHash, StringEqual> Lines;
+
+    bool is_active(const FilterPtr &filter) {
+      switch (filter->get_type()) {
+      case BLOCKING_FILTER:
+      case WHITELIST_FILTER:
+      case ELEM_HIDE_FILTER:
+      case ELEM_HIDE_EXCEPTION:
+        return true;
+      default:
+        return false;
+      }
+    }
+
+    /**
+     * Parses the lines of one version that the other version doesn't
+     * have, every filter is listed once. Invalid filters are collected
+     * in invalid if it isn't null.
+     */
+    void parse_missing(const std::vector<std::string> &lines,
+      const Lines &other, std::vector<FilterPtr> &filters,
+      std::vector<FilterPtr> *invalid)
+    {
+      boost::unordered_set<const Filter *> seen;
+      for (auto iter = lines.begin(); iter != lines.end(); ++iter) {
+        if (other.count(*iter) > 0) {
+          continue;
+        }
+        FilterPtr filter = Filter::from_text(*iter);
+        if (filter == nullptr) {
+          continue;
+        }
+        if (is_active(filter)) {
+          if (seen.insert(filter.get()).second) {
+            filters.push_back(filter);
+          }
+        } else if (invalid != nullptr && filter->get_type() == INVALID_FILTER) {
+          invalid->push_back(filter);
+        }
+      }
+    }
+
+    typedef boost::unordered_set<std::string> Texts;
+
+    /**
+     * Filter texts of the lines that normalization changes. A line
+     * without whitespace is its own filter text, so the filters of a list
+     * are its lines plus these texts.
+     */
+    Texts normalized_texts(const std::vector<std::string> &lines) {
+      Texts result;
+      for (auto iter = lines.begin(); iter != lines.end(); ++iter) {
+        for (auto ch = iter->begin(); ch != iter->end(); ++ch) {
+          if (*ch == ' ' || (*ch >= '\t' && *ch <= '\r')) {
+            result.insert(Filter::normalize(*iter));
+            break;
+          }
+        }
+      }
+      return result;
+    }
+
+    /**
+     * Drops the filters that the other version of the list still has
+     */
+    void drop_kept(std::vector<FilterPtr> &filters, const Lines &other_lines,
+      const Texts &other_texts)
+    {
+      for (auto iter = filters.begin(); iter != filters.end();) {
+        const std::string &text = (*iter)->get_text();
+        if (other_lines.count(boost::string_ref(text)) > 0 || other_texts.count(text) > 0) {
+          iter = filters.erase(iter);
+        } else {
+          ++iter;
+        }
+      }
+    }
+
+  }
+
+  ListUpdate::Diff ListUpdate::diff(
+    const std::vector<std::string> &old_lines,
+    const std::vector<std::string> &new_lines
+    )
+  {
+    Lines old_set(old_lines.begin(), old_lines.end());
+    Lines new_set(new_lines.begin(), new_lines.end());
+
+    Diff result;
+    std::vector<FilterPtr> invalid;
+    parse_missing(old_lines, new_set, result.removed, nullptr);
+    parse_missing(new_lines, old_set, result.added, &invalid);
+
+    // The old version reported its own invalid filters when it was loaded
+    Filter::report_invalid(invalid);
+
+    // A line missing from the other version can still be one of its
+    // filters, written differently
+    if (result.removed.size() > 0) {
+      drop_kept(result.removed, new_set, normalized_texts(new_lines));
+    }
+    if (result.added.size() > 0) {
+      drop_kept(result.added, old_set, normalized_texts(old_lines));
+    }
+    return result;
+  }
+
+  ListUpdate::Stats ListUpdate::apply(
+    CombindMatcher &matcher,
+    ElemHide &elem_hide,
+    const std::vector<std::string> &old_lines,
+    const std::vector<std::string> &new_lines
+    )
+  {
+    boost::chrono::steady_clock::time_point start = boost::chrono::steady_clock::now();
+    Diff changes = diff(old_lines, new_lines);
+
+    CombindMatcher::Filters removed_rules, added_rules;
+    ElemHide::Filters removed_elems, added_elems;
+    for (auto iter = changes.removed.begin(); iter != changes.removed.end(); ++iter) {
+      if ((*iter)->get_type() == BLOCKING_FILTER || (*iter)->get_type() == WHITELIST_FILTER) {
+        removed_rules.push_back(boost::static_pointer_cast<RegExpFilter>(*iter));
+      } else {
+        removed_elems.push_back(boost::static_pointer_cast<ElemHideBase>(*iter));
+      }
+    }
+    for (auto iter = changes.added.begin(); iter != changes.added.end(); ++iter) {
+      if ((*iter)->get_type() == BLOCKING_FILTER || (*iter)->get_type() == WHITELIST_FILTER) {
+        added_rules.push_back(boost::static_pointer_cast<RegExpFilter>(*iter));
+      } else {
+        added_elems.push_back(boost::static_pointer_cast<ElemHideBase>(*iter));
+      }
+    }
+
+    Stats stats;
+    stats.removed = static_cast<uint32_t>(changes.removed.size());
+    stats.added = static_cast<uint32_t>(changes.added.size());
+    stats.invalidated = matcher.update(removed_rules, added_rules);
+    elem_hide.update(removed_elems, added_elems);
+    stats.elapsed = boost::chrono::duration_cast<boost::chrono::microseconds>(
+      boost::chrono::steady_clock::now() - start);
+    return stats;
+  }
+
+}
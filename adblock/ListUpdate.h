@@ -0,0 +1,81 @@
+/*!
+ * \file ListUpdate.h
+ *
+ * \author yorath
+ * \date November 9, 2013
+ *
+ * \details Incremental update of the rules when a filter list changes
+ */
+
+#pragma once
+
+
+#include "Filter.h"
+#include "Matcher.h"
+#include "ElemHide.h"
+#include <boost/chrono.hpp>
+
+
+namespace NS_ADBLOCK {
+
+  /**
+   * Applies a new version of a filter list to the rules loaded from the
+   * old one.
+   *
+   * Only the lines that differ between the versions are parsed. A filter
+   * parsed from such a line is only removed or added if the other
+   * version doesn't have it in any spelling: lines that normalize to the
+   * same filter cancel out. The removed and added
+   * filters are then handed to CombindMatcher::update() and
+   * ElemHide::update() in one batch, so most cached results survive.
+   */
+  class ListUpdate {
+  public:
+    /**
+     * Filters that differ between two versions of a list, comments and
+     * invalid filters are left out
+     */
+    struct Diff {
+      std::vector<FilterPtr> removed;
+      std::vector<FilterPtr> added;
+    };
+
+    /**
+     * Computes the filters removed and added by a new version of a list,
+     * the invalid filters of the new lines are reported to
+     * Filter::get_diagnostics()
+     */
+    static Diff diff(const std::vector<std::string> &old_lines,
+      const std::vector<std::string> &new_lines);
+
+    struct Stats {
+      uint32_t removed;
+      uint32_t added;
+
+      /**
+       * Number of cached matching results that were dropped
+       */
+      uint32_t invalidated;
+
+      /**
+       * Time taken by the whole update, diff included
+       */
+      boost::chrono::microseconds elapsed;
+    };
+
+    /*!
+     * Updates rules loaded from old_lines to new_lines
+     *
+     * \param matcher blocking and exception rules of the list
+     * \param elem_hide element hiding rules of the list
+     * \param old_lines list the rules were loaded from
+     * \param new_lines new version of the list
+     *
+     * \return what changed and how long it took
+     */
+    static Stats apply(CombindMatcher &matcher, ElemHide &elem_hide,
+      const std::vector<std::string> &old_lines,
+      const std::vector<std::string> &new_lines);
+  };
+
+}
@@ -1,48 +1,144 @@
 #include "Matcher.h"
+#include "FilterOptions.h"
+#include "HitCounters.h"
+#include "FilterProfiler.h"
 #include <boost/algorithm/string/case_conv.hpp>
-#include <sstream>
+#include <boost/unordered_set.hpp>
+#include <algorithm>
 
 
 namespace NS_ADBLOCK {
 
   void Matcher::clear() {
     filter_by_keyword_.clear();
-    keyword_by_filter_.clear();
+    slot_by_filter_.clear();
+    hosts_.clear();
+    prefilter_.clear();
+    stale_keywords_ = 0;
+    domains_.clear();
   }
 
   void Matcher::add(const RegExpFilterPtr &filter) {
-    if (keyword_by_filter_.find(filter->get_text()) != keyword_by_filter_.end()) {
+    if (slot_by_filter_.find(filter->get_text()) != slot_by_filter_.end()) {
       return;
     }
-    
-    // Look for a suitable keyword
-    std::string keyword = find_keyword(filter);
-    filter_by_keyword_[keyword].push_back(filter);
-    keyword_by_filter_[filter->get_text()] = keyword;
+
+    std::string host = HostTable::get_host(*filter);
+    if (host.length() > 0) {
+      insert_host(filter, host);
+    } else {
+      // Look for a suitable keyword
+      insert(filter, find_keyword(filter));
+    }
+  }
+
+  void Matcher::insert(const RegExpFilterPtr &filter, const std::string &keyword) {
+    Bucket &bucket = filter_by_keyword_[keyword];
+    if (bucket.filters.size() == 0) {
+      add_keyword(keyword);
+    }
+    Slot &slot = slot_by_filter_[filter->get_text()];
+    slot.keyword = keyword;
+    slot.index = static_cast<uint32_t>(bucket.filters.size());
+    slot.host.clear();
+    bucket.filters.push_back(filter);
+    domains_.add(filter.get());
+  }
+
+  void Matcher::insert_host(const RegExpFilterPtr &filter, const std::string &host) {
+    Slot &slot = slot_by_filter_[filter->get_text()];
+    slot.keyword = find_keyword(filter);
+    slot.index = 0;
+    slot.host = host;
+    hosts_.add(host, filter);
+    domains_.add(filter.get());
   }
 
   void Matcher::remove(const RegExpFilterPtr &filter) {
-    if (keyword_by_filter_.find(filter->get_text()) == keyword_by_filter_.end()) {
+    auto slot = slot_by_filter_.find(filter->get_text());
+    if (slot == slot_by_filter_.end()) {
+      return;
+    }
+
+    if (slot->second.host.length() > 0) {
+      RegExpFilterPtr entry = hosts_.remove(slot->second.host, filter);
+      domains_.remove(entry.get());
+      slot_by_filter_.erase(slot);
       return;
     }
 
-    std::string keyword = keyword_by_filter_[filter->get_text()];
-    filter_by_keyword_.erase(keyword);
-    keyword_by_filter_.erase(filter->get_text());
+    // The registered filter may be another object with the same text
+    auto bucket = filter_by_keyword_.find(slot->second.keyword);
+    RegExpFilterPtr &entry = bucket->second.filters[slot->second.index];
+    domains_.remove(entry.get());
+    entry.reset();
+    ++bucket->second.removed;
+
+    if (bucket->second.size() == 0) {
+      filter_by_keyword_.erase(bucket);
+      if (slot->second.keyword.length() > 0 &&
+        ++stale_keywords_ * 2 > filter_by_keyword_.size())
+      {
+        rebuild_prefilter();
+      }
+    } else if (bucket->second.removed * 2 > bucket->second.filters.size()) {
+      compact(bucket->second);
+    }
+    slot_by_filter_.erase(slot);
   }
 
-  std::string Matcher::find_keyword(const RegExpFilterPtr &filter) {
-    std::string result;
+  void Matcher::add_keyword(const std::string &keyword) {
+    if (keyword.length() == 0) {
+      return;
+    }
+    if (prefilter_.get_count() >= prefilter_.get_capacity()) {
+      rebuild_prefilter();
+    } else {
+      prefilter_.insert(Tokenizer::hash(keyword.data(),
+        keyword.data() + keyword.length()));
+    }
+  }
+
+  void Matcher::rebuild_prefilter() {
+    prefilter_.reset(static_cast<uint32_t>(filter_by_keyword_.size()) * 2);
+    for (auto iter = filter_by_keyword_.begin(); iter != filter_by_keyword_.end(); ++iter) {
+      const std::string &keyword = iter->first;
+      if (keyword.length() > 0) {
+        prefilter_.insert(Tokenizer::hash(keyword.data(),
+          keyword.data() + keyword.length()));
+      }
+    }
+    stale_keywords_ = 0;
+  }
+
+  void Matcher::compact(Bucket &bucket) {
+    uint32_t count = 0;
+    for (auto iter = bucket.filters.begin(); iter != bucket.filters.end(); ++iter) {
+      if (*iter != nullptr) {
+        slot_by_filter_.find((*iter)->get_text())->second.index = count;
+        bucket.filters[count++].swap(*iter);
+      }
+    }
+    bucket.filters.resize(count);
+    bucket.removed = 0;
+  }
+
+  void Matcher::get_candidates(
+    const RegExpFilterPtr &filter,
+    std::vector<std::string> &candidates
+    )
+  {
+    candidates.clear();
     std::string text = filter->get_text();
 
     if (boost::regex_search(text, Filter::RegexRegex)) {
-      return result;
+      return;
     }
 
     // Remove options
-    boost::smatch match;
-    if (boost::regex_search(text, match, Filter::OptionsRegex)) {
-      text = std::string(text.begin(), match[0].first);
+    size_t options_idx = FilterOptions::find(text);
+    if (options_idx != std::string::npos) {
+      text.erase(options_idx);
     }
 
     // Remove whitelist marker
@@ -55,18 +151,24 @@ namespace NS_ADBLOCK {
       boost::regex("[^a-z0-9%*][a-z0-9%]{3,}(?=[^a-z0-9%*])"), 0);
     decltype(token_iter) token_end;
 
-    if (token_iter == token_end) {
-      return result;
+    while (token_iter != token_end) {
+      candidates.push_back(token_iter++->str().substr(1));
     }
+  }
+
+  std::string Matcher::find_keyword(const RegExpFilterPtr &filter) const {
+    std::string result;
+    std::vector<std::string> candidates;
+    get_candidates(filter, candidates);
 
     uint32_t result_count = 0xFFFFFF;
     uint32_t result_len = 0;
-    while (token_iter != token_end) {
-      std::string candidate = token_iter++->str().substr(1);
+    for (auto iter = candidates.begin(); iter != candidates.end(); ++iter) {
+      const std::string &candidate = *iter;
       uint32_t count = 0;
-      auto iter = filter_by_keyword_.find(candidate);
-      if (iter != filter_by_keyword_.end()) {
-        count = iter->second.size();
+      auto bucket = filter_by_keyword_.find(candidate);
+      if (bucket != filter_by_keyword_.end()) {
+        count = bucket->second.size();
       }
       if (count < result_count || (count == result_count && candidate.length() > result_len)) {
         result = candidate;
@@ -77,63 +179,292 @@ namespace NS_ADBLOCK {
     return result;
   }
 
-  bool Matcher::has_filter(const RegExpFilterPtr &filter) {
-    return (keyword_by_filter_.find(filter->get_text()) != keyword_by_filter_.end());
+  bool Matcher::has_filter(const RegExpFilterPtr &filter) const {
+    return (slot_by_filter_.find(filter->get_text()) != slot_by_filter_.end());
   }
 
   std::string Matcher::get_keyword(
     const RegExpFilterPtr &filter
-    )
+    ) const
   {
     std::string result;
-    auto iter = keyword_by_filter_.find(filter->get_text());
-    if (iter != keyword_by_filter_.end()) {
-      result = iter->second;
+    auto iter = slot_by_filter_.find(filter->get_text());
+    if (iter != slot_by_filter_.end()) {
+      result = iter->second.keyword;
     }
     return result;
   }
 
+  bool Matcher::is_host_filter(const RegExpFilterPtr &filter) const {
+    auto iter = slot_by_filter_.find(filter->get_text());
+    return iter != slot_by_filter_.end() && iter->second.host.length() > 0;
+  }
+
   RegExpFilterPtr Matcher::matches_any(
     const std::string &location,
     const std::string &content_type,
     const std::string &doc_domain,
     bool third_party
-    )
+    ) const
   {
-    auto token_iter = make_regex_token_iterator(
-      boost::to_lower_copy(location), boost::regex("[a-z0-9%]{3,}"), 0);
-    decltype(token_iter) token_end;
+    return matches_any(Request(location, content_type, doc_domain,
+      third_party));
+  }
 
-    std::vector<std::string> candidates(token_iter, token_end);
-    candidates.push_back("");
-    for (auto iter = candidates.begin(); iter != candidates.end(); ++iter) {
-      std::string substr = *iter;
-      if (filter_by_keyword_.find(substr) != filter_by_keyword_.end()) {
-        RegExpFilterPtr result = check_entry_match(substr, location,
-          content_type, doc_domain, third_party);
+  RegExpFilterPtr Matcher::matches_any(
+    const std::string &location,
+    CONTENT_TYPE content_type,
+    const std::string &doc_domain,
+    bool third_party
+    ) const
+  {
+    return matches_any(Request(location, content_type, doc_domain,
+      third_party));
+  }
+
+  RegExpFilterPtr Matcher::matches_any(const Request &request) const {
+    return matches_any(request, request.get_domain_matches(domains_));
+  }
+
+  RegExpFilterPtr Matcher::matches_any(
+    const Request &request,
+    const DomainMatches &domains
+    ) const
+  {
+    // One probe per sub-domain of the request, no pattern is tested
+    RegExpFilterPtr result = hosts_.matches_any(request, domains);
+    if (result != nullptr) {
+      return result;
+    }
+
+    for (uint32_t idx = 0; idx < request.get_token_count(); ++idx) {
+      // Most tokens aren't keywords, skip them without a probe
+      uint32_t hash = request.get_token_hash(idx);
+      if (!prefilter_.may_contain(hash)) {
+        continue;
+      }
+      auto bucket = filter_by_keyword_.find(request.get_token(idx),
+        TokenHash(hash), StringEqual());
+      if (bucket != filter_by_keyword_.end()) {
+        result = check_bucket_match(bucket->second.filters, request, domains);
         if (result != nullptr) {
           return result;
         }
       }
     }
-    return nullptr;
+
+    // Filters without a keyword are checked against every URL
+    auto iter = filter_by_keyword_.find("");
+    if (iter == filter_by_keyword_.end()) {
+      return nullptr;
+    }
+    return check_bucket_match(iter->second.filters, request, domains);
   }
 
   RegExpFilterPtr Matcher::check_entry_match(
-    const std::string &keyword,
-    const std::string &location,
-    const std::string &content_type,
-    const std::string &doc_domain,
-    bool third_party
-    )
+    boost::string_ref keyword,
+    const Request &request
+    ) const
   {
-    auto iter = filter_by_keyword_.find(keyword);
+    if (keyword.length() > 0 &&
+      !prefilter_.may_contain(Tokenizer::hash(keyword.begin(), keyword.end())))
+    {
+      return nullptr;
+    }
+    auto iter = filter_by_keyword_.find(keyword, KeywordHash(), StringEqual());
     if (iter == filter_by_keyword_.end()) {
       return nullptr;
     }
+    return check_bucket_match(iter->second.filters, request,
+      request.get_domain_matches(domains_));
+  }
+
+  void Matcher::BucketStats::add(const BucketStats &other) {
+    if (histogram.size() < other.histogram.size()) {
+      histogram.resize(other.histogram.size(), 0);
+    }
+    for (uint32_t idx = 0; idx < other.histogram.size(); ++idx) {
+      histogram[idx] += other.histogram[idx];
+    }
+    buckets += other.buckets;
+    largest = std::max(largest, other.largest);
+    keywordless += other.keywordless;
+    by_host += other.by_host;
+    expected_checks += other.expected_checks;
+  }
+
+  Matcher::BucketStats Matcher::get_bucket_stats(
+    const std::vector<std::string> &sample_urls
+    ) const
+  {
+    BucketStats stats;
+    stats.by_host = hosts_.size();
+    for (auto iter = filter_by_keyword_.begin(); iter != filter_by_keyword_.end(); ++iter) {
+      uint32_t size = iter->second.size();
+      uint32_t bin = 0;
+      while ((size >> (bin + 1)) != 0) {
+        ++bin;
+      }
+      if (stats.histogram.size() <= bin) {
+        stats.histogram.resize(bin + 1, 0);
+      }
+      ++stats.histogram[bin];
+      ++stats.buckets;
+      stats.largest = std::max(stats.largest, size);
+      if (iter->first.length() == 0) {
+        stats.keywordless = size;
+      }
+    }
+
+    if (sample_urls.size() > 0) {
+      // Same buckets as visited by matches_any()
+      uint64_t checks = 0;
+      Request request;
+      for (auto url = sample_urls.begin(); url != sample_urls.end(); ++url) {
+        request.set_location(*url);
+        for (uint32_t idx = 0; idx < request.get_token_count(); ++idx) {
+          auto bucket = filter_by_keyword_.find(request.get_token(idx),
+            TokenHash(request.get_token_hash(idx)), StringEqual());
+          if (bucket != filter_by_keyword_.end()) {
+            checks += bucket->second.filters.size();
+          }
+        }
+        checks += stats.keywordless;
+      }
+      stats.expected_checks = static_cast<double>(checks) / sample_urls.size();
+    }
+    return stats;
+  }
+
+  Matcher::Buckets Matcher::get_buckets() const {
+    Buckets result;
+    result.reserve(filter_by_keyword_.size());
+    for (auto bucket = filter_by_keyword_.begin(); bucket != filter_by_keyword_.end(); ++bucket) {
+      result.push_back(std::make_pair(bucket->first, Filters()));
+      Filters &filters = result.back().second;
+      filters.reserve(bucket->second.size());
+      for (auto iter = bucket->second.filters.begin(); iter != bucket->second.filters.end(); ++iter) {
+        if (*iter != nullptr) {
+          filters.push_back(*iter);
+        }
+      }
+    }
+    return result;
+  }
+
+  Matcher::RebalanceStats Matcher::rebalance(
+    const std::vector<std::string> &sample_urls
+    )
+  {
+    RebalanceStats stats;
+    stats.before = get_bucket_stats(sample_urls);
+
+    typedef boost::unordered_map<std::string, uint32_t, StringHash> Counts;
+    Counts url_counts;
+    Request request;
+    for (auto url = sample_urls.begin(); url != sample_urls.end(); ++url) {
+      request.set_location(*url);
+      for (uint32_t idx = 0; idx < request.get_token_count(); ++idx) {
+        boost::string_ref token = request.get_token(idx);
+        auto iter = url_counts.find(token, StringHash(), StringEqual());
+        if (iter != url_counts.end()) {
+          ++iter->second;
+        } else {
+          url_counts.insert(std::make_pair(token.to_string(), 1));
+        }
+      }
+    }
+
+    struct Entry {
+      RegExpFilterPtr filter;
+      std::vector<std::string> candidates;
+    };
+    std::vector<Entry> entries;
+    entries.reserve(slot_by_filter_.size());
+    Counts filter_counts;
+    for (auto bucket = filter_by_keyword_.begin(); bucket != filter_by_keyword_.end(); ++bucket) {
+      const Filters &filters = bucket->second.filters;
+      for (auto iter = filters.begin(); iter != filters.end(); ++iter) {
+        if (*iter == nullptr) {
+          continue;
+        }
+        entries.push_back(Entry());
+        entries.back().filter = *iter;
+        std::vector<std::string> &candidates = entries.back().candidates;
+        get_candidates(*iter, candidates);
+        std::sort(candidates.begin(), candidates.end());
+        candidates.erase(std::unique(candidates.begin(), candidates.end()),
+          candidates.end());
+        for (auto candidate = candidates.begin(); candidate != candidates.end(); ++candidate) {
+          ++filter_counts[*candidate];
+        }
+      }
+    }
+
+    // The filters with the least choice go first, the text makes the
+    // result independent of the order of the list
+    std::vector<const Entry *> order;
+    order.reserve(entries.size());
+    for (auto iter = entries.begin(); iter != entries.end(); ++iter) {
+      order.push_back(&*iter);
+    }
+    std::sort(order.begin(), order.end(), [](const Entry *lhs, const Entry *rhs) {
+      if (lhs->candidates.size() != rhs->candidates.size()) {
+        return lhs->candidates.size() < rhs->candidates.size();
+      }
+      return lhs->filter->get_text() < rhs->filter->get_text();
+    });
+
+    // The host table doesn't depend on the order of the list
+    HostTable::Filters by_host = hosts_.get_filters();
+
+    clear();
+    Counts sizes;
+    for (auto entry = order.begin(); entry != order.end(); ++entry) {
+      const std::vector<std::string> &candidates = (*entry)->candidates;
+      const std::string *result = nullptr;
+      uint64_t result_cost = 0;
+      uint32_t result_count = 0;
+      for (auto candidate = candidates.begin(); candidate != candidates.end(); ++candidate) {
+        uint64_t weight = 1;
+        if (sample_urls.size() > 0) {
+          auto iter = url_counts.find(*candidate);
+          weight += iter != url_counts.end() ? iter->second : 0;
+        }
+        auto size = sizes.find(*candidate);
+        uint64_t cost = ((size != sizes.end() ? size->second : 0) + 1) * weight;
+        uint32_t count = filter_counts[*candidate];
+        if (result == nullptr || cost < result_cost ||
+          (cost == result_cost && (count < result_count ||
+          (count == result_count && candidate->length() > result->length()))))
+        {
+          result = &*candidate;
+          result_cost = cost;
+          result_count = count;
+        }
+      }
+
+      std::string keyword = result != nullptr ? *result : std::string();
+      ++sizes[keyword];
+      insert((*entry)->filter, keyword);
+    }
+    for (auto iter = by_host.begin(); iter != by_host.end(); ++iter) {
+      insert_host(*iter, HostTable::get_host(**iter));
+    }
 
-    for (auto filter = iter->second.begin(); filter != iter->second.end(); ++filter) {
-      if ((*filter)->matches(location, content_type, doc_domain, third_party)) {
+    stats.after = get_bucket_stats(sample_urls);
+    return stats;
+  }
+
+  RegExpFilterPtr Matcher::check_bucket_match(
+    const Filters &filters,
+    const Request &request,
+    const DomainMatches &domains
+    )
+  {
+    for (auto filter = filters.begin(); filter != filters.end(); ++filter) {
+      // Null slots are filters removed since the last compaction
+      if (*filter != nullptr && (*filter)->matches(request, domains)) {
         return *filter;
       }
     }
@@ -141,8 +472,6 @@ namespace NS_ADBLOCK {
   }
 
 
-  const uint32_t CombindMatcher::MaxCacheEntries = 1000;
-
   void CombindMatcher::clear() {
     blacklist_.clear();
     whitelist_.clear();
@@ -151,11 +480,56 @@ namespace NS_ADBLOCK {
   }
 
   void CombindMatcher::add(const RegExpFilterPtr &filter) {
+    add_filter(filter);
+    result_cache_.clear();
+  }
+
+  void CombindMatcher::remove(const RegExpFilterPtr &filter) {
+    remove_filter(filter);
+    result_cache_.clear();
+  }
+
+  uint32_t CombindMatcher::update(const Filters &removed, const Filters &added) {
+    // Matchers remove by text, so a removed filter may be another object
+    // than the one cached for the same text
+    boost::unordered_set<boost::string_ref, StringHash, StringEqual> removed_set;
+    for (auto iter = removed.begin(); iter != removed.end(); ++iter) {
+      remove_filter(*iter);
+      removed_set.insert((*iter)->get_text());
+    }
+    for (auto iter = added.begin(); iter != added.end(); ++iter) {
+      add_filter(*iter);
+    }
+
+    if (added.size() > SelectiveInvalidationLimit) {
+      // Testing every cached request against that many filters costs
+      // more than matching the requests again
+      return result_cache_.invalidate_if(
+        [](const Request &, const RegExpFilterPtr &) { return true; });
+    }
+
+    // A cached result can only change if its filter is gone or if one of
+    // the new filters matches the request
+    return result_cache_.invalidate_if(
+      [&](const Request &request, const RegExpFilterPtr &result) -> bool {
+        if (result != nullptr && removed_set.count(result->get_text()) > 0) {
+          return true;
+        }
+        for (auto iter = added.begin(); iter != added.end(); ++iter) {
+          if ((*iter)->matches(request)) {
+            return true;
+          }
+        }
+        return false;
+      });
+  }
+
+  void CombindMatcher::add_filter(const RegExpFilterPtr &filter) {
     if (filter->get_type() == WHITELIST_FILTER) {
       auto wfilter = boost::dynamic_pointer_cast<WhitelistFilter>(filter);
       if (wfilter->get_key_num() > 0) {
         for (uint32_t idx = 0; idx < wfilter->get_key_num(); ++idx) {
-          keys_[wfilter->get_key(idx)] = wfilter->get_text();
+          keys_[wfilter->get_key(idx)] = filter;
         }
       } else {
         whitelist_.add(filter);
@@ -163,13 +537,9 @@ namespace NS_ADBLOCK {
     } else {
       blacklist_.add(filter);
     }
-
-    if (result_cache_.size() > 0) {
-      result_cache_.clear();
-    }
   }
 
-  void CombindMatcher::remove(const RegExpFilterPtr &filter) {
+  void CombindMatcher::remove_filter(const RegExpFilterPtr &filter) {
     if (filter->get_type() == WHITELIST_FILTER) {
       auto wfilter = boost::dynamic_pointer_cast<WhitelistFilter>(filter);
       if (wfilter->get_key_num() > 0) {
@@ -182,66 +552,91 @@ namespace NS_ADBLOCK {
     } else {
       blacklist_.remove(filter);
     }
-
-    if (result_cache_.size() > 0) {
-      result_cache_.clear();
-    }
   }
 
-  std::string CombindMatcher::find_keyword(const RegExpFilterPtr &filter) {
-    Matcher matcher = filter->get_type() == WHITELIST_FILTER ? whitelist_ : blacklist_;
+  std::string CombindMatcher::find_keyword(const RegExpFilterPtr &filter) const {
+    const Matcher &matcher = filter->get_type() == WHITELIST_FILTER ? whitelist_ : blacklist_;
     return matcher.find_keyword(filter);
   }
 
-  bool CombindMatcher::has_filter(const RegExpFilterPtr &filter) {
-    Matcher matcher = filter->get_type() == WHITELIST_FILTER ? whitelist_ : blacklist_;
+  Matcher::RebalanceStats CombindMatcher::rebalance(
+    const std::vector<std::string> &sample_urls
+    )
+  {
+    Matcher::RebalanceStats stats = blacklist_.rebalance(sample_urls);
+    Matcher::RebalanceStats whitelist_stats = whitelist_.rebalance(sample_urls);
+    stats.before.add(whitelist_stats.before);
+    stats.after.add(whitelist_stats.after);
+    result_cache_.clear();
+    return stats;
+  }
+
+  bool CombindMatcher::has_filter(const RegExpFilterPtr &filter) const {
+    const Matcher &matcher = filter->get_type() == WHITELIST_FILTER ? whitelist_ : blacklist_;
     return matcher.has_filter(filter);
   }
 
-  std::string CombindMatcher::get_keyword(const RegExpFilterPtr &filter) {
-    Matcher matcher = filter->get_type() == WHITELIST_FILTER ? whitelist_ : blacklist_;
+  std::string CombindMatcher::get_keyword(const RegExpFilterPtr &filter) const {
+    const Matcher &matcher = filter->get_type() == WHITELIST_FILTER ? whitelist_ : blacklist_;
     return matcher.get_keyword(filter);
   }
 
-  bool CombindMatcher::is_slow_filter(const RegExpFilterPtr &filter) {
-    Matcher matcher = filter->get_type() == WHITELIST_FILTER ? whitelist_ : blacklist_;
+  bool CombindMatcher::is_slow_filter(const RegExpFilterPtr &filter) const {
+    FilterProfiler::Cost cost = FilterProfiler::get_cost(*filter);
+    if (cost.evaluations > 0 &&
+      cost.total_ns() / cost.evaluations > FilterProfiler::SlowFilterNanoseconds)
+    {
+      return true;
+    }
+
+    const Matcher &matcher = filter->get_type() == WHITELIST_FILTER ? whitelist_ : blacklist_;
     if (matcher.has_filter(filter)) {
-      return matcher.get_keyword(filter).length() == 0;
+      return !matcher.is_host_filter(filter) &&
+        matcher.get_keyword(filter).length() == 0;
     } else {
-      return matcher.find_keyword(filter).length() == 0;
+      // Would be added to the host table
+      return HostTable::get_host(*filter).length() == 0 &&
+        matcher.find_keyword(filter).length() == 0;
     }
   }
 
   RegExpFilterPtr CombindMatcher::matches_any_internal(
-    const std::string &location,
-    const std::string &content_type,
-    const std::string &doc_domain,
-    bool third_party
-    )
+    const Request &request
+    ) const
   {
-    auto token_iter = make_regex_token_iterator(
-      boost::to_lower_copy(location), boost::regex("[a-z0-9%]{3,}"), 0);
-    decltype(token_iter) token_end;
+    // Exception rules win over any blocking rule, so the whitelist is
+    // checked completely first
+    RegExpFilterPtr result = whitelist_.matches_any(request);
+    if (result == nullptr) {
+      result = blacklist_.matches_any(request);
+    }
+    if (result != nullptr) {
+      HitCounters::record(*result);
+    }
+    return result;
+  }
 
-    std::vector<std::string> candidates(token_iter, token_end);
-    candidates.push_back("");
-    RegExpFilterPtr blacklisthit = nullptr;
-    for (auto iter = candidates.begin(); iter != candidates.end(); ++iter) {
-      std::string substr = *iter;
-      RegExpFilterPtr result = whitelist_.check_entry_match(substr,
-        location, content_type, doc_domain, third_party);
-      if (result != nullptr) {
-        return result;
+  void CombindMatcher::matches_page(PageBatch &batch) const {
+    // One pass per matcher, exception rules first as in
+    // matches_any_internal()
+    const DomainMatches &white_domains =
+      batch.get_domain_matches(whitelist_.get_domain_index());
+    for (uint32_t idx = 0; idx < batch.size(); ++idx) {
+      batch.set_result(idx, whitelist_.matches_any(batch.get_request(idx),
+        white_domains));
+    }
+
+    const DomainMatches &black_domains =
+      batch.get_domain_matches(blacklist_.get_domain_index());
+    for (uint32_t idx = 0; idx < batch.size(); ++idx) {
+      if (batch.get_result(idx) == nullptr) {
+        batch.set_result(idx, blacklist_.matches_any(batch.get_request(idx),
+          black_domains));
       }
-      if (blacklisthit == nullptr) {
-        result = blacklist_.check_entry_match(substr, location,
-          content_type, doc_domain, third_party);
-        if (result != nullptr) {
-          blacklisthit = result;
-        }
+      if (batch.get_result(idx) != nullptr) {
+        HitCounters::record(*batch.get_result(idx));
       }
     }
-    return blacklisthit;
   }
 
   RegExpFilterPtr CombindMatcher::matches_any(
@@ -251,40 +646,51 @@ namespace NS_ADBLOCK {
     bool third_party
     )
   {
-    std::stringstream key;
-    key << std::boolalpha << location << " " << content_type << " " << doc_domain << " " << third_party;
+    return matches_any(Request(location, content_type, doc_domain,
+      third_party));
+  }
 
-    auto iter = result_cache_.find(key.str());
-    if (iter != result_cache_.end()) {
-      return iter->second;
-    }
+  RegExpFilterPtr CombindMatcher::matches_any(
+    const std::string &location,
+    CONTENT_TYPE content_type,
+    const std::string &doc_domain,
+    bool third_party
+    )
+  {
+    return matches_any(Request(location, content_type, doc_domain,
+      third_party));
+  }
 
-    RegExpFilterPtr result = matches_any_internal(location, content_type, doc_domain, third_party);
-    if (result_cache_.size() >= MaxCacheEntries) {
-      result_cache_.clear();
+  RegExpFilterPtr CombindMatcher::matches_any(const Request &request) {
+    RegExpFilterPtr result = nullptr;
+    if (result_cache_.find(request, result)) {
+      if (result != nullptr) {
+        HitCounters::record(*result);
+      }
+      return result;
     }
 
-    result_cache_[key.str()] = result;
-
+    result = matches_any_internal(request);
+    result_cache_.insert(request, result);
     return result;
   }
 
+  void CombindMatcher::set_cache_capacity(uint32_t capacity) {
+    result_cache_.set_capacity(capacity);
+  }
+
   RegExpFilterPtr CombindMatcher::matches_by_key(
     const std::string &location,
     std::string key,
     const std::string &doc_domain
-    )
+    ) const
   {
     boost::to_upper(key);
-    auto key_iter = keys_.find(key);
-    if (key_iter != keys_.end()) {
-      auto filter_iter = Filter::known_filters_.find(key_iter->second);
-      if (filter_iter != Filter::known_filters_.end()) {
-        auto filter = boost::dynamic_pointer_cast<RegExpFilter>(filter_iter->second);
-        if (filter->matches(location, "DOCUMENT", doc_domain, false)) {
-          return filter;
-        }
-      }
+    auto iter = keys_.find(key);
+    if (iter != keys_.end() &&
+      iter->second->matches(location, TYPE_DOCUMENT, doc_domain, false))
+    {
+      return iter->second;
     }
     return nullptr;
   }
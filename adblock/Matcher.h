@@ -12,15 +12,43 @@
 
 
 #include "Filter.h"
+#include "KeywordPrefilter.h"
+#include "HostTable.h"
+#include "DomainIndex.h"
+#include "PageBatch.h"
+#include "Request.h"
+#include "ResultCache.h"
 
 
 namespace NS_ADBLOCK {
 
+  /**
+   * Hash of the keyword buckets, the same Tokenizer::hash() the request
+   * computes for its tokens
+   */
+  struct KeywordHash {
+    size_t operator()(boost::string_ref keyword) const {
+      return Tokenizer::hash(keyword.begin(), keyword.end());
+    }
+  };
+
+  /**
+   * KeywordHash of a token already hashed by the tokenizer
+   */
+  struct TokenHash {
+    explicit TokenHash(uint32_t hash): hash(hash) { }
+
+    size_t operator()(boost::string_ref) const { return hash; }
+
+    uint32_t hash;
+  };
+
   /**
    * Blacklist/whitelist filter matching
    */
   class Matcher {
   public:
+    Matcher(): stale_keywords_(0) { }
 
     /**
      * Removes all known filters
@@ -40,17 +68,23 @@ namespace NS_ADBLOCK {
     /**
      * Chooses a keyword to be associated with the filter
      */
-    std::string find_keyword(const RegExpFilterPtr &filter);
+    std::string find_keyword(const RegExpFilterPtr &filter) const;
 
     /**
      * Checks whether a particular filter is being matched against.
      */
-    bool has_filter(const RegExpFilterPtr &filter);
+    bool has_filter(const RegExpFilterPtr &filter) const;
 
     /**
      * Returns the keyword used for a filter, null for unknown filters.
      */
-    std::string get_keyword(const RegExpFilterPtr &filter);
+    std::string get_keyword(const RegExpFilterPtr &filter) const;
+
+    /**
+     * Checks whether a filter is stored in the host table rather than in
+     * a keyword bucket
+     */
+    bool is_host_filter(const RegExpFilterPtr &filter) const;
 
     /**
      * Tests whether the URL matches any of the known filters
@@ -64,27 +98,233 @@ namespace NS_ADBLOCK {
      */
     RegExpFilterPtr matches_any(const std::string &location,
       const std::string &content_type, const std::string &doc_domain,
-      bool third_party);
-    
+      bool third_party) const;
+
+    /**
+     * Same as above with the content type already resolved to its mask
+     */
+    RegExpFilterPtr matches_any(const std::string &location,
+      CONTENT_TYPE content_type, const std::string &doc_domain,
+      bool third_party) const;
+
+    /**
+     * Tests whether the request matches any of the known filters, using
+     * the tokens already computed by the request. Doesn't modify the
+     * matcher or the filters, so concurrent calls are safe as long as
+     * nobody adds or removes filters at the same time.
+     */
+    RegExpFilterPtr matches_any(const Request &request) const;
+
+    /**
+     * Same as above with the domain rules of the document already
+     * resolved from get_domain_index(), to share them between requests
+     */
+    RegExpFilterPtr matches_any(const Request &request,
+      const DomainMatches &domains) const;
+
+    /**
+     * Domain restrictions of the filters of the matcher
+     */
+    const DomainIndex &get_domain_index() const { return domains_; }
+
+    /**
+     * Bloom filter of the keywords, may also hold keywords removed since
+     * it was last rebuilt
+     */
+    const KeywordPrefilter &get_prefilter() const { return prefilter_; }
+
+    /**
+     * Checks whether the entries for a particular keyword match a request,
+     * the filters of the host table are not in the keyword buckets
+     */
+    RegExpFilterPtr check_entry_match(boost::string_ref keyword,
+      const Request &request) const;
+
+    /**
+     * Sizes of the keyword buckets
+     */
+    struct BucketStats {
+      BucketStats(): buckets(0), largest(0), keywordless(0), by_host(0),
+        expected_checks(0) { }
+
+      /**
+       * histogram[i] is the number of buckets holding 2^i to 2^(i+1)-1
+       * filters
+       */
+      std::vector<uint32_t> histogram;
+
+      uint32_t buckets;
+      uint32_t largest;
+
+      /**
+       * Filters without a keyword, checked against every URL
+       */
+      uint32_t keywordless;
+
+      /**
+       * Filters found through the host table instead of a bucket
+       */
+      uint32_t by_host;
+
+      /**
+       * Average number of filters checked per sample URL, 0 without
+       * samples
+       */
+      double expected_checks;
+
+      /**
+       * Adds the buckets of another matcher, expected_checks are summed
+       */
+      void add(const BucketStats &other);
+    };
+
+    /**
+     * Computes the bucket sizes, expected_checks is averaged over the
+     * sample URLs
+     */
+    BucketStats get_bucket_stats(
+      const std::vector<std::string> &sample_urls = std::vector<std::string>()) const;
+
+    struct RebalanceStats {
+      BucketStats before;
+      BucketStats after;
+    };
+
+    /**
+     * Assigns the keywords of all filters again, meant to run after a
+     * bulk load.
+     *
+     * add() picks the least used keyword candidate at the time a filter
+     * is added, so the buckets depend on the order of the list. This
+     * pass knows all filters: the filters with the fewest candidates
+     * choose first, each one takes the candidate that adds the fewest
+     * expected checks. With sample URLs a keyword costs its bucket size
+     * times its number of occurrences in the samples, otherwise the
+     * bucket size alone, ties go to the keyword fewer filters can use.
+     */
+    RebalanceStats rebalance(
+      const std::vector<std::string> &sample_urls = std::vector<std::string>());
+
+    typedef std::vector<RegExpFilterPtr> Filters;
+    typedef std::vector<std::pair<std::string, Filters>> Buckets;
+
     /**
-     * Checks whether the entries for a particular keyword match a URL
+     * Keyword buckets with their filters in the order matches_any()
+     * checks them, for the serialization of the matcher
      */
-    RegExpFilterPtr check_entry_match(const std::string &keyword,
-      const std::string &location, const std::string &content_type,
-      const std::string &doc_domain, bool third_party);
+    Buckets get_buckets() const;
+
+    /**
+     * Filters anchored on a host name, checked before the keyword buckets
+     */
+    const HostTable &get_host_table() const { return hosts_; }
 
   private:
-    typedef boost::unordered_map<std::string, std::vector<RegExpFilterPtr>> FilterByKeyword;
+
+    /**
+     * Keywords a filter can be stored under, empty for filters given
+     * as regular expressions
+     */
+    static void get_candidates(const RegExpFilterPtr &filter,
+      std::vector<std::string> &candidates);
+
+    /**
+     * Stores a filter in the bucket of a keyword
+     */
+    void insert(const RegExpFilterPtr &filter, const std::string &keyword);
+
+    /**
+     * Stores a filter in the host table, host as returned by
+     * HostTable::get_host()
+     */
+    void insert_host(const RegExpFilterPtr &filter, const std::string &host);
+
+    /**
+     * Checks whether any filter in a keyword bucket matches a request
+     */
+    static RegExpFilterPtr check_bucket_match(const Filters &filters,
+      const Request &request, const DomainMatches &domains);
+
+    /**
+     * Filters sharing a keyword. A removed filter leaves a null slot
+     * behind so the slots of the others stay valid, the bucket is
+     * compacted once more than half of it is empty.
+     */
+    struct Bucket {
+      Bucket(): removed(0) { }
+
+      Filters filters;
+      uint32_t removed;
+
+      uint32_t size() const {
+        return static_cast<uint32_t>(filters.size()) - removed;
+      }
+    };
+
     /**
-     * Lookup table for filters by their associated keyword
+     * Moves the filters of a bucket over its null slots
+     */
+    void compact(Bucket &bucket);
+
+    typedef boost::unordered_map<std::string, Bucket, KeywordHash> FilterByKeyword;
+    /**
+     * Lookup table for filters by their associated keyword. A URL token
+     * is looked up with the hash the tokenizer computed for it, without
+     * hashing it again.
      */
     FilterByKeyword filter_by_keyword_;
 
-    typedef boost::unordered_map<std::string, std::string> KeywordByFilter;
     /**
-     * Lookup table for keywords by the filter text
+     * Non-empty keywords of filter_by_keyword_, checked before it is
+     * probed
      */
-    KeywordByFilter keyword_by_filter_;
+    KeywordPrefilter prefilter_;
+
+    /**
+     * Keywords removed from filter_by_keyword_ that are still set in
+     * prefilter_
+     */
+    uint32_t stale_keywords_;
+
+    /**
+     * Adds a new keyword to prefilter_, rebuilding it once it is full
+     */
+    void add_keyword(const std::string &keyword);
+
+    /**
+     * Sizes prefilter_ for twice the current keywords and fills it
+     */
+    void rebuild_prefilter();
+
+    /**
+     * Where a filter is stored, its bucket and the index in it, or its
+     * host in hosts_. Filters of the host table keep the keyword they
+     * would be stored under, for get_keyword().
+     */
+    struct Slot {
+      std::string keyword;
+      uint32_t index;
+      std::string host;
+    };
+
+    typedef boost::unordered_map<std::string, Slot> SlotByFilter;
+    /**
+     * Lookup table for slots by the filter text, removing a filter
+     * takes one lookup here and one in filter_by_keyword_
+     */
+    SlotByFilter slot_by_filter_;
+
+    /**
+     * Filters anchored on a host name, checked before the keyword
+     * buckets
+     */
+    HostTable hosts_;
+
+    /**
+     * Domain restrictions of all filters, resolved once per request
+     * instead of once per candidate filter
+     */
+    DomainIndex domains_;
 
   };
 
@@ -97,6 +337,8 @@ namespace NS_ADBLOCK {
    */
   class CombindMatcher {
   public:
+    explicit CombindMatcher(uint32_t cache_capacity = ResultCache::DefaultCapacity):
+      result_cache_(cache_capacity) { }
 
     /**
      * @see Matcher#clear
@@ -113,25 +355,68 @@ namespace NS_ADBLOCK {
      */
     void remove(const RegExpFilterPtr &filter);
 
+    typedef std::vector<RegExpFilterPtr> Filters;
+
+    /*!
+     * Removes and adds filters in one batch. Instead of dropping the
+     * whole result cache like add() and remove(), only the results that
+     * the change can affect are dropped.
+     *
+     * \param removed filters to remove
+     * \param added filters to add
+     *
+     * \return number of dropped cache entries
+     */
+    uint32_t update(const Filters &removed, const Filters &added);
+
+    /**
+     * Above this number of added filters update() drops the whole cache
+     */
+    static const uint32_t SelectiveInvalidationLimit = 64;
+
     /**
      * @see Matcher#find_keyword
      */
-    std::string find_keyword(const RegExpFilterPtr &filter);
+    std::string find_keyword(const RegExpFilterPtr &filter) const;
+
+    /**
+     * Rebalances both matchers, the stats of their buckets are added.
+     * Drops the result cache.
+     * @see Matcher#rebalance
+     */
+    Matcher::RebalanceStats rebalance(
+      const std::vector<std::string> &sample_urls = std::vector<std::string>());
 
     /**
      * @see Matcher#has_filter
      */
-    bool has_filter(const RegExpFilterPtr &filter);
+    bool has_filter(const RegExpFilterPtr &filter) const;
 
     /**
      * @see Matcher#get_keyword
      */
-    std::string get_keyword(const RegExpFilterPtr &filter);
+    std::string get_keyword(const RegExpFilterPtr &filter) const;
+
+    /**
+     * Matcher of the exception rules
+     */
+    const Matcher &get_whitelist() const { return whitelist_; }
+
+    /**
+     * Matcher of the blocking rules
+     */
+    const Matcher &get_blacklist() const { return blacklist_; }
 
     /**
-     * Checks whether a particular filter is slow
+     * Checks whether a particular filter is slow: it has no keyword, so
+     * it is tested against every URL, or FilterProfiler measured more
+     * than FilterProfiler::SlowFilterNanoseconds per test on average.
+     * Filters of the host table are only tested on requests to their
+     * host, so they are never slow for lack of a keyword. FilterProfiler
+     * doesn't see the host table lookup that found them, only their
+     * options and domains checks, and only on requests to their host.
      */
-    bool is_slow_filter(const RegExpFilterPtr &filter);
+    bool is_slow_filter(const RegExpFilterPtr &filter) const;
 
     /**
      * @see Matcher#matches_any
@@ -140,14 +425,57 @@ namespace NS_ADBLOCK {
       const std::string &content_type, const std::string &doc_domain,
       bool third_party);
 
+    /**
+     * @see Matcher#matches_any
+     */
+    RegExpFilterPtr matches_any(const std::string &location,
+      CONTENT_TYPE content_type, const std::string &doc_domain,
+      bool third_party);
+
+    /**
+     * @see Matcher#matches_any
+     */
+    RegExpFilterPtr matches_any(const Request &request);
+
+    /**
+     * Optimized filter matching testing both whitelist and blacklist
+     * matchers simultaneously. Doesn't use the result cache, so it can be
+     * called from several threads at once.
+     * @see Matcher#matches_any
+     */
+    RegExpFilterPtr matches_any_internal(const Request &request) const;
+
+    /**
+     * Matches all requests of a batch, the results are stored in the
+     * batch. Gives the same results as matches_any_internal() for every
+     * request and is just as safe to call from several threads.
+     */
+    void matches_page(PageBatch &batch) const;
+
+    /**
+     * Resizes the result cache, drops the cached results
+     */
+    void set_cache_capacity(uint32_t capacity);
+
+    /**
+     * Result cache, for its hit/miss/eviction counters
+     */
+    const ResultCache &get_cache() const { return result_cache_; }
+
     /**
      * Looks up whether any filters match the given website key.
      */
     RegExpFilterPtr matches_by_key(const std::string &location, std::string key,
-      const std::string &doc_domain);
+      const std::string &doc_domain) const;
 
   private:
 
+    /**
+     * add() and remove() without touching the result cache
+     */
+    void add_filter(const RegExpFilterPtr &filter);
+    void remove_filter(const RegExpFilterPtr &filter);
+
     /**
      * Matcher for blocking rules.
      */
@@ -158,30 +486,18 @@ namespace NS_ADBLOCK {
      */
     Matcher whitelist_;
 
-    typedef boost::unordered_map<std::string, std::string> Keys;
+    typedef boost::unordered_map<std::string, RegExpFilterPtr> Keys;
     /**
      * Exception rules that are limited by public keys, mapped by
      * the corresponding keys.
      */
     Keys keys_;
 
-    typedef boost::unordered_map<std::string, RegExpFilterPtr> ResultCache;
     /**
      * Lookup table of previous matchesAny results
      */
     ResultCache result_cache_;
 
-    static const uint32_t MaxCacheEntries;
-
-    /**
-     * Optimized filter matching testing both whitelist and blacklist
-     * matchers simultaneously. For parameters see Matcher.matches_any().
-     * @see Matcher#matches_any
-     */
-    RegExpFilterPtr matches_any_internal(const std::string &location,
-      const std::string &content_type, const std::string &doc_domain,
-      bool third_party);
-
   };
 
 }
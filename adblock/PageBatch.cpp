@@ -0,0 +1,35 @@
+#include "PageBatch.h"
+
+
+namespace NS_ADBLOCK {
+
+  PageBatch::PageBatch(): size_(0) {
+  }
+
+  void PageBatch::reset(boost::string_ref doc_domain) {
+    document_.set_doc_domain(doc_domain);
+    for (uint32_t idx = 0; idx < size_; ++idx) {
+      results_[idx] = nullptr;
+    }
+    size_ = 0;
+  }
+
+  void PageBatch::add(
+    boost::string_ref location,
+    CONTENT_TYPE content_type,
+    bool third_party
+    )
+  {
+    if (size_ == requests_.size()) {
+      requests_.push_back(Request());
+      results_.push_back(nullptr);
+    }
+
+    Request &request = requests_[size_++];
+    request.set_location(location);
+    request.set_content_type(content_type);
+    request.set_doc_domain(document_.get_doc_domain());
+    request.set_third_party(third_party);
+  }
+
+}
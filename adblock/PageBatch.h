@@ -0,0 +1,98 @@
+/*!
+ * \file PageBatch.h
+ *
+ * \author yorath
+ * \date November 4, 2013
+ *
+ * \details Subresource requests of one document matched together.
+ */
+
+#pragma once
+
+
+#include "Request.h"
+
+
+namespace NS_ADBLOCK {
+
+  /**
+   * Requests sharing one document domain and their results.
+   *
+   * The document domain is uppercased and its domain rules are resolved
+   * once for the whole batch instead of once per request. Matching runs
+   * the whitelist over all requests first and the blacklist over the ones
+   * left, so each matcher stays in cache for the whole pass. The requests
+   * and results are reused by the next batch, a batch kept by the caller
+   * doesn't allocate once it has grown large enough. Like Request it must
+   * not be shared between threads.
+   */
+  class PageBatch {
+  public:
+    PageBatch();
+
+    /*!
+     * Starts a new batch
+     *
+     * \param doc_domain domain name of the document that loads the URLs
+     */
+    void reset(boost::string_ref doc_domain);
+
+    /*!
+     * Adds a request to the batch
+     *
+     * \param location URL to be tested, has to outlive the batch
+     * \param content_type content type of the URL
+     * \param third_party should be true if the URL is a third-party request
+     */
+    void add(boost::string_ref location, CONTENT_TYPE content_type,
+      bool third_party);
+
+    /**
+     * Number of requests in the batch
+     */
+    uint32_t size() const { return size_; }
+
+    const Request &get_request(uint32_t idx) const { return requests_[idx]; }
+
+    /**
+     * Matching filter of the request at index idx, null if none matched
+     * or the batch wasn't matched yet
+     */
+    const RegExpFilterPtr &get_result(uint32_t idx) const {
+      return results_[idx];
+    }
+
+    /**
+     * Uppercase version of the document domain
+     */
+    boost::string_ref get_doc_domain() const {
+      return document_.get_doc_domain();
+    }
+
+    /**
+     * Domain rules of an index for the document domain, resolved once
+     * per index and batch
+     */
+    const DomainMatches &get_domain_matches(const DomainIndex &index) const {
+      return document_.get_domain_matches(index);
+    }
+
+    /**
+     * Sets the result of the request at index idx
+     */
+    void set_result(uint32_t idx, const RegExpFilterPtr &result) {
+      results_[idx] = result;
+    }
+
+  private:
+    /**
+     * Document context, holds the resolved domain rules of the batch
+     */
+    Request document_;
+
+    std::vector<Request> requests_;
+    std::vector<RegExpFilterPtr> results_;
+    uint32_t size_;
+  };
+
+}
@@ -0,0 +1,282 @@
+#include "Pattern.h"
+
+
+namespace NS_ADBLOCK {
+
+  const uint8_t Pattern::separators_[256] = {
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 0, 1, 1, 1, 1, 1, 1, 1, 0, 0, 1,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1,
+    1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 0,
+    1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1,
+    1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+  };
+
+  namespace {
+
+    inline unsigned char fold(unsigned char ch) {
+      return (ch >= 'A' && ch <= 'Z') ? ch + ('a' - 'A') : ch;
+    }
+
+    inline bool is_word(unsigned char ch) {
+      return (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') ||
+        (ch >= '0' && ch <= '9') || ch == '_';
+    }
+
+    /**
+     * Matches one segment (no wildcards inside) exactly at position pos,
+     * the position after the match is stored in end
+     */
+    bool match_segment_at(boost::string_ref segment, boost::string_ref text,
+      size_t pos, bool match_case, size_t &end)
+    {
+      for (size_t idx = 0; idx < segment.size(); ++idx) {
+        unsigned char expected = segment[idx];
+        if (expected == '^') {
+          if (pos == text.size()) {
+            // Separator placeholder also matches the end of the address
+            continue;
+          }
+          if (!Pattern::is_separator(text[pos])) {
+            return false;
+          }
+        } else {
+          if (pos == text.size()) {
+            return false;
+          }
+          unsigned char ch = text[pos];
+          if ((match_case ? ch : fold(ch)) != expected) {
+            return false;
+          }
+        }
+        ++pos;
+      }
+      end = pos;
+      return true;
+    }
+
+    /**
+     * Finds the leftmost match of a segment starting at or after pos
+     */
+    bool search_segment(boost::string_ref segment, boost::string_ref text,
+      size_t pos, bool match_case, size_t &end)
+    {
+      if (segment.empty()) {
+        end = pos;
+        return true;
+      }
+
+      unsigned char first = segment[0];
+      for (; pos <= text.size(); ++pos) {
+        if (first != '^' && pos < text.size()) {
+          unsigned char ch = text[pos];
+          if ((match_case ? ch : fold(ch)) != first) {
+            continue;
+          }
+        }
+        if (match_segment_at(segment, text, pos, match_case, end)) {
+          return true;
+        }
+      }
+      return false;
+    }
+
+    /**
+     * Matches all segments of the body starting at position start. Taking
+     * the leftmost match of every segment is enough, since a wildcard can
+     * absorb anything between two segments.
+     */
+    bool match_body(boost::string_ref body, uint32_t flags,
+      boost::string_ref text, size_t start, bool anchored)
+    {
+      bool match_case = (flags & Pattern::MATCH_CASE) != 0;
+      size_t pos = start;
+      bool first = true;
+      while (true) {
+        size_t wildcard = body.find('*');
+        bool last = (wildcard == boost::string_ref::npos);
+        boost::string_ref segment = last ? body : body.substr(0, wildcard);
+
+        size_t end = 0;
+        if (last && (flags & Pattern::ANCHOR_END)) {
+          // The last segment never ends with a separator placeholder here
+          // so it has a fixed width and can only match at one position
+          if (segment.size() > text.size() - pos) {
+            return false;
+          }
+          size_t at = text.size() - segment.size();
+          if (first && anchored && at != pos) {
+            return false;
+          }
+          return match_segment_at(segment, text, at, match_case, end) &&
+            end == text.size();
+        }
+
+        if (first && anchored) {
+          if (!match_segment_at(segment, text, pos, match_case, end)) {
+            return false;
+          }
+        } else if (!search_segment(segment, text, pos, match_case, end)) {
+          return false;
+        }
+
+        if (last) {
+          return true;
+        }
+        pos = end;
+        body = body.substr(wildcard + 1);
+        first = false;
+      }
+    }
+
+  }
+
+  void Pattern::compile(const std::string &source, bool match_case) {
+    // Remove multiple wildcards
+    std::string text;
+    text.reserve(source.length());
+    for (auto iter = source.begin(); iter != source.end(); ++iter) {
+      if (*iter == '*' && text.length() > 0 && text[text.length() - 1] == '*') {
+        continue;
+      }
+      text += *iter;
+    }
+
+    // Remove leading and trailing wildcards
+    if (text.length() > 0 && text[0] == '*') {
+      text.erase(0, 1);
+    }
+    if (text.length() > 0 && text[text.length() - 1] == '*') {
+      text.erase(text.length() - 1);
+    }
+
+    // Remove anchors following separator placeholder
+    if (text.length() >= 2 && text.compare(text.length() - 2, 2, "^|") == 0) {
+      text.erase(text.length() - 1);
+    }
+
+    flags_ = match_case ? MATCH_CASE : 0;
+    size_t begin = 0;
+    size_t end = text.length();
+    if (text.compare(0, 2, "||") == 0) {
+      flags_ |= ANCHOR_HOST;
+      begin = 2;
+    } else if (text.length() > 0 && text[0] == '|') {
+      flags_ |= ANCHOR_START;
+      begin = 1;
+    }
+    if (end > begin && text[end - 1] == '|') {
+      flags_ |= ANCHOR_END;
+      --end;
+    }
+
+    body_ = text.substr(begin, end - begin);
+    if (!match_case) {
+      for (auto iter = body_.begin(); iter != body_.end(); ++iter) {
+        *iter = fold(*iter);
+      }
+    }
+  }
+
+  bool Pattern::matches(boost::string_ref location) const {
+    return matches(body_, flags_, location);
+  }
+
+  bool Pattern::matches(
+    boost::string_ref body,
+    uint32_t flags,
+    boost::string_ref location
+    )
+  {
+    if (flags & ANCHOR_START) {
+      return match_body(body, flags, location, 0, true);
+    }
+    if (!(flags & ANCHOR_HOST)) {
+      return match_body(body, flags, location, 0, false);
+    }
+
+    // Extended anchor, the protocol has to be followed by the host name
+    // or any of its sub-domains
+    size_t pos = skip_protocol(location);
+    if (pos == boost::string_ref::npos) {
+      return false;
+    }
+
+    while (true) {
+      if (match_body(body, flags, location, pos, true)) {
+        return true;
+      }
+
+      // Move on to the next label, labels can't be empty
+      size_t label = pos;
+      while (pos < location.size() && location[pos] != '.' &&
+        location[pos] != '/')
+      {
+        ++pos;
+      }
+      if (pos == label || pos == location.size() || location[pos] != '.') {
+        return false;
+      }
+      ++pos;
+    }
+  }
+
+  size_t Pattern::skip_protocol(boost::string_ref location) {
+    size_t pos = 0;
+    while (pos < location.size() &&
+      (is_word(location[pos]) || location[pos] == '-'))
+    {
+      ++pos;
+    }
+    if (pos == 0 || pos == location.size() || location[pos] != ':') {
+      return boost::string_ref::npos;
+    }
+    size_t slashes = ++pos;
+    while (pos < location.size() && location[pos] == '/') {
+      ++pos;
+    }
+    return pos == slashes ? boost::string_ref::npos : pos;
+  }
+
+  void Pattern::find_host_keys(boost::string_ref location, Spans &keys) {
+    keys.clear();
+    size_t pos = skip_protocol(location);
+    if (pos == boost::string_ref::npos) {
+      return;
+    }
+
+    // Same positions as tried by matches() for ANCHOR_HOST
+    while (true) {
+      size_t end = pos;
+      while (end < location.size() && !is_separator(location[end])) {
+        ++end;
+      }
+      Span key;
+      key.begin = static_cast<uint32_t>(pos);
+      key.length = static_cast<uint32_t>(end - pos);
+      keys.push_back(key);
+
+      size_t label = pos;
+      while (pos < location.size() && location[pos] != '.' &&
+        location[pos] != '/')
+      {
+        ++pos;
+      }
+      if (pos == label || pos == location.size() || location[pos] != '.') {
+        return;
+      }
+      ++pos;
+    }
+  }
+
+}
@@ -0,0 +1,130 @@
+/*!
+ * \file Pattern.h
+ *
+ * \author yorath
+ * \date October 21, 2013
+ *
+ * \details Native matcher for the plain (non-regular expression) filter
+ * syntax: literal segments, * wildcards, the ^ separator placeholder
+ * and the |, || anchors.
+ */
+
+#pragma once
+
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <boost/utility/string_ref.hpp>
+
+
+namespace NS_ADBLOCK {
+
+  /**
+   * Compiled form of a plain filter pattern.
+   *
+   * The body is kept as a normalized string where '*' separates the
+   * segments and '^' stands for the separator placeholder, so a pattern
+   * can be matched straight from its text without building a regex.
+   */
+  class Pattern {
+  public:
+    enum {
+      /**
+       * Pattern starts with | and has to match at the beginning of the URL
+       */
+      ANCHOR_START = 0x01,
+
+      /**
+       * Pattern starts with || and has to match at the beginning of the
+       * host name or at any of its sub-domains
+       */
+      ANCHOR_HOST = 0x02,
+
+      /**
+       * Pattern ends with | and has to match at the end of the URL
+       */
+      ANCHOR_END = 0x04,
+
+      /**
+       * Pattern is case sensitive, otherwise the body is stored lowercase
+       */
+      MATCH_CASE = 0x08
+    };
+
+    Pattern(): flags_(0) { }
+
+    /*!
+     * Compiles the pattern part of a filter
+     *
+     * \param source filter text without options and whitelist marker
+     * \param match_case true if the filter is case sensitive
+     */
+    void compile(const std::string &source, bool match_case);
+
+    /**
+     * Tests whether the URL matches this pattern
+     */
+    bool matches(boost::string_ref location) const;
+
+    /**
+     * Get the normalized body of the pattern
+     */
+    const std::string &get_body() const { return body_; }
+
+    /**
+     * Get the combination of ANCHOR_* and MATCH_CASE flags
+     */
+    uint32_t get_flags() const { return flags_; }
+
+    /*!
+     * Tests a URL against a pattern given by its normalized body and flags
+     *
+     * \param body normalized body as returned by get_body()
+     * \param flags flags as returned by get_flags()
+     * \param location URL to be tested
+     *
+     * \return true if match
+     */
+    static bool matches(boost::string_ref body, uint32_t flags,
+      boost::string_ref location);
+
+    /**
+     * Checks whether a character is matched by the ^ placeholder (all ANSI
+     * characters but alphanumeric characters and _%.-)
+     */
+    static bool is_separator(unsigned char ch) { return separators_[ch] != 0; }
+
+    struct Span {
+      uint32_t begin;
+      uint32_t length;
+    };
+
+    typedef std::vector<Span> Spans;
+
+    /*!
+     * Finds the host keys of a URL: at every position where a || anchor
+     * can match, the host name and each of its sub-domains, the run of
+     * characters up to the next separator. A pattern ||host^ whose host
+     * contains no separator matches exactly the URLs with host among
+     * their host keys.
+     *
+     * \param location lowercase URL
+     * \param keys receives the keys, as offsets into location
+     */
+    static void find_host_keys(boost::string_ref location, Spans &keys);
+
+  private:
+    /**
+     * Position after the protocol and its slashes, npos if the URL has no
+     * protocol
+     */
+    static size_t skip_protocol(boost::string_ref location);
+
+    std::string body_;
+    uint32_t flags_;
+
+    static const uint8_t separators_[256];
+  };
+
+}
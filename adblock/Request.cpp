@@ -0,0 +1,91 @@
+#include "Request.h"
+
+
+namespace NS_ADBLOCK {
+
+  Request::Request(): content_type_(TYPE_OTHER), third_party_(false) {
+    reset_domain_matches();
+  }
+
+  Request::Request(
+    boost::string_ref location,
+    CONTENT_TYPE content_type,
+    boost::string_ref doc_domain,
+    bool third_party
+    ): content_type_(content_type), third_party_(third_party)
+  {
+    reset_domain_matches();
+    set_location(location);
+    set_doc_domain(doc_domain);
+  }
+
+  Request::Request(
+    boost::string_ref location,
+    const std::string &content_type,
+    boost::string_ref doc_domain,
+    bool third_party
+    ): third_party_(third_party)
+  {
+    reset_domain_matches();
+    set_location(location);
+    set_content_type(content_type);
+    set_doc_domain(doc_domain);
+  }
+
+  void Request::set_location(boost::string_ref location) {
+    location_ = location;
+    lower_location_.resize(location.length());
+    tokens_.clear();
+
+    // Lowercase and split into [a-z0-9%]{3,} tokens in the same pass
+    if (location.length() > 0) {
+      Tokenizer::tokenize(location.data(), static_cast<uint32_t>(location.length()),
+        &lower_location_[0], tokens_);
+    }
+    Pattern::find_host_keys(lower_location_, host_keys_);
+  }
+
+  void Request::set_content_type(const std::string &content_type) {
+    content_type_ = RegExpFilter::get_content_type(content_type);
+  }
+
+  void Request::set_doc_domain(boost::string_ref doc_domain) {
+    doc_domain_.assign(doc_domain.begin(), doc_domain.end());
+    for (auto iter = doc_domain_.begin(); iter != doc_domain_.end(); ++iter) {
+      if (*iter >= 'a' && *iter <= 'z') {
+        *iter -= 'a' - 'A';
+      }
+    }
+    reset_domain_matches();
+  }
+
+  const DomainMatches &Request::get_domain_matches(
+    const DomainIndex &index
+    ) const
+  {
+    uint64_t stamp = index.get_stamp();
+    for (uint32_t idx = 0; idx < 2; ++idx) {
+      if (domain_stamps_[idx] == stamp) {
+        return domain_matches_[idx];
+      }
+    }
+
+    boost::string_ref doc_domain = doc_domain_;
+    while (doc_domain.length() > 0 && doc_domain.back() == '.') {
+      doc_domain.remove_suffix(1);
+    }
+
+    uint32_t slot = next_domain_slot_;
+    next_domain_slot_ = 1 - slot;
+    index.resolve(doc_domain, domain_matches_[slot]);
+    domain_stamps_[slot] = stamp;
+    return domain_matches_[slot];
+  }
+
+  void Request::reset_domain_matches() {
+    domain_stamps_[0] = 0;
+    domain_stamps_[1] = 0;
+    next_domain_slot_ = 0;
+  }
+
+}
@@ -0,0 +1,163 @@
+/*!
+ * \file Request.h
+ *
+ * \author yorath
+ * \date October 25, 2013
+ *
+ * \details Request context shared by all the filters tested against
+ * one URL.
+ */
+
+#pragma once
+
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <boost/utility/string_ref.hpp>
+#include "Filter.h"
+#include "DomainIndex.h"
+#include "Tokenizer.h"
+
+
+namespace NS_ADBLOCK {
+
+  /**
+   * Everything the matchers need to know about a request, computed once.
+   *
+   * The location is lowercased and split into keyword tokens when it is
+   * set, the document domain is uppercased. All buffers are owned by the
+   * object and reused, so a Request kept by the caller makes matching
+   * free of heap allocations once the buffers have grown large enough.
+   */
+  class Request {
+  public:
+    Request();
+
+    /*!
+     * \param location URL to be tested, has to outlive the request
+     * \param content_type content type of the URL
+     * \param doc_domain domain name of the document that loads the URL
+     * \param third_party should be true if the URL is a third-party request
+     */
+    Request(boost::string_ref location, CONTENT_TYPE content_type,
+      boost::string_ref doc_domain, bool third_party);
+
+    /**
+     * Same as above with a content type identifier like "SCRIPT"
+     */
+    Request(boost::string_ref location, const std::string &content_type,
+      boost::string_ref doc_domain, bool third_party);
+
+    /**
+     * Sets the URL to be tested, it has to outlive the request
+     */
+    void set_location(boost::string_ref location);
+
+    /**
+     * Sets the content type of the URL
+     */
+    void set_content_type(CONTENT_TYPE content_type) {
+      content_type_ = content_type;
+    }
+
+    /**
+     * Sets the content type of the URL from its identifier, unknown
+     * identifiers don't match any filter
+     */
+    void set_content_type(const std::string &content_type);
+
+    /**
+     * Sets the domain name of the document that loads the URL
+     */
+    void set_doc_domain(boost::string_ref doc_domain);
+
+    /**
+     * Sets whether the URL is a third-party request
+     */
+    void set_third_party(bool third_party) { third_party_ = third_party; }
+
+    boost::string_ref get_location() const { return location_; }
+
+    /**
+     * Lowercase version of the location
+     */
+    boost::string_ref get_lower_location() const { return lower_location_; }
+
+    CONTENT_TYPE get_content_type() const { return content_type_; }
+
+    /**
+     * Uppercase version of the document domain
+     */
+    boost::string_ref get_doc_domain() const { return doc_domain_; }
+
+    bool get_third_party() const { return third_party_; }
+
+    /**
+     * Number of keyword tokens ([a-z0-9%]{3,}) in the location
+     */
+    uint32_t get_token_count() const {
+      return static_cast<uint32_t>(tokens_.size());
+    }
+
+    /**
+     * Keyword token at index idx, points into the lowercase location
+     */
+    boost::string_ref get_token(uint32_t idx) const {
+      return boost::string_ref(lower_location_.data() + tokens_[idx].begin,
+        tokens_[idx].length);
+    }
+
+    /**
+     * Number of host keys of the location, see Pattern#find_host_keys
+     */
+    uint32_t get_host_key_count() const {
+      return static_cast<uint32_t>(host_keys_.size());
+    }
+
+    /**
+     * Host key at index idx, points into the lowercase location
+     */
+    boost::string_ref get_host_key(uint32_t idx) const {
+      return boost::string_ref(lower_location_.data() + host_keys_[idx].begin,
+        host_keys_[idx].length);
+    }
+
+    /**
+     * Tokenizer::hash() of the token at index idx
+     */
+    uint32_t get_token_hash(uint32_t idx) const {
+      return tokens_[idx].hash;
+    }
+
+    /**
+     * Domain rules of an index for the document domain without trailing
+     * dots. They are resolved on first use and kept until the document
+     * domain or the index changes, the last two indexes are remembered so
+     * the whitelist and blacklist of a CombindMatcher don't evict each
+     * other. Like the rest of the request it must not be shared between
+     * threads.
+     */
+    const DomainMatches &get_domain_matches(const DomainIndex &index) const;
+
+  private:
+    boost::string_ref location_;
+    std::string lower_location_;
+    Tokenizer::Tokens tokens_;
+    Pattern::Spans host_keys_;
+    CONTENT_TYPE content_type_;
+    std::string doc_domain_;
+    bool third_party_;
+
+    /**
+     * Resolved domain rules and the stamps of the indexes they were
+     * resolved from, 0 for none
+     */
+    mutable DomainMatches domain_matches_[2];
+    mutable uint64_t domain_stamps_[2];
+    mutable uint32_t next_domain_slot_;
+
+    void reset_domain_matches();
+  };
+
+}
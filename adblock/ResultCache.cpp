@@ -0,0 +1,149 @@
+#include "ResultCache.h"
+
+
+namespace NS_ADBLOCK {
+
+  namespace {
+
+    const uint64_t FnvOffsetBasis = 14695981039346656037ULL;
+    const uint64_t FnvPrime = 1099511628211ULL;
+
+    inline uint64_t fnv1a(uint64_t hash, const char *data, size_t length) {
+      for (size_t idx = 0; idx < length; ++idx) {
+        hash ^= static_cast<unsigned char>(data[idx]);
+        hash *= FnvPrime;
+      }
+      return hash;
+    }
+
+  }
+
+  ResultCache::ResultCache(uint32_t capacity): hits_(0), misses_(0),
+    evictions_(0)
+  {
+    set_capacity(capacity);
+  }
+
+  void ResultCache::set_capacity(uint32_t capacity) {
+    if (capacity == 0) {
+      entries_.clear();
+      hands_.clear();
+      set_mask_ = 0;
+      generation_ = 1;
+      return;
+    }
+
+    uint32_t sets = 1;
+    while (sets * Ways < capacity) {
+      sets <<= 1;
+    }
+
+    entries_.assign(sets * Ways, Entry());
+    hands_.assign(sets, 0);
+    set_mask_ = sets - 1;
+    generation_ = 1;
+  }
+
+  void ResultCache::clear() {
+    if (++generation_ == 0) {
+      // Generation wrapped around, old entries could become valid again
+      for (auto iter = entries_.begin(); iter != entries_.end(); ++iter) {
+        iter->generation = 0;
+      }
+      generation_ = 1;
+    }
+  }
+
+  uint64_t ResultCache::hash(const Request &request) {
+    boost::string_ref location = request.get_location();
+    boost::string_ref doc_domain = request.get_doc_domain();
+    uint32_t content_type = request.get_content_type();
+    char third_party = request.get_third_party() ? 1 : 0;
+
+    uint64_t hash = FnvOffsetBasis;
+    hash = fnv1a(hash, location.data(), location.size());
+    hash = fnv1a(hash, &third_party, 1);
+    hash = fnv1a(hash, reinterpret_cast<const char *>(&content_type),
+      sizeof(content_type));
+    hash = fnv1a(hash, doc_domain.data(), doc_domain.size());
+    return hash;
+  }
+
+  bool ResultCache::is_same_request(
+    const Entry &entry,
+    uint64_t hash,
+    const Request &request
+    ) const
+  {
+    return entry.generation == generation_ && entry.hash == hash &&
+      entry.content_type == static_cast<uint32_t>(request.get_content_type()) &&
+      entry.third_party == request.get_third_party() &&
+      request.get_location() == entry.location &&
+      request.get_doc_domain() == entry.doc_domain;
+  }
+
+  bool ResultCache::find(const Request &request, RegExpFilterPtr &result) {
+    if (entries_.empty()) {
+      return false;
+    }
+    uint64_t request_hash = hash(request);
+    Entry *set = &entries_[((request_hash ^ (request_hash >> 32)) & set_mask_) * Ways];
+    for (uint32_t way = 0; way < Ways; ++way) {
+      if (is_same_request(set[way], request_hash, request)) {
+        set[way].referenced = true;
+        result = set[way].result;
+        ++hits_;
+        return true;
+      }
+    }
+    ++misses_;
+    return false;
+  }
+
+  void ResultCache::insert(
+    const Request &request,
+    const RegExpFilterPtr &result
+    )
+  {
+    if (entries_.empty()) {
+      return;
+    }
+    uint64_t request_hash = hash(request);
+    uint32_t set_idx = static_cast<uint32_t>((request_hash ^ (request_hash >> 32)) & set_mask_);
+    Entry *set = &entries_[set_idx * Ways];
+
+    Entry *target = nullptr;
+    for (uint32_t way = 0; way < Ways && target == nullptr; ++way) {
+      if (set[way].generation != generation_ ||
+        is_same_request(set[way], request_hash, request))
+      {
+        target = &set[way];
+      }
+    }
+
+    if (target == nullptr) {
+      // Second chance: skip and clear referenced entries until the hand
+      // finds one that hasn't been hit since its last pass
+      uint8_t &hand = hands_[set_idx];
+      while (set[hand].referenced) {
+        set[hand].referenced = false;
+        hand = (hand + 1) % Ways;
+      }
+      target = &set[hand];
+      hand = (hand + 1) % Ways;
+      ++evictions_;
+    }
+
+    boost::string_ref location = request.get_location();
+    boost::string_ref doc_domain = request.get_doc_domain();
+    target->hash = request_hash;
+    target->generation = generation_;
+    target->referenced = false;
+    target->location.assign(location.begin(), location.end());
+    target->doc_domain.assign(doc_domain.begin(), doc_domain.end());
+    target->content_type = request.get_content_type();
+    target->third_party = request.get_third_party();
+    target->result = result;
+  }
+
+}
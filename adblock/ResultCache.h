@@ -0,0 +1,159 @@
+/*!
+ * \file ResultCache.h
+ *
+ * \author yorath
+ * \date October 28, 2013
+ *
+ * \details Fixed-capacity cache of matching results.
+ */
+
+#pragma once
+
+
+#include "Filter.h"
+#include "Request.h"
+
+
+namespace NS_ADBLOCK {
+
+  /**
+   * Cache of CombindMatcher results keyed by the request tuple
+   * (location, content type, document domain, third-party).
+   *
+   * Entries are found through a 64-bit hash of the tuple and organized in
+   * sets of Ways entries. A full set evicts with the CLOCK (second chance)
+   * policy, so the cache never has to be wiped when it runs full. The
+   * stored tuple is compared on every hit to rule out hash collisions.
+   * All storage is allocated up front, strings in the entries keep their
+   * capacity when they are overwritten.
+   */
+  class ResultCache {
+  public:
+    explicit ResultCache(uint32_t capacity = DefaultCapacity);
+
+    /**
+     * Resizes the cache, rounded up to a power of two, drops all entries.
+     * A capacity of 0 disables the cache: nothing is stored or counted.
+     */
+    void set_capacity(uint32_t capacity);
+
+    uint32_t get_capacity() const {
+      return static_cast<uint32_t>(entries_.size());
+    }
+
+    /**
+     * Drops all entries
+     */
+    void clear();
+
+    /*!
+     * Drops the entries for which pred(request, result) is true
+     *
+     * \param pred called with the cached request and its result
+     *
+     * \return number of dropped entries
+     */
+    template <typename Predicate>
+    uint32_t invalidate_if(Predicate pred);
+
+    /*!
+     * Looks up the cached result of a request
+     *
+     * \param request request to look up
+     * \param result receives the cached result, can be null
+     *
+     * \return true if the request is cached
+     */
+    bool find(const Request &request, RegExpFilterPtr &result);
+
+    /**
+     * Stores the result of a request, evicting an entry if needed
+     */
+    void insert(const Request &request, const RegExpFilterPtr &result);
+
+    uint64_t get_hits() const { return hits_; }
+    uint64_t get_misses() const { return misses_; }
+    uint64_t get_evictions() const { return evictions_; }
+
+    /**
+     * 64-bit FNV-1a hash of the request tuple
+     */
+    static uint64_t hash(const Request &request);
+
+    static const uint32_t DefaultCapacity = 1024;
+
+    /**
+     * Number of entries in a set
+     */
+    static const uint32_t Ways = 4;
+
+  private:
+    struct Entry {
+      Entry(): hash(0), generation(0), referenced(false),
+        content_type(0), third_party(false) { }
+
+      uint64_t hash;
+
+      /**
+       * Entry is valid only if it equals generation_
+       */
+      uint32_t generation;
+
+      /**
+       * CLOCK reference bit, set on every hit
+       */
+      bool referenced;
+
+      std::string location;
+      std::string doc_domain;
+      uint32_t content_type;
+      bool third_party;
+      RegExpFilterPtr result;
+    };
+
+    bool is_same_request(const Entry &entry, uint64_t hash,
+      const Request &request) const;
+
+    std::vector<Entry> entries_;
+
+    /**
+     * CLOCK hand of every set
+     */
+    std::vector<uint8_t> hands_;
+
+    uint32_t set_mask_;
+
+    /**
+     * Incremented by clear(), invalidates all entries at once
+     */
+    uint32_t generation_;
+
+    uint64_t hits_;
+    uint64_t misses_;
+    uint64_t evictions_;
+  };
+
+  template <typename Predicate>
+  uint32_t ResultCache::invalidate_if(Predicate pred) {
+    uint32_t result = 0;
+    Request request;
+    for (auto iter = entries_.begin(); iter != entries_.end(); ++iter) {
+      if (iter->generation != generation_) {
+        continue;
+      }
+      request.set_location(iter->location);
+      request.set_content_type(static_cast<CONTENT_TYPE>(iter->content_type));
+      request.set_doc_domain(iter->doc_domain);
+      request.set_third_party(iter->third_party);
+      if (pred(static_cast<const Request &>(request),
+        static_cast<const RegExpFilterPtr &>(iter->result)))
+      {
+        iter->generation = 0;
+        iter->result = nullptr;
+        ++result;
+      }
+    }
+    return result;
+  }
+
+}
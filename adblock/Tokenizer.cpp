@@ -0,0 +1,289 @@
+#include "Tokenizer.h"
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define ADBLOCK_TOKENIZER_SSE2
+#include <emmintrin.h>
+// AVX2 intrinsics need VS2012 or a GCC/Clang target attribute
+#if defined(__GNUC__) || (defined(_MSC_VER) && _MSC_VER >= 1700)
+#define ADBLOCK_TOKENIZER_AVX2
+#include <immintrin.h>
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#ifdef __GNUC__
+#define ADBLOCK_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define ADBLOCK_TARGET_AVX2
+#endif
+
+
+namespace NS_ADBLOCK {
+
+  namespace {
+
+    /**
+     * Token being read when a block ends
+     */
+    struct State {
+      uint32_t begin;
+      bool in_token;
+    };
+
+    inline bool is_token_char(char ch) {
+      return (ch >= 'a' && ch <= 'z') || (ch >= '0' && ch <= '9') || ch == '%';
+    }
+
+    inline uint32_t lowest_bit(uint32_t mask) {
+#ifdef _MSC_VER
+      unsigned long idx;
+      _BitScanForward(&idx, mask);
+      return idx;
+#else
+      return __builtin_ctz(mask);
+#endif
+    }
+
+    /**
+     * The lowercase bytes of the token are already stored in dst
+     */
+    inline void end_token(uint32_t end, const char *dst, State &state,
+      Tokenizer::Tokens &tokens)
+    {
+      if (end - state.begin >= 3) {
+        Tokenizer::Token token;
+        token.begin = state.begin;
+        token.length = end - state.begin;
+        token.hash = Tokenizer::hash(dst + state.begin, dst + end);
+        tokens.push_back(token);
+      }
+      state.in_token = false;
+    }
+
+    /**
+     * Turns the class mask of a block (bit i set if the byte at offset + i
+     * is a token character) into tokens. Every bit that differs from the
+     * bit before it starts or ends a token.
+     */
+    inline void scan_mask(uint32_t mask, uint32_t offset, uint32_t width_mask,
+      const char *dst, State &state, Tokenizer::Tokens &tokens)
+    {
+      uint32_t boundaries = (mask ^ ((mask << 1) | (state.in_token ? 1 : 0))) & width_mask;
+      while (boundaries != 0) {
+        uint32_t idx = lowest_bit(boundaries);
+        boundaries &= boundaries - 1;
+        if (state.in_token) {
+          end_token(offset + idx, dst, state, tokens);
+        } else {
+          state.begin = offset + idx;
+          state.in_token = true;
+        }
+      }
+    }
+
+    void tokenize_scalar(const char *src, uint32_t begin, uint32_t length,
+      char *dst, State &state, Tokenizer::Tokens &tokens)
+    {
+      for (uint32_t idx = begin; idx < length; ++idx) {
+        char ch = src[idx];
+        if (ch >= 'A' && ch <= 'Z') {
+          ch += 'a' - 'A';
+        }
+        dst[idx] = ch;
+
+        if (is_token_char(ch)) {
+          if (!state.in_token) {
+            state.begin = idx;
+            state.in_token = true;
+          }
+        } else if (state.in_token) {
+          end_token(idx, dst, state, tokens);
+        }
+      }
+    }
+
+#ifdef ADBLOCK_TOKENIZER_SSE2
+    uint32_t tokenize_sse2(const char *src, uint32_t length, char *dst,
+      State &state, Tokenizer::Tokens &tokens)
+    {
+      // Signed comparisons, bytes >= 0x80 are below every bound
+      const __m128i upper_low = _mm_set1_epi8('A' - 1);
+      const __m128i upper_high = _mm_set1_epi8('Z' + 1);
+      const __m128i lower_low = _mm_set1_epi8('a' - 1);
+      const __m128i lower_high = _mm_set1_epi8('z' + 1);
+      const __m128i digit_low = _mm_set1_epi8('0' - 1);
+      const __m128i digit_high = _mm_set1_epi8('9' + 1);
+      const __m128i percent = _mm_set1_epi8('%');
+      const __m128i case_bit = _mm_set1_epi8(0x20);
+
+      uint32_t idx = 0;
+      for (; idx + 16 <= length; idx += 16) {
+        __m128i chars = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + idx));
+        __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(chars, upper_low),
+          _mm_cmpgt_epi8(upper_high, chars));
+        chars = _mm_or_si128(chars, _mm_and_si128(upper, case_bit));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + idx), chars);
+
+        __m128i lower = _mm_and_si128(_mm_cmpgt_epi8(chars, lower_low),
+          _mm_cmpgt_epi8(lower_high, chars));
+        __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(chars, digit_low),
+          _mm_cmpgt_epi8(digit_high, chars));
+        __m128i token = _mm_or_si128(_mm_or_si128(lower, digit),
+          _mm_cmpeq_epi8(chars, percent));
+        scan_mask(static_cast<uint32_t>(_mm_movemask_epi8(token)), idx, 0xFFFF,
+          dst, state, tokens);
+      }
+      return idx;
+    }
+#endif
+
+#ifdef ADBLOCK_TOKENIZER_AVX2
+    ADBLOCK_TARGET_AVX2
+    uint32_t tokenize_avx2(const char *src, uint32_t length, char *dst,
+      State &state, Tokenizer::Tokens &tokens)
+    {
+      const __m256i upper_low = _mm256_set1_epi8('A' - 1);
+      const __m256i upper_high = _mm256_set1_epi8('Z' + 1);
+      const __m256i lower_low = _mm256_set1_epi8('a' - 1);
+      const __m256i lower_high = _mm256_set1_epi8('z' + 1);
+      const __m256i digit_low = _mm256_set1_epi8('0' - 1);
+      const __m256i digit_high = _mm256_set1_epi8('9' + 1);
+      const __m256i percent = _mm256_set1_epi8('%');
+      const __m256i case_bit = _mm256_set1_epi8(0x20);
+
+      uint32_t idx = 0;
+      for (; idx + 32 <= length; idx += 32) {
+        __m256i chars = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + idx));
+        __m256i upper = _mm256_and_si256(_mm256_cmpgt_epi8(chars, upper_low),
+          _mm256_cmpgt_epi8(upper_high, chars));
+        chars = _mm256_or_si256(chars, _mm256_and_si256(upper, case_bit));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + idx), chars);
+
+        __m256i lower = _mm256_and_si256(_mm256_cmpgt_epi8(chars, lower_low),
+          _mm256_cmpgt_epi8(lower_high, chars));
+        __m256i digit = _mm256_and_si256(_mm256_cmpgt_epi8(chars, digit_low),
+          _mm256_cmpgt_epi8(digit_high, chars));
+        __m256i token = _mm256_or_si256(_mm256_or_si256(lower, digit),
+          _mm256_cmpeq_epi8(chars, percent));
+        scan_mask(static_cast<uint32_t>(_mm256_movemask_epi8(token)), idx, 0xFFFFFFFF,
+          dst, state, tokens);
+      }
+      return idx;
+    }
+#endif
+
+    bool cpu_has_sse2() {
+#if !defined(ADBLOCK_TOKENIZER_SSE2)
+      return false;
+#elif defined(_M_X64) || defined(__x86_64__)
+      return true;
+#elif defined(_MSC_VER)
+      int info[4];
+      __cpuid(info, 1);
+      return (info[3] & (1 << 26)) != 0;
+#else
+      return __builtin_cpu_supports("sse2") != 0;
+#endif
+    }
+
+    bool cpu_has_avx2() {
+#if !defined(ADBLOCK_TOKENIZER_AVX2)
+      return false;
+#elif defined(_MSC_VER)
+      int info[4];
+      __cpuid(info, 0);
+      if (info[0] < 7) {
+        return false;
+      }
+      // The OS has to save the YMM registers too
+      __cpuid(info, 1);
+      const int osxsave_avx = (1 << 27) | (1 << 28);
+      if ((info[2] & osxsave_avx) != osxsave_avx || (_xgetbv(0) & 6) != 6) {
+        return false;
+      }
+      __cpuidex(info, 7, 0);
+      return (info[1] & (1 << 5)) != 0;
+#else
+      return __builtin_cpu_supports("avx2") != 0;
+#endif
+    }
+
+    Tokenizer::KERNEL best_kernel() {
+      if (cpu_has_sse2()) {
+        return Tokenizer::KERNEL_SSE2;
+      }
+      return Tokenizer::KERNEL_SCALAR;
+    }
+
+    // Zero initialized before they are set, anything tokenized during
+    // static initialization uses the scalar kernel
+    const Tokenizer::KERNEL default_kernel = best_kernel();
+    const bool use_avx2 = cpu_has_avx2();
+
+  }
+
+  void Tokenizer::tokenize(
+    const char *src,
+    uint32_t length,
+    char *dst,
+    Tokens &tokens
+    )
+  {
+    tokenize(get_kernel(length), src, length, dst, tokens);
+  }
+
+  void Tokenizer::tokenize(
+    KERNEL kernel,
+    const char *src,
+    uint32_t length,
+    char *dst,
+    Tokens &tokens
+    )
+  {
+    State state;
+    state.begin = 0;
+    state.in_token = false;
+
+    uint32_t done = 0;
+    switch (kernel) {
+#ifdef ADBLOCK_TOKENIZER_AVX2
+    case KERNEL_AVX2:
+      done = tokenize_avx2(src, length, dst, state, tokens);
+      break;
+#endif
+#ifdef ADBLOCK_TOKENIZER_SSE2
+    case KERNEL_SSE2:
+      done = tokenize_sse2(src, length, dst, state, tokens);
+      break;
+#endif
+    default:
+      break;
+    }
+
+    tokenize_scalar(src, done, length, dst, state, tokens);
+    if (state.in_token) {
+      end_token(length, dst, state, tokens);
+    }
+  }
+
+  bool Tokenizer::is_supported(KERNEL kernel) {
+    switch (kernel) {
+    case KERNEL_AVX2:
+      return cpu_has_avx2();
+    case KERNEL_SSE2:
+      return cpu_has_sse2();
+    default:
+      return true;
+    }
+  }
+
+  Tokenizer::KERNEL Tokenizer::get_kernel(uint32_t length) {
+    if (use_avx2 && length >= Avx2MinLength) {
+      return KERNEL_AVX2;
+    }
+    return default_kernel;
+  }
+
+}
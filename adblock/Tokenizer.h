@@ -0,0 +1,99 @@
+/*!
+ * \file Tokenizer.h
+ *
+ * \author yorath
+ * \date November 5, 2013
+ *
+ * \details Lowercasing and keyword tokenization of URLs, with SSE2 and
+ * AVX2 kernels chosen at runtime.
+ */
+
+#pragma once
+
+
+#include <cstdint>
+#include <vector>
+
+
+namespace NS_ADBLOCK {
+
+  /**
+   * Splits a URL into the [a-z0-9%]{3,} tokens used as filter keywords and
+   * lowercases it in the same pass.
+   *
+   * The vector kernels lowercase and classify 16 (SSE2) or 32 (AVX2)
+   * bytes at a time and turn the class mask into token boundaries with
+   * bit scans. All kernels give identical results. SSE2 is used when the
+   * processor supports it: on URL-length inputs the wider AVX2 kernel
+   * loses more to its setup and partial blocks than it gains, so it is
+   * only used for inputs of at least Avx2MinLength bytes.
+   * Every token is hashed when it ends, while its bytes are still in the
+   * L1 cache.
+   */
+  class Tokenizer {
+  public:
+    struct Token {
+      uint32_t begin;
+      uint32_t length;
+
+      /**
+       * hash() of the lowercase token
+       */
+      uint32_t hash;
+    };
+
+    typedef std::vector<Token> Tokens;
+
+    enum KERNEL {
+      KERNEL_SCALAR,
+      KERNEL_SSE2,
+      KERNEL_AVX2
+    };
+
+    /*!
+     * Lowercases a URL and appends its tokens
+     *
+     * \param src URL to be tokenized
+     * \param length length of the URL
+     * \param dst receives the lowercase URL, length bytes
+     * \param tokens receives the tokens, as offsets into dst
+     */
+    static void tokenize(const char *src, uint32_t length, char *dst,
+      Tokens &tokens);
+
+    /**
+     * Same as above with a particular kernel, used by the tests and
+     * benchmarks. The kernel has to be supported.
+     */
+    static void tokenize(KERNEL kernel, const char *src, uint32_t length,
+      char *dst, Tokens &tokens);
+
+    /**
+     * Hash of a keyword or token, FNV-1a with a final mix so that all bits
+     * can be used by KeywordPrefilter
+     */
+    static uint32_t hash(const char *begin, const char *end) {
+      uint32_t result = 2166136261u;
+      for (const char *pos = begin; pos != end; ++pos) {
+        result = (result ^ static_cast<unsigned char>(*pos)) * 16777619u;
+      }
+      result ^= result >> 16;
+      result *= 0x85EBCA6Bu;
+      result ^= result >> 13;
+      return result;
+    }
+
+    /**
+     * Checks whether the processor and the build support a kernel
+     */
+    static bool is_supported(KERNEL kernel);
+
+    /**
+     * Kernel used by tokenize() for an input of the given length
+     */
+    static KERNEL get_kernel(uint32_t length = 0);
+
+    static const uint32_t Avx2MinLength = 256;
+  };
+
+}
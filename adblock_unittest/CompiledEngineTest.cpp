@@ -0,0 +1,238 @@
+#include "../adblock/CompiledEngine.h"
+#include "TestUtil.h"
+
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <algorithm>
+#include <gtest/gtest.h>
+
+using namespace NS_ADBLOCK;
+
+
+namespace {
+
+  const char *CompiledPath = "compiled_engine_test.bin";
+
+  std::vector<std::string> sample_lines() {
+    const char *lines[] = {
+      "||ads.example.com^", "/banner/*.gif", "-ad-$domain=example.com|~sub.example.com",
+      "@@||ads.example.com/allowed^", "&ad=$script,third-party", "^track^",
+      "/\\/pop[0-9]+\\.js/$script", "@@$document,sitekey=abcdef", "|http://first.$~third-party",
+      "##.ad", "example.com##.banner", "example.com#@#.ad", "~news.com,com##.text-ad",
+      "! comment", "||ads.example.com^",
+      // Host table filters checked before keyword filters listed first
+      "/tracker.", "|http://tracker.net/", "://tracker.net/x", "||tracker.net^$domain=news.com",
+      "||tracker.net^"
+    };
+    return std::vector<std::string>(lines, lines + sizeof(lines) / sizeof(lines[0]));
+  }
+
+  std::vector<std::string> sample_urls() {
+    std::vector<std::string> urls = test_util::load_urls();
+    const char *extra[] = {
+      "http://ads.example.com/x.js", "http://ads.example.com/allowed/x.js",
+      "http://cdn.com/banner/x.gif", "http://cdn.com/x-ad-y.js",
+      "http://cdn.com/?q=1&ad=2", "http://cdn.com/a/track/b",
+      "http://cdn.com/POP12.js", "http://first.com/x.js",
+      "http://tracker.net/x.js", "http://cdn.tracker.net/y.js"
+    };
+    urls.insert(urls.end(), extra, extra + sizeof(extra) / sizeof(extra[0]));
+    return urls;
+  }
+
+  /**
+   * Text of the filter the compiled engine matched, empty for no match
+   */
+  std::string matched_text(const CompiledEngine &engine, const Request &request) {
+    uint32_t idx = engine.matches_any(request);
+    return idx == CompiledEngine::NoFilter ? "" : engine.get_filter_text(idx).to_string();
+  }
+
+  std::vector<std::string> sorted(std::vector<std::string> selectors) {
+    std::sort(selectors.begin(), selectors.end());
+    return selectors;
+  }
+
+}
+
+TEST(CompiledEngineTest, SameAsEngine) {
+  EnginePtr engine = Engine::from_lines(sample_lines());
+  ASSERT_TRUE(CompiledEngine::write(*engine, CompiledPath));
+  CompiledEnginePtr compiled = CompiledEngine::load(CompiledPath);
+  ASSERT_TRUE(compiled != nullptr);
+  EXPECT_EQ(18u, compiled->get_filter_count());
+
+  Request host_request("http://tracker.net/x.js", TYPE_SCRIPT, "other.com", true);
+  EXPECT_EQ("||tracker.net^", engine->matches_any(host_request)->get_text());
+  EXPECT_EQ("||tracker.net^", matched_text(*compiled, host_request));
+  host_request.set_doc_domain("news.com");
+  EXPECT_EQ("||tracker.net^$domain=news.com", engine->matches_any(host_request)->get_text());
+  EXPECT_EQ("||tracker.net^$domain=news.com", matched_text(*compiled, host_request));
+
+  std::vector<std::string> urls = sample_urls();
+  const char *domains[] = { "www.example.com", "sub.example.com", "news.com", "" };
+  for (uint32_t didx = 0; didx < sizeof(domains) / sizeof(domains[0]); ++didx) {
+    for (uint32_t third_party = 0; third_party < 2; ++third_party) {
+      for (auto url = urls.begin(); url != urls.end(); ++url) {
+        Request request(*url, TYPE_SCRIPT, domains[didx], third_party != 0);
+        RegExpFilterPtr expected = engine->matches_any(request);
+        EXPECT_EQ(expected == nullptr ? "" : expected->get_text(),
+          matched_text(*compiled, request)) << *url << " " << domains[didx];
+      }
+    }
+
+    EXPECT_EQ(sorted(engine->get_selectors(domains[didx], false)),
+      sorted(compiled->get_selectors(domains[didx], false))) << domains[didx];
+    EXPECT_EQ(sorted(engine->get_selectors(domains[didx], true)),
+      sorted(compiled->get_selectors(domains[didx], true))) << domains[didx];
+  }
+
+  uint32_t key_match = compiled->matches_by_key("http://example.com/", "abcdef", "example.com");
+  ASSERT_TRUE(key_match != CompiledEngine::NoFilter);
+  EXPECT_EQ("@@$document,sitekey=abcdef", compiled->get_filter_text(key_match).to_string());
+  EXPECT_TRUE(compiled->is_whitelist(key_match));
+  EXPECT_TRUE(compiled->matches_by_key("http://example.com/", "other",
+    "example.com") == CompiledEngine::NoFilter);
+
+  compiled.reset();
+  std::remove(CompiledPath);
+}
+
+TEST(CompiledEngineTest, RejectsBadFiles) {
+  EXPECT_TRUE(CompiledEngine::load("missing_compiled_engine.bin") == nullptr);
+
+  EnginePtr engine = Engine::from_lines(sample_lines());
+  ASSERT_TRUE(CompiledEngine::write(*engine, CompiledPath));
+  std::vector<char> data;
+  {
+    std::ifstream file(CompiledPath, std::ios::binary);
+    data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+  }
+
+  // Truncated file
+  {
+    std::ofstream file(CompiledPath, std::ios::binary | std::ios::trunc);
+    file.write(&data[0], data.size() / 2);
+  }
+  EXPECT_TRUE(CompiledEngine::load(CompiledPath) == nullptr);
+
+  // Other version
+  data[4] ^= 0x7F;
+  {
+    std::ofstream file(CompiledPath, std::ios::binary | std::ios::trunc);
+    file.write(&data[0], data.size());
+  }
+  EXPECT_TRUE(CompiledEngine::load(CompiledPath) == nullptr);
+  std::remove(CompiledPath);
+}
+
+TEST(CompiledEngineTest, RejectsBadRecords) {
+  EnginePtr engine = Engine::from_lines(sample_lines());
+  ASSERT_TRUE(CompiledEngine::write(*engine, CompiledPath));
+  std::vector<char> data;
+  {
+    std::ifstream file(CompiledPath, std::ios::binary);
+    data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+  }
+
+  auto read = [&data](size_t offset) {
+    uint32_t value;
+    std::memcpy(&value, &data[offset], sizeof(value));
+    return value;
+  };
+  // Loads the file with one 32-bit word replaced
+  auto load_with = [&data](size_t offset, uint32_t value) {
+    std::vector<char> copy = data;
+    std::memcpy(&copy[offset], &value, sizeof(value));
+    {
+      std::ofstream file(CompiledPath, std::ios::binary | std::ios::trunc);
+      file.write(&copy[0], copy.size());
+    }
+    return CompiledEngine::load(CompiledPath);
+  };
+
+  // Offsets in the header: filters at 16, indexes at 32, the blacklist
+  // slots at 84 and its generic bucket at 92
+  EXPECT_TRUE(load_with(0, read(0)) != nullptr);
+  // String past the string pool
+  EXPECT_TRUE(load_with(read(16), 0x7FFFFFFF) == nullptr);
+  // Filter index past the filters
+  EXPECT_TRUE(load_with(read(32), read(20)) == nullptr);
+  // Empty and non power of two slot tables
+  EXPECT_TRUE(load_with(88, 0) == nullptr);
+  EXPECT_TRUE(load_with(88, read(88) - 1) == nullptr);
+  // Bucket past the buckets
+  EXPECT_TRUE(load_with(92, 1000) == nullptr);
+  EXPECT_TRUE(load_with(read(84), 1000) == nullptr);
+  std::remove(CompiledPath);
+}
+
+TEST(CompiledEngineTest, Benchmark) {
+  std::vector<std::string> lines = test_util::read_lines("easylist.txt");
+  if (lines.size() == 0) {
+    std::cout << "easylist.txt not found, skipping benchmark" << std::endl;
+    return;
+  }
+  std::vector<std::string> urls = test_util::load_urls();
+
+  // The engine used to write the file is kept alive, so memory it would
+  // free can't hide the growth of the text loading below
+  EnginePtr writer = Engine::from_lines(lines);
+  ASSERT_TRUE(CompiledEngine::write(*writer, CompiledPath));
+  Filter::known_filters_.clear();
+
+  // Mapped file first, the pages it touches are all it adds to the RSS
+  uint64_t rss_before = test_util::resident_bytes();
+  test_util::Timer compiled_timer;
+  CompiledEnginePtr compiled = CompiledEngine::load(CompiledPath);
+  ASSERT_TRUE(compiled != nullptr);
+  double compiled_load_us = compiled_timer.elapsed_us();
+  uint64_t compiled_rss = test_util::resident_bytes() - rss_before;
+
+  Request request;
+  request.set_content_type(TYPE_SCRIPT);
+  request.set_doc_domain("www.example.com");
+  request.set_third_party(true);
+  std::vector<uint32_t> compiled_results;
+  compiled_results.reserve(urls.size());
+  test_util::Timer compiled_match_timer;
+  for (auto url = urls.begin(); url != urls.end(); ++url) {
+    request.set_location(*url);
+    compiled_results.push_back(compiled->matches_any(request));
+  }
+  double compiled_match_us = compiled_match_timer.elapsed_us();
+  uint64_t compiled_touched_rss = test_util::resident_bytes() - rss_before;
+
+  rss_before = test_util::resident_bytes();
+  test_util::Timer text_timer;
+  EnginePtr engine = Engine::from_lines(test_util::read_lines("easylist.txt"));
+  double text_load_us = text_timer.elapsed_us();
+  uint64_t text_rss = test_util::resident_bytes() - rss_before;
+
+  uint32_t mismatches = 0;
+  test_util::Timer text_match_timer;
+  for (uint32_t idx = 0; idx < urls.size(); ++idx) {
+    request.set_location(urls[idx]);
+    RegExpFilterPtr expected = engine->matches_any(request);
+    uint32_t result = compiled_results[idx];
+    std::string text = result == CompiledEngine::NoFilter ? "" :
+      compiled->get_filter_text(result).to_string();
+    mismatches += (expected == nullptr ? "" : expected->get_text()) != text ? 1 : 0;
+  }
+  double text_match_us = text_match_timer.elapsed_us();
+  EXPECT_EQ(0u, mismatches);
+
+  std::cout << std::dec << engine->get_filter_count() << " filters, "
+    << urls.size() << " urls" << std::endl
+    << "text load:     " << text_load_us / 1000 << " ms, RSS +"
+    << text_rss / 1024 << " KB" << std::endl
+    << "compiled load: " << compiled_load_us / 1000 << " ms, RSS +"
+    << compiled_rss / 1024 << " KB (+" << compiled_touched_rss / 1024
+    << " KB after matching)" << std::endl
+    << "matching:      " << text_match_us / urls.size() << " us/url engine, "
+    << compiled_match_us / urls.size() << " us/url compiled" << std::endl;
+
+  compiled.reset();
+  std::remove(CompiledPath);
+}
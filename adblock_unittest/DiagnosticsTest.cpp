@@ -0,0 +1,94 @@
+#include "../adblock/Diagnostics.h"
+#include "../adblock/ListParser.h"
+#include "../adblock/Engine.h"
+#include "../adblock/ListUpdate.h"
+
+#include <gtest/gtest.h>
+
+using namespace NS_ADBLOCK;
+
+
+TEST(DiagnosticsTest, CountsByReason) {
+  DiagnosticsCollectorPtr diagnostics(new DiagnosticsCollector());
+  Filter::known_filters_.clear();
+  Filter::set_diagnostics(diagnostics);
+
+  std::string buffer = "||ads.example.com^$script,no-such-option\n"
+    "example.com#div(foo)(bar)\n"
+    "example.com#div(title=ad)\n"
+    "/ad[/\n"
+    "||ads.example.com^$script,no-such-option\n"
+    "||valid.example.com^\n"
+    "##.valid\n";
+  std::vector<FilterPtr> filters = ListParser::parse(buffer, 2);
+  Filter::set_diagnostics(nullptr);
+  ASSERT_EQ(7u, filters.size());
+
+  // The repeated line is the same filter and only reported once
+  EXPECT_EQ(1u, diagnostics->get_count(INVALID_UNKNOWN_OPTION));
+  EXPECT_EQ(1u, diagnostics->get_count(INVALID_DUPLICATE_ID));
+  EXPECT_EQ(1u, diagnostics->get_count(INVALID_NO_CRITERIA));
+  EXPECT_EQ(1u, diagnostics->get_count(INVALID_REGEX_SYNTAX));
+  EXPECT_EQ(4u, diagnostics->get_total());
+  EXPECT_EQ(4u, diagnostics->get_samples().size());
+
+  auto invalid = boost::dynamic_pointer_cast<InvalidFilter>(filters[0]);
+  ASSERT_TRUE(invalid != nullptr);
+  EXPECT_EQ(INVALID_UNKNOWN_OPTION, invalid->get_reason());
+  EXPECT_EQ("Unknown optionno_such_option", invalid->get_message());
+
+  // Nothing is reported without diagnostics
+  Filter::known_filters_.clear();
+  ListParser::parse(buffer, 2);
+  EXPECT_EQ(4u, diagnostics->get_total());
+}
+
+TEST(DiagnosticsTest, ReportsEveryLoad) {
+  DiagnosticsCollectorPtr diagnostics(new DiagnosticsCollector());
+  std::vector<std::string> lines;
+  lines.push_back("||reload.example.com^$no-such-option");
+  lines.push_back("/reload[/");
+  lines.push_back("||reload.example.com^");
+
+  // The texts are registered before the diagnostics are installed, the
+  // loads still report them
+  Engine::from_lines(lines);
+  Filter::set_diagnostics(diagnostics);
+  Engine::from_lines(lines);
+  EXPECT_EQ(2u, diagnostics->get_total());
+  Engine::from_lines(lines);
+  EXPECT_EQ(4u, diagnostics->get_total());
+  ListParser::parse(lines[0] + "\n" + lines[1] + "\n", 1);
+  EXPECT_EQ(6u, diagnostics->get_total());
+
+  // An update only reports the invalid lines it adds
+  std::vector<std::string> new_lines(lines);
+  new_lines.push_back("/reload-new[/");
+  ListUpdate::diff(lines, new_lines);
+  Filter::set_diagnostics(nullptr);
+  EXPECT_EQ(7u, diagnostics->get_total());
+  EXPECT_EQ(4u, diagnostics->get_count(INVALID_REGEX_SYNTAX));
+}
+
+TEST(DiagnosticsTest, SampleRing) {
+  DiagnosticsCollectorPtr diagnostics(new DiagnosticsCollector(3));
+  Filter::known_filters_.clear();
+  Filter::set_diagnostics(diagnostics);
+  std::string buffer;
+  for (uint32_t idx = 0; idx < 5; ++idx) {
+    buffer += "/ad" + std::string(1, static_cast<char>('a' + idx)) + "$bogus\n";
+  }
+  ListParser::parse(buffer, 1);
+  Filter::set_diagnostics(nullptr);
+
+  EXPECT_EQ(5u, diagnostics->get_count(INVALID_UNKNOWN_OPTION));
+  auto samples = diagnostics->get_samples();
+  ASSERT_EQ(3u, samples.size());
+  EXPECT_EQ("/adc$bogus", samples[0].text);
+  EXPECT_EQ("/ade$bogus", samples[2].text);
+  EXPECT_EQ(INVALID_UNKNOWN_OPTION, samples[2].reason);
+
+  diagnostics->clear();
+  EXPECT_EQ(0u, diagnostics->get_total());
+  EXPECT_EQ(0u, diagnostics->get_samples().size());
+}
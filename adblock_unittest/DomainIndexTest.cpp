@@ -0,0 +1,232 @@
+#include "../adblock/DomainIndex.h"
+#include "../adblock/ElemHide.h"
+#include "../adblock/Matcher.h"
+#include "TestUtil.h"
+
+#include <iostream>
+#include <boost/unordered_set.hpp>
+#include <gtest/gtest.h>
+
+using namespace NS_ADBLOCK;
+
+
+namespace {
+
+  typedef boost::shared_ptr<ActiveFilter> ActiveFilterPtr;
+
+  ActiveFilterPtr active_filter(const std::string &text) {
+    return boost::dynamic_pointer_cast<ActiveFilter>(Filter::from_text(text));
+  }
+
+  /**
+   * Filters of easylist.txt with domain restrictions
+   */
+  std::vector<ActiveFilterPtr> easylist_domain_filters() {
+    std::vector<ActiveFilterPtr> result;
+    auto filters = test_util::load_easylist();
+    for (auto iter = filters.begin(); iter != filters.end(); ++iter) {
+      auto filter = boost::dynamic_pointer_cast<ActiveFilter>(*iter);
+      if (filter != nullptr && filter->get_domains().size() > 0) {
+        result.push_back(filter);
+      }
+    }
+    return result;
+  }
+
+  /**
+   * Domains named by the filters, a subdomain of each and some domains
+   * no filter names
+   */
+  std::vector<std::string> test_domains(const std::vector<ActiveFilterPtr> &filters) {
+    boost::unordered_set<std::string> unique;
+    for (auto filter = filters.begin(); filter != filters.end(); ++filter) {
+      const ActiveFilter::DomainMap &domains = (*filter)->get_domains();
+      for (auto iter = domains.begin(); iter != domains.end(); ++iter) {
+        if (iter->first.length() > 0) {
+          unique.insert(iter->first);
+          unique.insert("WWW." + iter->first);
+        }
+      }
+    }
+    std::vector<std::string> result(unique.begin(), unique.end());
+    std::sort(result.begin(), result.end());
+    result.push_back("");
+    result.push_back("EXAMPLE.COM");
+    result.push_back("COM");
+    return result;
+  }
+
+}
+
+TEST(DomainIndexTest, MostSpecificDomainWins) {
+  auto filter = active_filter("/domainindex/ad.$domain=example.com|~sub.example.com|deep.sub.example.com");
+  auto excluded = active_filter("/domainindex/ad2.$domain=~example.com");
+  auto other = active_filter("example.org##.domainindex");
+  DomainIndex index;
+  index.add(filter.get());
+  index.add(excluded.get());
+  index.add(other.get());
+
+  const char *domains[] = { "", "EXAMPLE.COM", "WWW.EXAMPLE.COM", "SUB.EXAMPLE.COM",
+    "X.SUB.EXAMPLE.COM", "DEEP.SUB.EXAMPLE.COM", "EXAMPLE.ORG", "COM" };
+  DomainMatches matches;
+  for (uint32_t idx = 0; idx < sizeof(domains) / sizeof(domains[0]); ++idx) {
+    index.resolve(domains[idx], matches);
+    EXPECT_EQ(filter->is_active_on_upper_domain(domains[idx]),
+      filter->is_active_on(matches)) << domains[idx];
+    EXPECT_EQ(excluded->is_active_on_upper_domain(domains[idx]),
+      excluded->is_active_on(matches)) << domains[idx];
+    EXPECT_EQ(other->is_active_on_upper_domain(domains[idx]),
+      other->is_active_on(matches)) << domains[idx];
+  }
+
+  // Every change gives the index a new stamp
+  uint64_t stamp = index.get_stamp();
+  index.remove(filter.get());
+  EXPECT_NE(stamp, index.get_stamp());
+  index.resolve("SUB.EXAMPLE.COM", matches);
+  EXPECT_TRUE(boost::indeterminate(matches.find(filter.get())));
+  EXPECT_FALSE(matches.find(excluded.get()));
+
+  DomainIndex copy = index;
+  EXPECT_NE(index.get_stamp(), copy.get_stamp());
+}
+
+TEST(DomainIndexTest, SameAsFilterWalk) {
+  auto filters = easylist_domain_filters();
+  if (filters.size() == 0) {
+    std::cout << "easylist.txt not found, skipping test" << std::endl;
+    return;
+  }
+
+  DomainIndex index;
+  for (auto filter = filters.begin(); filter != filters.end(); ++filter) {
+    index.add(filter->get());
+  }
+
+  std::vector<std::string> domains = test_domains(filters);
+  DomainMatches matches;
+  for (uint32_t idx = 0; idx < domains.size(); idx += 7) {
+    index.resolve(domains[idx], matches);
+    for (auto filter = filters.begin(); filter != filters.end(); ++filter) {
+      ASSERT_EQ((*filter)->is_active_on_upper_domain(domains[idx]),
+        (*filter)->is_active_on(matches)) << (*filter)->get_text() << " on " << domains[idx];
+    }
+  }
+}
+
+TEST(DomainIndexTest, MatcherAndElemHide) {
+  auto filters = test_util::load_easylist();
+  if (filters.size() == 0) {
+    std::cout << "easylist.txt not found, skipping test" << std::endl;
+    return;
+  }
+
+  CombindMatcher matcher;
+  ElemHide elem_hide;
+  std::vector<RegExpFilterPtr> regexp_filters;
+  boost::unordered_set<ElemHideFilterPtr> elem_filters;
+  for (auto iter = filters.begin(); iter != filters.end(); ++iter) {
+    auto regexp_filter = boost::dynamic_pointer_cast<RegExpFilter>(*iter);
+    if (regexp_filter != nullptr) {
+      matcher.add(regexp_filter);
+      regexp_filters.push_back(regexp_filter);
+    }
+    auto elem_filter = boost::dynamic_pointer_cast<ElemHideBase>(*iter);
+    if (elem_filter != nullptr) {
+      elem_hide.add(elem_filter);
+      if (elem_filter->get_type() == ELEM_HIDE_FILTER) {
+        elem_filters.insert(boost::dynamic_pointer_cast<ElemHideFilter>(elem_filter));
+      }
+    }
+  }
+
+  // One request reused for several document domains, the resolved rules
+  // have to follow the domain
+  auto urls = test_util::load_urls();
+  if (urls.size() > 200) {
+    urls.resize(200);
+  }
+  const char *doc_domains[] = { "", "www.youtube.com", "cnn.com.", "sub.imdb.com" };
+  Request request;
+  request.set_content_type(TYPE_SCRIPT);
+  request.set_third_party(true);
+  for (uint32_t idx = 0; idx < sizeof(doc_domains) / sizeof(doc_domains[0]); ++idx) {
+    request.set_doc_domain(doc_domains[idx]);
+    for (auto url = urls.begin(); url != urls.end(); ++url) {
+      request.set_location(*url);
+      bool whitelisted = false;
+      bool blocked = false;
+      for (auto iter = regexp_filters.begin(); iter != regexp_filters.end(); ++iter) {
+        if ((*iter)->matches(request)) {
+          if ((*iter)->get_type() == WHITELIST_FILTER) {
+            whitelisted = true;
+          } else {
+            blocked = true;
+          }
+        }
+      }
+      auto result = matcher.matches_any_internal(request);
+      if (whitelisted || blocked) {
+        ASSERT_TRUE(result != nullptr) << *url << " on " << doc_domains[idx];
+        EXPECT_EQ(whitelisted ? WHITELIST_FILTER : BLOCKING_FILTER, result->get_type());
+      } else {
+        EXPECT_TRUE(result == nullptr) << *url << " on " << doc_domains[idx];
+      }
+    }
+
+    std::vector<std::string> selectors = elem_hide.get_selectors(doc_domains[idx], false);
+    uint32_t expected = 0;
+    for (auto iter = elem_filters.begin(); iter != elem_filters.end(); ++iter) {
+      if ((*iter)->is_active_on_domain(doc_domains[idx]) &&
+        elem_hide.get_exception(*iter, doc_domains[idx]) == nullptr)
+      {
+        ++expected;
+      }
+    }
+    EXPECT_EQ(expected, selectors.size()) << doc_domains[idx];
+  }
+}
+
+TEST(DomainIndexTest, Benchmark) {
+  auto filters = easylist_domain_filters();
+  if (filters.size() == 0) {
+    std::cout << "easylist.txt not found, skipping benchmark" << std::endl;
+    return;
+  }
+
+  DomainIndex index;
+  for (auto filter = filters.begin(); filter != filters.end(); ++filter) {
+    index.add(filter->get());
+  }
+  std::vector<std::string> domains = test_domains(filters);
+
+  // Every filter with domain restrictions checked against every domain,
+  // the worst case of a request no keyword narrows down
+  uint32_t walk_active = 0;
+  test_util::Timer walk_timer;
+  for (auto domain = domains.begin(); domain != domains.end(); ++domain) {
+    for (auto filter = filters.begin(); filter != filters.end(); ++filter) {
+      walk_active += (*filter)->is_active_on_upper_domain(*domain) ? 1 : 0;
+    }
+  }
+  double walk_us = walk_timer.elapsed_us();
+
+  uint32_t index_active = 0;
+  DomainMatches matches;
+  test_util::Timer index_timer;
+  for (auto domain = domains.begin(); domain != domains.end(); ++domain) {
+    index.resolve(*domain, matches);
+    for (auto filter = filters.begin(); filter != filters.end(); ++filter) {
+      index_active += (*filter)->is_active_on(matches) ? 1 : 0;
+    }
+  }
+  double index_us = index_timer.elapsed_us();
+  EXPECT_EQ(walk_active, index_active);
+
+  std::cout << std::dec << filters.size() << " filters, " << domains.size()
+    << " domains" << std::endl
+    << "filter walk: " << walk_us / domains.size() << " us/domain" << std::endl
+    << "index:       " << index_us / domains.size() << " us/domain, x"
+    << walk_us / index_us << std::endl;
+}
@@ -0,0 +1,306 @@
+#include "../adblock/ElemHide.h"
+#include "TestUtil.h"
+
+#include <iostream>
+#include <algorithm>
+#include <boost/lexical_cast.hpp>
+#include <boost/unordered_map.hpp>
+#include <boost/unordered_set.hpp>
+#include <gtest/gtest.h>
+
+using namespace NS_ADBLOCK;
+
+
+namespace {
+
+  ElemHideBasePtr elem_hide_filter(const std::string &text) {
+    return boost::dynamic_pointer_cast<ElemHideBase>(Filter::from_text(text));
+  }
+
+  /**
+   * get_selectors() as a scan of every filter
+   */
+  std::vector<std::string> scan_selectors(const ElemHide &elem_hide,
+    const std::vector<ElemHideFilterPtr> &filters, const std::string &domain,
+    bool specific)
+  {
+    std::vector<std::string> result;
+    for (auto iter = filters.begin(); iter != filters.end(); ++iter) {
+      auto filter = *iter;
+      if (specific) {
+        const auto &domains = filter->get_domains();
+        if (domains.size() == 0 || domains.find("")->second) {
+          continue;
+        }
+      }
+      if (filter->is_active_on_domain(domain) &&
+        elem_hide.get_exception(filter, domain) == nullptr)
+      {
+        result.push_back(filter->get_selector());
+      }
+    }
+    return result;
+  }
+
+  /**
+   * Adds the element hiding rules of easylist.txt, returns the filters
+   * without duplicates
+   */
+  std::vector<ElemHideFilterPtr> add_easylist(ElemHide &elem_hide) {
+    std::vector<ElemHideFilterPtr> result;
+    boost::unordered_set<ElemHideFilterPtr> known;
+    auto filters = test_util::load_easylist();
+    for (auto iter = filters.begin(); iter != filters.end(); ++iter) {
+      auto filter = boost::dynamic_pointer_cast<ElemHideBase>(*iter);
+      if (filter == nullptr) {
+        continue;
+      }
+      elem_hide.add(filter);
+      if (filter->get_type() == ELEM_HIDE_FILTER) {
+        auto elem_filter = boost::static_pointer_cast<ElemHideFilter>(filter);
+        if (known.insert(elem_filter).second) {
+          result.push_back(elem_filter);
+        }
+      }
+    }
+    return result;
+  }
+
+  std::vector<std::string> sorted(std::vector<std::string> selectors) {
+    std::sort(selectors.begin(), selectors.end());
+    return selectors;
+  }
+
+}
+
+TEST(ElemHideTest, GenericAndSpecific) {
+  ElemHide elem_hide;
+  elem_hide.add(elem_hide_filter("##.elemhide-generic"));
+  elem_hide.add(elem_hide_filter("##.elemhide-excepted"));
+  elem_hide.add(elem_hide_filter("~example.com##.elemhide-not-example"));
+  elem_hide.add(elem_hide_filter("example.com,~sub.example.com##.elemhide-example"));
+  elem_hide.add(elem_hide_filter("sub.example.com##.elemhide-sub"));
+  elem_hide.add(elem_hide_filter("example.com#@#.elemhide-excepted"));
+
+  std::vector<std::string> expected;
+  expected.push_back(".elemhide-excepted");
+  expected.push_back(".elemhide-generic");
+  expected.push_back(".elemhide-not-example");
+  EXPECT_TRUE(sorted(elem_hide.get_selectors("example.org", false)) == expected);
+
+  expected.clear();
+  expected.push_back(".elemhide-example");
+  expected.push_back(".elemhide-generic");
+  EXPECT_TRUE(sorted(elem_hide.get_selectors("www.example.com", false)) == expected);
+
+  expected.clear();
+  expected.push_back(".elemhide-sub");
+  EXPECT_TRUE(sorted(elem_hide.get_selectors("x.sub.example.com", true)) == expected);
+
+  // The prebuilt lists follow the rules
+  elem_hide.add(elem_hide_filter("##.elemhide-later"));
+  elem_hide.remove(elem_hide_filter("example.com#@#.elemhide-excepted"));
+  expected.clear();
+  expected.push_back(".elemhide-example");
+  expected.push_back(".elemhide-excepted");
+  expected.push_back(".elemhide-generic");
+  expected.push_back(".elemhide-later");
+  EXPECT_TRUE(sorted(elem_hide.get_selectors("example.com", false)) == expected);
+}
+
+TEST(ElemHideTest, ExceptionsByDomain) {
+  ElemHide elem_hide;
+  auto filter = elem_hide_filter("##.elemhide-exception");
+  auto example = elem_hide_filter("example.com,~sub.example.com#@#.elemhide-exception");
+  auto not_org = elem_hide_filter("~example.org#@#.elemhide-exception");
+  elem_hide.add(filter);
+  elem_hide.add(example);
+  elem_hide.add(not_org);
+
+  EXPECT_EQ(example, elem_hide.get_exception(filter, "www.example.com"));
+  EXPECT_EQ(not_org, elem_hide.get_exception(filter, "sub.example.com"));
+  EXPECT_TRUE(elem_hide.get_exception(filter, "example.org") == nullptr);
+  EXPECT_EQ(not_org, elem_hide.get_exception(filter, ""));
+
+  // Removing an exception keeps the other exceptions of the selector
+  elem_hide.remove(not_org);
+  EXPECT_TRUE(elem_hide.get_exception(filter, "sub.example.com") == nullptr);
+  EXPECT_EQ(example, elem_hide.get_exception(filter, "example.com"));
+  elem_hide.remove(example);
+  EXPECT_TRUE(elem_hide.get_exception(filter, "example.com") == nullptr);
+}
+
+TEST(ElemHideTest, StylesheetCache) {
+  ElemHide elem_hide;
+  elem_hide.add(elem_hide_filter("##.elemhide-style"));
+  elem_hide.add(elem_hide_filter("example.com##.elemhide-style-example"));
+
+  auto stylesheet = elem_hide.get_stylesheet("example.com");
+  EXPECT_EQ(".elemhide-style { display: none !important; }\n"
+    ".elemhide-style-example { display: none !important; }\n", *stylesheet);
+  EXPECT_EQ(stylesheet, elem_hide.get_stylesheet("EXAMPLE.COM"));
+
+  elem_hide.add(elem_hide_filter("example.com#@#.elemhide-style-example"));
+  auto changed = elem_hide.get_stylesheet("example.com");
+  EXPECT_NE(stylesheet, changed);
+  EXPECT_EQ(".elemhide-style { display: none !important; }\n", *changed);
+}
+
+TEST(ElemHideTest, StylesheetCacheEviction) {
+  ElemHide elem_hide;
+  elem_hide.add(elem_hide_filter("##.elemhide-style"));
+
+  auto first = elem_hide.get_stylesheet("first.com");
+  auto second = elem_hide.get_stylesheet("second.com");
+  for (uint32_t idx = 0; idx < 4 * ElemHide::StylesheetCacheSize; ++idx) {
+    elem_hide.get_stylesheet("domain" + boost::lexical_cast<std::string>(idx) + ".com");
+    // Hit after every new domain, so the CLOCK hand always skips it
+    EXPECT_EQ(first, elem_hide.get_stylesheet("first.com"));
+  }
+
+  // Never used again, so it was dropped and is built again
+  EXPECT_NE(second, elem_hide.get_stylesheet("second.com"));
+  EXPECT_EQ(*second, *elem_hide.get_stylesheet("second.com"));
+}
+
+TEST(ElemHideTest, SameAsFullScan) {
+  ElemHide elem_hide;
+  auto elem_filters = add_easylist(elem_hide);
+  if (elem_filters.size() == 0) {
+    std::cout << "easylist.txt not found, skipping test" << std::endl;
+    return;
+  }
+
+  std::vector<std::string> domains;
+  domains.push_back("");
+  domains.push_back("example.com");
+  for (auto filter = elem_filters.begin(); filter != elem_filters.end(); ++filter) {
+    const auto &filter_domains = (*filter)->get_domains();
+    for (auto domain = filter_domains.begin(); domain != filter_domains.end(); ++domain) {
+      if (domain->first.length() > 0 && domains.size() < 300) {
+        domains.push_back("www." + domain->first);
+      }
+    }
+  }
+
+  for (auto domain = domains.begin(); domain != domains.end(); ++domain) {
+    EXPECT_TRUE(sorted(elem_hide.get_selectors(*domain, false)) ==
+      sorted(scan_selectors(elem_hide, elem_filters, *domain, false))) << *domain;
+    EXPECT_TRUE(sorted(elem_hide.get_selectors(*domain, true)) ==
+      sorted(scan_selectors(elem_hide, elem_filters, *domain, true))) << *domain;
+  }
+}
+
+TEST(ElemHideTest, Benchmark) {
+  ElemHide elem_hide;
+  auto elem_filters = add_easylist(elem_hide);
+  if (elem_filters.size() == 0) {
+    std::cout << "easylist.txt not found, skipping benchmark" << std::endl;
+    return;
+  }
+
+  const char *domains[] = { "www.youtube.com", "edition.cnn.com", "www.imdb.com",
+    "news.example.org" };
+  const uint32_t domain_count = sizeof(domains) / sizeof(domains[0]);
+  const uint32_t rounds = 20;
+
+  uint32_t scan_count = 0;
+  test_util::Timer scan_timer;
+  for (uint32_t round = 0; round < rounds; ++round) {
+    for (uint32_t idx = 0; idx < domain_count; ++idx) {
+      scan_count += scan_selectors(elem_hide, elem_filters, domains[idx], false).size();
+    }
+  }
+  double scan_us = scan_timer.elapsed_us() / (rounds * domain_count);
+
+  uint32_t index_count = 0;
+  test_util::Timer index_timer;
+  for (uint32_t round = 0; round < rounds; ++round) {
+    for (uint32_t idx = 0; idx < domain_count; ++idx) {
+      index_count += elem_hide.get_selectors(domains[idx], false).size();
+    }
+  }
+  double index_us = index_timer.elapsed_us() / (rounds * domain_count);
+  EXPECT_EQ(scan_count, index_count);
+
+  test_util::Timer stylesheet_timer;
+  for (uint32_t round = 0; round < rounds; ++round) {
+    for (uint32_t idx = 0; idx < domain_count; ++idx) {
+      elem_hide.get_stylesheet(domains[idx]);
+    }
+  }
+  double stylesheet_us = stylesheet_timer.elapsed_us() / (rounds * domain_count);
+
+  std::cout << std::dec << elem_filters.size() << " element hiding filters" << std::endl
+    << "full scan:  " << scan_us << " us/domain" << std::endl
+    << "index:      " << index_us << " us/domain, x" << scan_us / index_us << std::endl
+    << "stylesheet: " << stylesheet_us << " us/domain (cached)" << std::endl;
+}
+
+TEST(ElemHideTest, ExceptionBenchmark) {
+  auto filters = test_util::load_easylist();
+  if (filters.size() == 0) {
+    std::cout << "easylist.txt not found, skipping benchmark" << std::endl;
+    return;
+  }
+
+  // Exceptions by selector as they were kept before the domain index
+  ElemHide elem_hide;
+  boost::unordered_map<std::string, std::vector<ElemHideExceptionPtr>> by_selector;
+  std::vector<ElemHideExceptionPtr> exceptions;
+  std::vector<std::string> domains;
+  for (auto iter = filters.begin(); iter != filters.end(); ++iter) {
+    auto filter = boost::dynamic_pointer_cast<ElemHideException>(*iter);
+    if (filter == nullptr) {
+      continue;
+    }
+    elem_hide.add(filter);
+    std::vector<ElemHideExceptionPtr> &list = by_selector[filter->get_selector()];
+    if (std::find(list.begin(), list.end(), filter) != list.end()) {
+      continue;
+    }
+    list.push_back(filter);
+    exceptions.push_back(filter);
+    const auto &filter_domains = filter->get_domains();
+    for (auto domain = filter_domains.begin(); domain != filter_domains.end(); ++domain) {
+      if (domain->first.length() > 0) {
+        domains.push_back("www." + domain->first);
+      }
+    }
+  }
+  domains.push_back("www.example.com");
+
+  uint32_t scan_count = 0;
+  test_util::Timer scan_timer;
+  for (auto domain = domains.begin(); domain != domains.end(); ++domain) {
+    for (auto exception = exceptions.begin(); exception != exceptions.end(); ++exception) {
+      const std::vector<ElemHideExceptionPtr> &list = by_selector[(*exception)->get_selector()];
+      for (auto iter = list.begin(); iter != list.end(); ++iter) {
+        if ((*iter)->is_active_on_domain(*domain)) {
+          ++scan_count;
+          break;
+        }
+      }
+    }
+  }
+  double scan_us = scan_timer.elapsed_us();
+
+  uint32_t index_count = 0;
+  test_util::Timer index_timer;
+  for (auto domain = domains.begin(); domain != domains.end(); ++domain) {
+    for (auto exception = exceptions.begin(); exception != exceptions.end(); ++exception) {
+      if (elem_hide.get_exception(*exception, *domain) != nullptr) {
+        ++index_count;
+      }
+    }
+  }
+  double index_us = index_timer.elapsed_us();
+  EXPECT_EQ(scan_count, index_count);
+
+  uint32_t lookups = static_cast<uint32_t>(domains.size() * exceptions.size());
+  std::cout << std::dec << exceptions.size() << " exceptions, " << domains.size()
+    << " domains" << std::endl
+    << "list scan: " << scan_us * 1000 / lookups << " ns/lookup" << std::endl
+    << "index:     " << index_us * 1000 / lookups << " ns/lookup, x"
+    << scan_us / index_us << std::endl;
+}
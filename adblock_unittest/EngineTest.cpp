@@ -0,0 +1,232 @@
+#include "../adblock/Adblock.h"
+#include "TestUtil.h"
+
+#include <algorithm>
+#include <iostream>
+#include <boost/thread.hpp>
+#include <gtest/gtest.h>
+
+using namespace NS_ADBLOCK;
+
+
+namespace {
+
+  /**
+   * Matches every URL of the corpus a number of times against the engine
+   * published by an Adblock, stores the results of the last round
+   */
+  class Worker {
+  public:
+    Worker(const Adblock &adblock, const std::vector<std::string> &urls,
+      uint32_t rounds): adblock_(&adblock), urls_(&urls), rounds_(rounds) { }
+
+    void operator()() {
+      EngineReader reader(*adblock_);
+      Request request;
+      request.set_content_type(TYPE_SCRIPT);
+      request.set_doc_domain("www.example.com");
+      request.set_third_party(true);
+
+      results_.assign(urls_->size(), nullptr);
+      for (uint32_t round = 0; round < rounds_; ++round) {
+        for (uint32_t idx = 0; idx < urls_->size(); ++idx) {
+          request.set_location((*urls_)[idx]);
+          results_[idx] = reader.get().matches_any(request);
+        }
+      }
+    }
+
+    const std::vector<RegExpFilterPtr> &get_results() const {
+      return results_;
+    }
+
+  private:
+    const Adblock *adblock_;
+    const std::vector<std::string> *urls_;
+    uint32_t rounds_;
+    std::vector<RegExpFilterPtr> results_;
+  };
+
+  /**
+   * Runs the workers on their own threads, returns the wall time in
+   * microseconds
+   */
+  double run_workers(std::vector<Worker> &workers) {
+    test_util::Timer timer;
+    boost::thread_group threads;
+    for (auto iter = workers.begin(); iter != workers.end(); ++iter) {
+      threads.create_thread(boost::ref(*iter));
+    }
+    threads.join_all();
+    return timer.elapsed_us();
+  }
+
+}
+
+TEST(EngineTest, SameAsCombindMatcher) {
+  const char *lines[] = {
+    "||ads.example.com^", "/banner/*.gif", "-ad-$domain=example.com",
+    "@@||ads.example.com/allowed^", "&ad=$script,third-party", "^track^",
+    "##.ad", "example.com##.banner", "! comment"
+  };
+  std::vector<std::string> list(lines, lines + sizeof(lines) / sizeof(lines[0]));
+
+  CombindMatcher matcher;
+  for (auto iter = list.begin(); iter != list.end(); ++iter) {
+    auto filter = boost::dynamic_pointer_cast<RegExpFilter>(Filter::from_text(*iter));
+    if (filter != nullptr) {
+      matcher.add(filter);
+    }
+  }
+
+  EnginePtr engine = Engine::from_lines(list);
+  EXPECT_EQ(8u, engine->get_filter_count());
+
+  std::vector<std::string> urls = test_util::load_urls();
+  const char *extra[] = {
+    "http://ads.example.com/x.js", "http://ads.example.com/allowed/x.js",
+    "http://cdn.com/banner/x.gif", "http://cdn.com/x-ad-y.js",
+    "http://cdn.com/?q=1&ad=2", "http://cdn.com/a/track/b"
+  };
+  urls.insert(urls.end(), extra, extra + sizeof(extra) / sizeof(extra[0]));
+
+  for (auto url = urls.begin(); url != urls.end(); ++url) {
+    Request request(*url, TYPE_SCRIPT, "www.example.com", true);
+    EXPECT_EQ(matcher.matches_any(request), engine->matches_any(request)) << *url;
+  }
+}
+
+TEST(EngineTest, PublishWhileMatching) {
+  std::vector<std::string> blocking(1, "/ads/");
+  std::vector<std::string> allowing(1, "@@/ads/");
+  std::vector<std::string> urls(100, "http://example.com/ads/banner.js");
+
+  Adblock adblock;
+  adblock.load(blocking);
+  uint32_t generation = adblock.get_generation();
+
+  std::vector<Worker> workers(4, Worker(adblock, urls, 50));
+  boost::thread_group threads;
+  for (auto iter = workers.begin(); iter != workers.end(); ++iter) {
+    threads.create_thread(boost::ref(*iter));
+  }
+  for (uint32_t idx = 0; idx < 100; ++idx) {
+    adblock.load(idx % 2 == 0 ? allowing : blocking);
+  }
+  threads.join_all();
+
+  EXPECT_EQ(generation + 100, adblock.get_generation());
+
+  // Every result comes from one of the published engines
+  for (auto worker = workers.begin(); worker != workers.end(); ++worker) {
+    const std::vector<RegExpFilterPtr> &results = worker->get_results();
+    for (auto result = results.begin(); result != results.end(); ++result) {
+      ASSERT_TRUE(*result != nullptr);
+      EXPECT_TRUE((*result)->get_text() == "/ads/" ||
+        (*result)->get_text() == "@@/ads/");
+    }
+  }
+
+  // Readers switch to the last engine
+  Request request(urls.front(), TYPE_SCRIPT, "", false);
+  EngineReader reader(adblock);
+  EXPECT_EQ("/ads/", reader.get().matches_any(request)->get_text());
+}
+
+TEST(EngineTest, Benchmark) {
+  std::vector<std::string> lines = test_util::read_lines("easylist.txt");
+  if (lines.size() == 0) {
+    std::cout << "easylist.txt not found, skipping benchmark" << std::endl;
+    return;
+  }
+
+  Adblock adblock;
+  adblock.load(lines);
+  std::vector<std::string> urls = test_util::load_urls();
+
+  std::vector<Worker> reference(1, Worker(adblock, urls, 1));
+  run_workers(reference);
+
+  // Every thread matches the whole corpus, throughput scales with the
+  // number of threads as long as there are enough cores
+  std::cout << std::dec << adblock.get_engine()->get_filter_count() << " filters, "
+    << urls.size() << " urls, " << boost::thread::hardware_concurrency()
+    << " cores" << std::endl;
+  double single_rate = 0;
+  const uint32_t thread_counts[] = { 1, 2, 4, 8 };
+  for (uint32_t idx = 0; idx < sizeof(thread_counts) / sizeof(thread_counts[0]); ++idx) {
+    std::vector<Worker> workers(thread_counts[idx], Worker(adblock, urls, 1));
+    double elapsed_us = run_workers(workers);
+    double rate = thread_counts[idx] * 1.0 * urls.size() / elapsed_us * 1000000;
+    if (idx == 0) {
+      single_rate = rate;
+    }
+    std::cout << thread_counts[idx] << " threads: " << static_cast<uint64_t>(rate)
+      << " urls/s, x" << rate / single_rate << std::endl;
+
+    for (auto worker = workers.begin(); worker != workers.end(); ++worker) {
+      EXPECT_TRUE(worker->get_results() == reference.front().get_results());
+    }
+  }
+}
+
+TEST(EngineTest, WarmUp) {
+  std::vector<std::string> lines;
+  lines.push_back("/warm-up-[0-9]+\\.js/");
+  lines.push_back("@@/warm-up-1[0-9]*\\.js/$script");
+  lines.push_back("||warm-up.example.com^");
+  lines.push_back("example.com##.warm-up");
+  Adblock adblock;
+  adblock.set_warm_up(true);
+  adblock.load(lines);
+  EnginePtr engine = adblock.get_engine();
+  EXPECT_GE(adblock.get_warm_up_stats().elapsed.count(), 0);
+  EXPECT_EQ(1u, engine->get_selectors("example.com", false).size());
+
+  Request request("http://x.com/warm-up-12.js", TYPE_SCRIPT, "x.com", true);
+  EXPECT_EQ("@@/warm-up-1[0-9]*\\.js/$script", engine->matches_any(request)->get_text());
+  request.set_location("http://x.com/warm-up-22.js");
+  EXPECT_EQ("/warm-up-[0-9]+\\.js/", engine->matches_any(request)->get_text());
+}
+
+TEST(EngineTest, WarmUpBenchmark) {
+  std::vector<std::string> lines = test_util::read_lines("easylist.txt");
+  if (lines.size() == 0) {
+    std::cout << "easylist.txt not found, skipping benchmark" << std::endl;
+    return;
+  }
+
+  std::vector<std::string> urls = test_util::load_urls();
+  Request request;
+  request.set_content_type(TYPE_SCRIPT);
+  request.set_doc_domain("www.example.com");
+  request.set_third_party(true);
+
+  // Latency of the first requests on a fresh engine, without then with
+  // warm_up(). The first element hiding query is timed on its own, it is
+  // the only work warm_up() takes off the first queries
+  for (uint32_t warm = 0; warm < 2; ++warm) {
+    EnginePtr engine = Engine::from_lines(lines);
+    if (warm) {
+      Engine::WarmUpStats stats = engine->warm_up();
+      std::cout << "warm-up: " << stats.elapsed.count() << " us" << std::endl;
+    }
+
+    test_util::Timer selectors_timer;
+    engine->get_selectors("www.example.com", false);
+    double selectors_us = selectors_timer.elapsed_us();
+
+    std::vector<double> latencies;
+    for (uint32_t idx = 0; idx < 10000; ++idx) {
+      request.set_location(urls[idx % urls.size()]);
+      test_util::Timer timer;
+      engine->matches_any(request);
+      latencies.push_back(timer.elapsed_us());
+    }
+    std::sort(latencies.begin(), latencies.end());
+    std::cout << (warm ? "warm" : "cold") << ": first selectors " <<
+      selectors_us << " us, first 10k requests p99 " <<
+      latencies[latencies.size() * 99 / 100] << " us, max " <<
+      latencies.back() << " us" << std::endl;
+  }
+}
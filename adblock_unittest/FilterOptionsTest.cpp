@@ -0,0 +1,134 @@
+#include "../adblock/Filter.h"
+#include "../adblock/FilterOptions.h"
+#include "TestUtil.h"
+
+#include <algorithm>
+#include <boost/algorithm/string/case_conv.hpp>
+#include <gtest/gtest.h>
+
+using namespace NS_ADBLOCK;
+
+
+namespace {
+
+  RegExpFilterPtr regexp_filter(const std::string &text) {
+    return boost::dynamic_pointer_cast<RegExpFilter>(Filter::from_text(text));
+  }
+
+  /**
+   * Position of the options as found by OptionsRegex
+   */
+  size_t find_regex(const std::string &text) {
+    boost::smatch match;
+    if (!boost::regex_search(text, match, Filter::OptionsRegex)) {
+      return std::string::npos;
+    }
+    return match.position(static_cast<boost::smatch::size_type>(0));
+  }
+
+}
+
+TEST(FilterOptionsTest, PerfectHash) {
+  for (auto iter = RegExpFilter::type_map_.begin(); iter != RegExpFilter::type_map_.end(); ++iter) {
+    uint32_t type = 0;
+    EXPECT_EQ(FilterOptions::OPTION_TYPE, FilterOptions::lookup(iter->first, type)) << iter->first;
+    EXPECT_EQ(iter->second, type) << iter->first;
+
+    std::string name = boost::to_lower_copy(iter->first);
+    std::replace(name.begin(), name.end(), '_', '-');
+    type = 0;
+    EXPECT_EQ(FilterOptions::OPTION_TYPE, FilterOptions::lookup(name, type)) << name;
+    EXPECT_EQ(iter->second, type) << name;
+  }
+
+  uint32_t type = 0;
+  EXPECT_EQ(FilterOptions::OPTION_MATCH_CASE, FilterOptions::lookup("match-case", type));
+  EXPECT_EQ(FilterOptions::OPTION_DOMAIN, FilterOptions::lookup("Domain", type));
+  EXPECT_EQ(FilterOptions::OPTION_THIRD_PARTY, FilterOptions::lookup("third_party", type));
+  EXPECT_EQ(FilterOptions::OPTION_COLLAPSE, FilterOptions::lookup("COLLAPSE", type));
+  EXPECT_EQ(FilterOptions::OPTION_SITEKEY, FilterOptions::lookup("sitekey", type));
+
+  const char *unknown[] = {
+    "", "a", "xb", "scripts", "scrip", "~script", "third-partyx", "domain=",
+    "stylesheeT1", "tdt", "elemhidf", "object-subrequest_"
+  };
+  for (uint32_t idx = 0; idx < sizeof(unknown) / sizeof(unknown[0]); ++idx) {
+    EXPECT_EQ(FilterOptions::OPTION_UNKNOWN, FilterOptions::lookup(unknown[idx], type)) << unknown[idx];
+  }
+}
+
+TEST(FilterOptionsTest, SameAsOptionsRegex) {
+  const char *texts[] = {
+    "", "$", "a$", "$script", "a$script", "a$~script,image", "a$script,", "a$,script",
+    "a$domain=", "a$domain=x.com|~y.com", "a$domain=x$y", "a$b$c", "a$b c", "a$b=c d",
+    "a$b=c\nd", "a$b\n", "a$b=c\r", "a$b\fc", "a$~~b", "a$~", "a$b=c=d", "a$b(c)",
+    "a$b,~c=d,e-f_g=h", "$$$", "a$b\x80", "a$b=\x80\x85"
+  };
+  std::vector<std::string> lines(texts, texts + sizeof(texts) / sizeof(texts[0]));
+  std::vector<std::string> easylist = test_util::read_lines("easylist.txt");
+  lines.insert(lines.end(), easylist.begin(), easylist.end());
+
+  for (auto line = lines.begin(); line != lines.end(); ++line) {
+    ASSERT_EQ(find_regex(*line), FilterOptions::find(*line)) << *line;
+  }
+}
+
+TEST(FilterOptionsTest, Parse) {
+  FilterOptions options;
+  EXPECT_TRUE(options.parse("Script,~Third-Party,domain=a.com|~b.a.com,match-case,~collapse"));
+  EXPECT_EQ(TYPE_SCRIPT, options.content_type);
+  EXPECT_TRUE(options.match_case);
+  EXPECT_FALSE(options.third_party);
+  EXPECT_FALSE(options.collapse);
+  EXPECT_FALSE(options.has_document);
+  EXPECT_EQ("a.com|~b.a.com", options.domains.to_string());
+
+  FilterOptions negated;
+  EXPECT_TRUE(negated.parse("~image,~popup,document"));
+  EXPECT_EQ(static_cast<uint32_t>(DEFAULT_CONTENT_TYPE & ~(TYPE_IMAGE | TYPE_POPUP)),
+    negated.content_type);
+  EXPECT_TRUE(negated.has_document);
+  EXPECT_TRUE(boost::indeterminate(negated.third_party));
+
+  FilterOptions unknown;
+  EXPECT_FALSE(unknown.parse("script,~no-such-option=1,image"));
+  EXPECT_EQ("~no-such-option", unknown.unknown.to_string());
+
+  FilterOptions no_value;
+  EXPECT_FALSE(no_value.parse("domain"));
+  EXPECT_EQ("domain", no_value.unknown.to_string());
+}
+
+TEST(FilterOptionsTest, RegExpFilter) {
+  auto filter = regexp_filter("||ads.com^$script,image,third-party,domain=a.com|~b.a.com");
+  ASSERT_TRUE(filter != nullptr);
+  EXPECT_EQ("||ads.com^", filter->get_regex_source());
+  EXPECT_EQ(static_cast<uint32_t>(TYPE_SCRIPT | TYPE_IMAGE), filter->get_content_types());
+  EXPECT_TRUE(filter->get_third_party());
+  EXPECT_TRUE(filter->is_active_on_domain("www.a.com"));
+  EXPECT_FALSE(filter->is_active_on_domain("b.a.com"));
+
+  // Values may contain $, the leftmost $ starting valid options wins
+  filter = regexp_filter("/ad$domain=a$b.com,match-case");
+  ASSERT_TRUE(filter != nullptr);
+  EXPECT_EQ("/ad", filter->get_regex_source());
+  EXPECT_TRUE(filter->get_match_case());
+  filter = regexp_filter("/ad$x$match-case");
+  ASSERT_TRUE(filter != nullptr);
+  EXPECT_EQ("/ad$x", filter->get_regex_source());
+
+  // Exception filters don't apply to documents unless asked to
+  filter = regexp_filter("@@||example.com^");
+  ASSERT_TRUE(filter != nullptr);
+  EXPECT_EQ(0u, filter->get_content_types() & TYPE_DOCUMENT);
+  filter = regexp_filter("@@||example.com^$document");
+  ASSERT_TRUE(filter != nullptr);
+  EXPECT_EQ(static_cast<uint32_t>(TYPE_DOCUMENT), filter->get_content_types());
+  filter = regexp_filter("@@|http://example.com^");
+  ASSERT_TRUE(filter != nullptr);
+  EXPECT_NE(0u, filter->get_content_types() & TYPE_DOCUMENT);
+
+  auto invalid = Filter::from_text("||ads.com^$script,foo-bar");
+  ASSERT_TRUE(invalid != nullptr);
+  EXPECT_EQ(INVALID_FILTER, invalid->get_type());
+}
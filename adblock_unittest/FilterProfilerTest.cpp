@@ -0,0 +1,63 @@
+#include "../adblock/FilterProfiler.h"
+#include "../adblock/Matcher.h"
+
+#include <sstream>
+#include <gtest/gtest.h>
+
+using namespace NS_ADBLOCK;
+
+
+namespace {
+
+  RegExpFilterPtr regexp_filter(const std::string &text) {
+    return boost::dynamic_pointer_cast<RegExpFilter>(Filter::from_text(text));
+  }
+
+}
+
+TEST(FilterProfilerTest, CostPerFilter) {
+  CombindMatcher matcher;
+  auto image = regexp_filter("||profile.example.com^$image");
+  auto regex = regexp_filter("/banner[0-9]+\\.gif/$domain=example.com");
+  matcher.add(image);
+  matcher.add(regex);
+
+  // Nothing is recorded unless enabled
+  matcher.matches_any_internal(Request("http://profile.example.com/a.png",
+    TYPE_IMAGE, "example.com", true));
+  EXPECT_EQ(0u, FilterProfiler::get_cost(*image).evaluations);
+
+  FilterProfiler::set_enabled(true);
+  const char *urls[] = { "http://profile.example.com/a.png",
+    "http://profile.example.com/a.js", "http://other.example.com/banner1.png" };
+  for (uint32_t idx = 0; idx < 3; ++idx) {
+    matcher.matches_any_internal(Request(urls[idx], TYPE_IMAGE, "example.com", true));
+  }
+  matcher.matches_any_internal(Request(urls[0], TYPE_SCRIPT, "example.com", true));
+  FilterProfiler::set_enabled(false);
+
+  FilterProfiler::Cost image_cost = FilterProfiler::get_cost(*image);
+  EXPECT_EQ(image->get_text(), image_cost.text);
+  EXPECT_EQ(3u, image_cost.evaluations);
+  EXPECT_EQ(2u, image_cost.matches);
+  EXPECT_DOUBLE_EQ(2.0 / 3, image_cost.match_rate());
+
+  // The regex has no keyword, it is tested whenever no other filter matched
+  FilterProfiler::Cost regex_cost = FilterProfiler::get_cost(*regex);
+  EXPECT_EQ(2u, regex_cost.evaluations);
+  EXPECT_EQ(0u, regex_cost.matches);
+  EXPECT_GT(regex_cost.location_ns, 0u);
+  EXPECT_TRUE(matcher.is_slow_filter(regex));
+
+  std::vector<FilterProfiler::Cost> top = FilterProfiler::get_top(1);
+  ASSERT_EQ(1u, top.size());
+  EXPECT_GE(top[0].total_ns(), regex_cost.total_ns());
+
+  std::ostringstream report;
+  FilterProfiler::dump(report, 10);
+  EXPECT_NE(std::string::npos, report.str().find(regex->get_text()));
+
+  FilterProfiler::clear();
+  EXPECT_EQ(0u, FilterProfiler::get_cost(*regex).evaluations);
+  EXPECT_TRUE(FilterProfiler::get_top(10).empty());
+}
@@ -0,0 +1,156 @@
+#include "../adblock/Filter.h"
+#include "TestUtil.h"
+
+#include <iostream>
+#include <gtest/gtest.h>
+
+using namespace NS_ADBLOCK;
+
+
+namespace {
+
+  /**
+   * Filter::normalize() as it was written with regular expressions
+   */
+  std::string normalize_regex(std::string text) {
+    if (text.length() == 0) {
+      return text;
+    }
+
+    text = boost::regex_replace(text, boost::regex("[^\\S ]"), "");
+    if (boost::regex_search(text, boost::regex("^\\s*!"))) {
+      return boost::regex_replace(
+        boost::regex_replace(text, boost::regex("^\\s+"), ""),
+        boost::regex("\\s+$"),
+        "");
+    } else if (boost::regex_search(text, Filter::ElemHideRegex)) {
+      boost::smatch match;
+      if (boost::regex_search(text, match, boost::regex("^(.*?)(#\\@?#?)(.*)$"))) {
+        return boost::regex_replace(match[1].str(), boost::regex("\\s"), "")
+          + match[2].str() + boost::regex_replace(
+          boost::regex_replace(match[3].str(), boost::regex("^\\s+"), ""),
+          boost::regex("\\s+$"),
+          "");
+      }
+    }
+    return boost::regex_replace(text, boost::regex("\\s"), "");
+  }
+
+  /**
+   * Groups of ElemHideRegex in the form "domain|exception|tag|attrs|selector",
+   * empty if it doesn't match
+   */
+  std::string elem_hide_regex(const std::string &text) {
+    boost::smatch match;
+    if (!boost::regex_search(text, match, Filter::ElemHideRegex)) {
+      return "";
+    }
+    return match[1].str() + "|" + (match[2].matched ? "1" : "0") + "|" +
+      match[3].str() + "|" + match[4].str() + "|" + match[5].str();
+  }
+
+  std::string elem_hide_parts(const Filter::ElemHideParts &parts) {
+    return parts.domain.to_string() + "|" + (parts.is_exception ? "1" : "0") + "|" +
+      parts.tag_name.to_string() + "|" + parts.attr_rules.to_string() + "|" +
+      parts.selector.to_string();
+  }
+
+  std::string elem_hide_scanner(const std::string &text) {
+    Filter::ElemHideParts parts;
+    if (!Filter::parse_elem_hide(text, parts)) {
+      return "";
+    }
+    return elem_hide_parts(parts);
+  }
+
+  /**
+   * Lines of easylist.txt plus lines around the corners of the grammar
+   */
+  std::vector<std::string> test_lines() {
+    const char *lines[] = {
+      "", "   ", "\t! comment \r", "  !comment with  spaces  ", "a !b",
+      "example.com##.ad", " example .com ## .ad  .b ", "##div > a", "#@#.ad",
+      "example.com#@##ad", "example.com#div(id=x)(foo)", "#*(id)", "#div(id^=a b)",
+      "#div(id$x)", "#div(id)x", "#div(", "###", "##", "#@", "##{}", "a#b#c##.d",
+      "a/b##.c", "a#b/c##.d", "@@||ads.example.com^", "||ads.example.com^$script, image",
+      "/ads/ *.gif\n", "example.com,~a.example.com##.x y", "a\x80#div", "#div\xC3(x)",
+      "#a-b_c(x-y=\"z\")", "#a(b=c(d))", "foo#bar baz", "x\v##.y\f"
+    };
+    std::vector<std::string> result(lines, lines + sizeof(lines) / sizeof(lines[0]));
+    std::vector<std::string> easylist = test_util::read_lines("easylist.txt");
+    result.insert(result.end(), easylist.begin(), easylist.end());
+    return result;
+  }
+
+}
+
+TEST(FilterTest, SameAsRegexParser) {
+  std::vector<std::string> lines = test_lines();
+  for (auto line = lines.begin(); line != lines.end(); ++line) {
+    std::string normalized = normalize_regex(*line);
+    ASSERT_EQ(normalized, Filter::normalize(*line)) << *line;
+    ASSERT_EQ(elem_hide_regex(*line), elem_hide_scanner(*line)) << *line;
+    ASSERT_EQ(elem_hide_regex(normalized), elem_hide_scanner(normalized)) << *line;
+
+    // The in-place variant classifies without parsing the text again
+    std::string text = *line;
+    Filter::ElemHideParts parts;
+    FILTER_TYPE type = Filter::normalize(text, parts);
+    ASSERT_EQ(normalized, text) << *line;
+    if (type == ELEM_HIDE_BASE) {
+      ASSERT_EQ(elem_hide_regex(normalized), elem_hide_parts(parts)) << *line;
+    } else if (type == REGEXP_FILTER) {
+      ASSERT_EQ("", elem_hide_regex(normalized)) << *line;
+    } else {
+      ASSERT_EQ('!', text[0]) << *line;
+    }
+  }
+}
+
+TEST(FilterTest, ParseBenchmark) {
+  std::vector<std::string> lines = test_util::read_lines("easylist.txt");
+  if (lines.size() == 0) {
+    std::cout << "easylist.txt not found, skipping benchmark" << std::endl;
+    return;
+  }
+
+  uint32_t regex_elem_hide = 0;
+  test_util::Timer regex_timer;
+  for (auto line = lines.begin(); line != lines.end(); ++line) {
+    std::string text = normalize_regex(*line);
+    if (text.length() > 0 && text[0] != '!' && text.find('#') != std::string::npos) {
+      boost::smatch match;
+      regex_elem_hide += boost::regex_search(text, match, Filter::ElemHideRegex) ? 1 : 0;
+    }
+  }
+  double regex_us = regex_timer.elapsed_us();
+
+  uint32_t scanner_elem_hide = 0;
+  test_util::Timer scanner_timer;
+  for (auto line = lines.begin(); line != lines.end(); ++line) {
+    std::string text = Filter::normalize(*line);
+    if (text.length() > 0 && text[0] != '!' && text.find('#') != std::string::npos) {
+      Filter::ElemHideParts parts;
+      scanner_elem_hide += Filter::parse_elem_hide(text, parts) ? 1 : 0;
+    }
+  }
+  double scanner_us = scanner_timer.elapsed_us();
+  EXPECT_EQ(regex_elem_hide, scanner_elem_hide);
+
+  // Whole parse, including the filters themselves
+  Filter::known_filters_.clear();
+  test_util::Timer parse_timer;
+  for (auto line = lines.begin(); line != lines.end(); ++line) {
+    Filter::from_text(*line);
+  }
+  double parse_us = parse_timer.elapsed_us();
+
+  std::cout << std::dec << lines.size() << " lines, " << scanner_elem_hide
+    << " element hiding" << std::endl
+    << "normalize + classify, regex:   " << lines.size() * 1e6 / regex_us
+    << " lines/s" << std::endl
+    << "normalize + classify, scanner: " << lines.size() * 1e6 / scanner_us
+    << " lines/s, x" << regex_us / scanner_us << std::endl
+    << "Filter::from_text:             " << lines.size() * 1e6 / parse_us
+    << " lines/s" << std::endl;
+}
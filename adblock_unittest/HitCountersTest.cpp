@@ -0,0 +1,64 @@
+#include "../adblock/HitCounters.h"
+#include "../adblock/Engine.h"
+
+#include <boost/thread.hpp>
+#include <gtest/gtest.h>
+
+using namespace NS_ADBLOCK;
+
+
+namespace {
+
+  void match_times(const Engine *engine, const std::string *url, uint32_t count) {
+    Request request(*url, TYPE_IMAGE, "example.com", true);
+    for (uint32_t idx = 0; idx < count; ++idx) {
+      engine->matches_any(request);
+    }
+  }
+
+}
+
+TEST(HitCountersTest, CountsAcrossThreads) {
+  std::vector<std::string> lines;
+  lines.push_back("||hits.example.com^$image");
+  lines.push_back("@@||hits.example.com/ok^");
+  lines.push_back("||never.example.com^");
+  EnginePtr engine = Engine::from_lines(lines);
+  auto blocking = boost::dynamic_pointer_cast<ActiveFilter>(Filter::from_text(lines[0]));
+  auto exception = boost::dynamic_pointer_cast<ActiveFilter>(Filter::from_text(lines[1]));
+  auto never = boost::dynamic_pointer_cast<ActiveFilter>(Filter::from_text(lines[2]));
+  ASSERT_TRUE(blocking != nullptr && exception != nullptr && never != nullptr);
+  EXPECT_NE(blocking->get_id(), exception->get_id());
+
+  HitCounters::aggregate();
+  uint64_t blocking_before = HitCounters::get_hit_count(blocking->get_id());
+  uint64_t exception_before = HitCounters::get_hit_count(exception->get_id());
+  size_t shards_before = HitCounters::get_shard_count();
+
+  std::string blocked_url = "http://hits.example.com/ad.png";
+  std::string allowed_url = "http://hits.example.com/ok/ad.png";
+  boost::thread_group threads;
+  for (uint32_t idx = 0; idx < 4; ++idx) {
+    threads.create_thread(boost::bind(&match_times, engine.get(), &blocked_url, 1000));
+  }
+  threads.create_thread(boost::bind(&match_times, engine.get(), &allowed_url, 10));
+  threads.join_all();
+  // Finished threads leave their counts but not their shards
+  EXPECT_EQ(shards_before, HitCounters::get_shard_count());
+
+  {
+    // Stopping the aggregator folds the hits of the finished threads
+    HitAggregator aggregator(10000);
+  }
+  EXPECT_EQ(blocking_before + 4000, HitCounters::get_hit_count(blocking->get_id()));
+  EXPECT_EQ(exception_before + 10, HitCounters::get_hit_count(exception->get_id()));
+  EXPECT_EQ(0u, HitCounters::get_hit_count(never->get_id()));
+  EXPECT_GT(HitCounters::get_last_hit(blocking->get_id()), 0);
+  EXPECT_EQ(0, HitCounters::get_last_hit(never->get_id()));
+
+  HitCounters::export_to(engine->get_filters());
+  EXPECT_EQ(HitCounters::get_hit_count(blocking->get_id()), blocking->get_hit_count());
+  EXPECT_EQ(HitCounters::get_last_hit(blocking->get_id()), blocking->get_last_hit());
+  EXPECT_EQ(0u, never->get_hit_count());
+  EXPECT_FALSE(never->get_disabled());
+}
@@ -0,0 +1,100 @@
+#include "../adblock/HostTable.h"
+#include "../adblock/Matcher.h"
+
+#include <gtest/gtest.h>
+
+using namespace NS_ADBLOCK;
+
+
+namespace {
+
+  RegExpFilterPtr regexp_filter(const std::string &text) {
+    return boost::dynamic_pointer_cast<RegExpFilter>(Filter::from_text(text));
+  }
+
+}
+
+TEST(HostTableTest, GetHost) {
+  EXPECT_EQ("ads.example.com", HostTable::get_host(*regexp_filter("||ads.example.com^")));
+  EXPECT_EQ("ads.example.com", HostTable::get_host(*regexp_filter("||Ads.Example.com^$image,third-party")));
+  EXPECT_EQ("ads.example.com", HostTable::get_host(*regexp_filter("@@||ads.example.com^$domain=x.com")));
+  EXPECT_EQ("", HostTable::get_host(*regexp_filter("||ads.example.com")));
+  EXPECT_EQ("", HostTable::get_host(*regexp_filter("||ads.example.com/")));
+  // An anchor after the placeholder is dropped by the pattern
+  EXPECT_EQ("ads.example.com", HostTable::get_host(*regexp_filter("||ads.example.com^|")));
+  EXPECT_EQ("", HostTable::get_host(*regexp_filter("||ads.example.com|")));
+  EXPECT_EQ("", HostTable::get_host(*regexp_filter("||ads.*.com^")));
+  EXPECT_EQ("", HostTable::get_host(*regexp_filter("||ads.example.com^$match-case")));
+  EXPECT_EQ("", HostTable::get_host(*regexp_filter("|http://ads.example.com^")));
+  EXPECT_EQ("", HostTable::get_host(*regexp_filter("/ads\\.example\\.com/")));
+}
+
+TEST(HostTableTest, SameAsPattern) {
+  const char *hosts[] = { "example.com", "ads.example.com", "com", "b", "a.b" };
+  const char *urls[] = {
+    "http://example.com/", "https://ads.example.com:8080/x", "http://ADS.Example.COM",
+    "http://example.community/", "http://notexample.com/", "http://x.ads.example.com?q",
+    "http://example.com.evil.org/", "http://user@example.com/", "http://a.b?c.example.com/",
+    "http://.example.com/", "http://x..example.com/", "http:example.com/", "example.com",
+    "http://x.com/ads.example.com/", "ftp://a.b/", "http://a.b_c/", "http://a-b.example.com/"
+  };
+  Request request;
+  for (size_t host = 0; host < sizeof(hosts) / sizeof(hosts[0]); ++host) {
+    std::string text = std::string("||") + hosts[host] + "^";
+    auto filter = regexp_filter(text);
+    ASSERT_EQ(hosts[host], HostTable::get_host(*filter));
+    HostTable table;
+    table.add(hosts[host], filter);
+    for (size_t url = 0; url < sizeof(urls) / sizeof(urls[0]); ++url) {
+      request.set_location(urls[url]);
+      EXPECT_EQ(filter->get_pattern().matches(urls[url]),
+        table.matches_any(request, DomainMatches()) != nullptr) << text << " " << urls[url];
+    }
+  }
+}
+
+TEST(HostTableTest, Matcher) {
+  Matcher matcher;
+  auto image = regexp_filter("||ads.example.com^$image");
+  auto scoped = regexp_filter("||track.example.com^$domain=news.com");
+  auto banner = regexp_filter("/banner/*.gif");
+  matcher.add(image);
+  matcher.add(scoped);
+  matcher.add(banner);
+  EXPECT_TRUE(matcher.has_filter(image));
+  // Still the keyword it would use in a bucket
+  EXPECT_NE("", matcher.get_keyword(image));
+  EXPECT_EQ(2u, matcher.get_bucket_stats().by_host);
+  EXPECT_EQ(1u, matcher.get_bucket_stats().buckets);
+
+  EXPECT_EQ(image, matcher.matches_any("http://cdn.ads.example.com/a.png", "IMAGE", "", false));
+  EXPECT_TRUE(matcher.matches_any("http://cdn.ads.example.com/a.js", "SCRIPT", "", false) == nullptr);
+  EXPECT_EQ(scoped, matcher.matches_any("http://track.example.com/p", "SCRIPT", "news.com", false));
+  EXPECT_TRUE(matcher.matches_any("http://track.example.com/p", "SCRIPT", "other.com", false) == nullptr);
+  EXPECT_EQ(banner, matcher.matches_any("http://x.com/banner/a.gif", "IMAGE", "", false));
+
+  matcher.rebalance();
+  EXPECT_EQ(image, matcher.matches_any("http://ads.example.com/a.png", "IMAGE", "", false));
+
+  Matcher copy = matcher;
+  matcher.remove(regexp_filter("||ads.example.com^$image"));
+  EXPECT_FALSE(matcher.has_filter(image));
+  EXPECT_TRUE(matcher.matches_any("http://ads.example.com/a.png", "IMAGE", "", false) == nullptr);
+  EXPECT_EQ(1u, matcher.get_bucket_stats().by_host);
+  EXPECT_EQ(image, copy.matches_any("http://ads.example.com/a.png", "IMAGE", "", false));
+}
+
+TEST(HostTableTest, NotSlow) {
+  CombindMatcher matcher;
+  // Too short for a keyword, would be tested against every URL in a bucket
+  auto host = regexp_filter("||ab.cd^");
+  auto generic = regexp_filter("ab.cd");
+  EXPECT_FALSE(matcher.is_slow_filter(host));
+  EXPECT_TRUE(matcher.is_slow_filter(generic));
+
+  matcher.add(host);
+  matcher.add(generic);
+  EXPECT_EQ("", matcher.get_keyword(host));
+  EXPECT_FALSE(matcher.is_slow_filter(host));
+  EXPECT_TRUE(matcher.is_slow_filter(generic));
+}
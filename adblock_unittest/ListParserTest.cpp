@@ -0,0 +1,125 @@
+#include "../adblock/ListParser.h"
+#include "../adblock/Engine.h"
+#include "TestUtil.h"
+
+#include <iostream>
+#include <boost/thread.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/algorithm/string/split.hpp>
+#include <boost/algorithm/string/classification.hpp>
+#include <gtest/gtest.h>
+
+using namespace NS_ADBLOCK;
+
+
+namespace {
+
+  std::string join_lines(const std::vector<std::string> &lines) {
+    std::string buffer;
+    for (auto iter = lines.begin(); iter != lines.end(); ++iter) {
+      buffer += *iter;
+      buffer += '\n';
+    }
+    return buffer;
+  }
+
+  std::vector<std::string> texts(const std::vector<FilterPtr> &filters) {
+    std::vector<std::string> result;
+    for (auto iter = filters.begin(); iter != filters.end(); ++iter) {
+      result.push_back((*iter)->get_text());
+    }
+    return result;
+  }
+
+}
+
+TEST(ListParserTest, SameAsSerial) {
+  std::string buffer = "[Adblock Plus 2.0]\r\n! Title: test\r\n||ads.example.com^\r\n"
+    "\r\n/banner/*.gif\n##.ad\n||ads.example.com^\n  -ad-$domain=example.com  \n"
+    "@@||ads.example.com/allowed^\n/\\/pop[0-9]+\\.js/$script\n##.ad";
+
+  std::vector<FilterPtr> serial;
+  std::vector<std::string> lines;
+  boost::split(lines, buffer, boost::is_any_of("\n"));
+  for (auto iter = lines.begin(); iter != lines.end(); ++iter) {
+    FilterPtr filter = Filter::from_text(*iter);
+    if (filter != nullptr) {
+      serial.push_back(filter);
+    }
+  }
+  ASSERT_EQ(10u, serial.size());
+
+  const uint32_t thread_counts[] = { 1, 2, 3, 8 };
+  for (uint32_t idx = 0; idx < sizeof(thread_counts) / sizeof(thread_counts[0]); ++idx) {
+    std::vector<FilterPtr> parallel = ListParser::parse(buffer, thread_counts[idx]);
+    EXPECT_TRUE(parallel == serial) << thread_counts[idx] << " threads";
+  }
+
+  // Duplicates are the same filter
+  Filter::known_filters_.clear();
+  std::vector<FilterPtr> parallel = ListParser::parse(buffer, 4);
+  EXPECT_TRUE(texts(parallel) == texts(serial));
+  ASSERT_EQ(10u, parallel.size());
+  EXPECT_EQ(parallel[2], parallel[5]);
+  EXPECT_EQ(parallel[4], parallel[9]);
+}
+
+TEST(ListParserTest, ConcurrentRegistry) {
+  Filter::known_filters_.clear();
+  std::vector<std::string> lines;
+  for (uint32_t idx = 0; idx < 500; ++idx) {
+    lines.push_back("/path" + boost::lexical_cast<std::string>(idx % 100) + "/ad.");
+  }
+  std::string buffer = join_lines(lines);
+
+  // Every thread parses the whole list, all of them have to agree
+  std::vector<std::vector<FilterPtr> > results(4);
+  boost::thread_group threads;
+  for (uint32_t idx = 0; idx < results.size(); ++idx) {
+    std::vector<FilterPtr> *result = &results[idx];
+    threads.create_thread([&buffer, result]() {
+      *result = ListParser::parse(buffer, 2);
+    });
+  }
+  threads.join_all();
+
+  EXPECT_EQ(100u, Filter::known_filters_.size());
+  for (uint32_t idx = 1; idx < results.size(); ++idx) {
+    EXPECT_TRUE(results[idx] == results[0]);
+  }
+}
+
+TEST(ListParserTest, Benchmark) {
+  std::vector<std::string> lines = test_util::read_lines("easylist.txt");
+  if (lines.size() == 0) {
+    std::cout << "easylist.txt not found, skipping benchmark" << std::endl;
+    return;
+  }
+  std::string buffer = join_lines(lines);
+
+  Filter::known_filters_.clear();
+  test_util::Timer serial_timer;
+  std::vector<FilterPtr> serial;
+  for (auto iter = lines.begin(); iter != lines.end(); ++iter) {
+    FilterPtr filter = Filter::from_text(*iter);
+    if (filter != nullptr) {
+      serial.push_back(filter);
+    }
+  }
+  double serial_us = serial_timer.elapsed_us();
+  std::vector<std::string> expected = texts(serial);
+
+  std::cout << std::dec << lines.size() << " lines, "
+    << boost::thread::hardware_concurrency() << " cores" << std::endl
+    << "serial:    " << serial_us / 1000 << " ms" << std::endl;
+  const uint32_t thread_counts[] = { 1, 2, 4, 8 };
+  for (uint32_t idx = 0; idx < sizeof(thread_counts) / sizeof(thread_counts[0]); ++idx) {
+    Filter::known_filters_.clear();
+    test_util::Timer timer;
+    std::vector<FilterPtr> parallel = ListParser::parse(buffer, thread_counts[idx]);
+    double elapsed_us = timer.elapsed_us();
+    EXPECT_TRUE(texts(parallel) == expected) << thread_counts[idx] << " threads";
+    std::cout << thread_counts[idx] << " threads: " << elapsed_us / 1000
+      << " ms, x" << serial_us / elapsed_us << std::endl;
+  }
+}
@@ -0,0 +1,126 @@
+#include "../adblock/ListUpdate.h"
+#include "TestUtil.h"
+
+#include <gtest/gtest.h>
+
+using namespace NS_ADBLOCK;
+
+
+namespace {
+
+  std::vector<std::string> split_lines(const char *const *lines, size_t count) {
+    return std::vector<std::string>(lines, lines + count);
+  }
+
+  void load(CombindMatcher &matcher, ElemHide &elem_hide,
+    const std::vector<std::string> &lines)
+  {
+    for (auto iter = lines.begin(); iter != lines.end(); ++iter) {
+      FilterPtr filter = Filter::from_text(*iter);
+      if (filter == nullptr) {
+        continue;
+      }
+      if (filter->get_type() == BLOCKING_FILTER || filter->get_type() == WHITELIST_FILTER) {
+        matcher.add(boost::static_pointer_cast<RegExpFilter>(filter));
+      } else if (filter->get_type() == ELEM_HIDE_FILTER ||
+        filter->get_type() == ELEM_HIDE_EXCEPTION)
+      {
+        elem_hide.add(boost::static_pointer_cast<ElemHideBase>(filter));
+      }
+    }
+  }
+
+}
+
+TEST(ListUpdateTest, Diff) {
+  const char *old_lines[] = { "! Version 1", "||ads.example.com^", "/banner/*",
+    "##.ad", "||track.example.com^" };
+  const char *new_lines[] = { "! Version 2", "||ads.example.com^", " /banner/* ",
+    "##.sponsor", "@@||ads.example.com/ok^", "@@||ads.example.com/ok^" };
+
+  ListUpdate::Diff diff = ListUpdate::diff(split_lines(old_lines, 5),
+    split_lines(new_lines, 6));
+  ASSERT_EQ(2u, diff.removed.size());
+  EXPECT_EQ("##.ad", diff.removed[0]->get_text());
+  EXPECT_EQ("||track.example.com^", diff.removed[1]->get_text());
+  ASSERT_EQ(2u, diff.added.size());
+  EXPECT_EQ("##.sponsor", diff.added[0]->get_text());
+  EXPECT_EQ("@@||ads.example.com/ok^", diff.added[1]->get_text());
+}
+
+TEST(ListUpdateTest, DiffKeepsRespelledFilters) {
+  const char *old_lines[] = { "||a.com^", "||a.com^ ", "||b.com^" };
+  const char *new_lines[] = { "||a.com^", " ||b.com^", "||b.com^\t" };
+
+  ListUpdate::Diff diff = ListUpdate::diff(split_lines(old_lines, 3),
+    split_lines(new_lines, 3));
+  EXPECT_EQ(0u, diff.removed.size());
+  EXPECT_EQ(0u, diff.added.size());
+
+  diff = ListUpdate::diff(split_lines(new_lines, 3), split_lines(old_lines, 3));
+  EXPECT_EQ(0u, diff.removed.size());
+  EXPECT_EQ(0u, diff.added.size());
+
+  CombindMatcher matcher;
+  ElemHide elem_hide;
+  load(matcher, elem_hide, split_lines(old_lines, 3));
+  ListUpdate::apply(matcher, elem_hide, split_lines(old_lines, 3), split_lines(new_lines, 3));
+  EXPECT_TRUE(matcher.matches_any("http://a.com/x", TYPE_SCRIPT, "", false) != nullptr);
+  EXPECT_TRUE(matcher.matches_any("http://b.com/x", TYPE_SCRIPT, "", false) != nullptr);
+}
+
+TEST(ListUpdateTest, SameAsReload) {
+  const char *old_lines[] = { "||ads.example.com^", "/banner/*", "##.ad",
+    "||track.example.com^", "example.com#@#.ad" };
+  const char *new_lines[] = { "||ads.example.com^", "/banner/*", "##.sponsor",
+    "@@||ads.example.com/ok^", "example.com#@#.ad", "||other.example.com^$image" };
+  std::vector<std::string> old_list = split_lines(old_lines, 5);
+  std::vector<std::string> new_list = split_lines(new_lines, 6);
+
+  CombindMatcher matcher;
+  ElemHide elem_hide;
+  load(matcher, elem_hide, old_list);
+
+  const char *urls[] = { "http://ads.example.com/x", "http://ads.example.com/ok/x",
+    "http://track.example.com/pixel", "http://cdn.example.org/banner/1.gif",
+    "http://other.example.com/a.png", "http://www.example.org/" };
+  const uint32_t url_count = sizeof(urls) / sizeof(urls[0]);
+  for (uint32_t idx = 0; idx < url_count; ++idx) {
+    matcher.matches_any(urls[idx], TYPE_IMAGE, "example.org", true);
+  }
+
+  ListUpdate::Stats stats = ListUpdate::apply(matcher, elem_hide, old_list, new_list);
+  EXPECT_EQ(2u, stats.removed);
+  EXPECT_EQ(3u, stats.added);
+  // Dropped: the result of ||track.example.com^ and the requests matched
+  // by the exception and by the new image filter
+  EXPECT_EQ(3u, stats.invalidated);
+  EXPECT_GE(stats.elapsed.count(), 0);
+
+  CombindMatcher reloaded_matcher;
+  ElemHide reloaded_elem_hide;
+  load(reloaded_matcher, reloaded_elem_hide, new_list);
+  for (uint32_t idx = 0; idx < url_count; ++idx) {
+    EXPECT_EQ(reloaded_matcher.matches_any(urls[idx], TYPE_IMAGE, "example.org", true),
+      matcher.matches_any(urls[idx], TYPE_IMAGE, "example.org", true)) << urls[idx];
+  }
+  EXPECT_EQ(reloaded_elem_hide.get_selectors("example.com", false),
+    elem_hide.get_selectors("example.com", false));
+  EXPECT_EQ(reloaded_elem_hide.get_selectors("example.org", false),
+    elem_hide.get_selectors("example.org", false));
+}
+
+TEST(ListUpdateTest, RemoveKeepsBucket) {
+  CombindMatcher matcher;
+  auto first = boost::dynamic_pointer_cast<RegExpFilter>(Filter::from_text("/banner/ad1"));
+  auto second = boost::dynamic_pointer_cast<RegExpFilter>(Filter::from_text("/banner/ad2"));
+  matcher.add(first);
+  matcher.add(second);
+  ASSERT_EQ(matcher.get_keyword(first), matcher.get_keyword(second));
+
+  matcher.remove(first);
+  EXPECT_FALSE(matcher.has_filter(first));
+  EXPECT_TRUE(matcher.has_filter(second));
+  EXPECT_EQ(second, matcher.matches_any("http://x.com/banner/ad2", TYPE_IMAGE, "x.com", false));
+  EXPECT_EQ(nullptr, matcher.matches_any("http://x.com/banner/ad1", TYPE_IMAGE, "x.com", false));
+}
@@ -0,0 +1,335 @@
+#include "../adblock/Matcher.h"
+#include "TestUtil.h"
+
+#include <iostream>
+#include <boost/lexical_cast.hpp>
+#include <gtest/gtest.h>
+
+using namespace NS_ADBLOCK;
+
+
+namespace {
+
+  RegExpFilterPtr regexp_filter(const std::string &text) {
+    return boost::dynamic_pointer_cast<RegExpFilter>(Filter::from_text(text));
+  }
+
+  std::vector<RegExpFilterPtr> easylist_regexp_filters() {
+    std::vector<RegExpFilterPtr> result;
+    auto filters = test_util::load_easylist();
+    for (auto iter = filters.begin(); iter != filters.end(); ++iter) {
+      auto filter = boost::dynamic_pointer_cast<RegExpFilter>(*iter);
+      if (filter != nullptr) {
+        result.push_back(filter);
+      }
+    }
+    return result;
+  }
+
+}
+
+TEST(MatcherTest, TokenHashes) {
+  // Buckets are probed with the hashes of the tokenizer
+  Request request("http://AdServer.example.com/ads/banners/xads", TYPE_OTHER, "", false);
+  ASSERT_EQ(7u, request.get_token_count());
+  for (uint32_t idx = 0; idx < request.get_token_count(); ++idx) {
+    EXPECT_EQ(KeywordHash()(request.get_token(idx)), request.get_token_hash(idx));
+  }
+
+  Matcher matcher;
+  auto filter = regexp_filter("/banners/*$image");
+  matcher.add(filter);
+  EXPECT_EQ("banners", matcher.get_keyword(filter));
+  EXPECT_EQ(filter, matcher.matches_any("http://x.com/BANNERS/a.gif", TYPE_IMAGE, "", false));
+  EXPECT_TRUE(matcher.matches_any("http://x.com/banner/s/a.gif", TYPE_IMAGE, "", false) == nullptr);
+}
+
+TEST(MatcherTest, KeywordBuckets) {
+  Matcher matcher;
+  auto banner = regexp_filter("/banner/*.gif");
+  auto host = regexp_filter("||ads.example.com^");
+  auto any = regexp_filter("*&ad=");
+  matcher.add(banner);
+  matcher.add(host);
+  matcher.add(any);
+
+  EXPECT_EQ("banner", matcher.get_keyword(banner));
+  EXPECT_EQ("", matcher.get_keyword(any));
+  EXPECT_EQ(banner, matcher.matches_any("http://x.com/banner/a.gif", "IMAGE", "", false));
+  EXPECT_EQ(host, matcher.matches_any("http://ads.example.com/x.js", "SCRIPT", "", false));
+  EXPECT_EQ(any, matcher.matches_any("http://x.com/?q=1&ad=2", "SCRIPT", "", false));
+  EXPECT_TRUE(matcher.matches_any("http://x.com/banners/a.gif", "IMAGE", "", false) == nullptr);
+
+  Matcher copy = matcher;
+  matcher.clear();
+  EXPECT_EQ(banner, copy.matches_any("http://x.com/banner/a.gif", "IMAGE", "", false));
+  EXPECT_TRUE(matcher.matches_any("http://x.com/banner/a.gif", "IMAGE", "", false) == nullptr);
+}
+
+TEST(MatcherTest, RemoveFromBucket) {
+  Matcher matcher;
+  std::vector<RegExpFilterPtr> filters;
+  for (uint32_t idx = 0; idx < 1000; ++idx) {
+    filters.push_back(regexp_filter("/banner/*ad" + boost::lexical_cast<std::string>(idx) + "."));
+    matcher.add(filters.back());
+  }
+  ASSERT_EQ("banner", matcher.get_keyword(filters[999]));
+
+  // Every other filter goes, the neighbours keep matching through the
+  // compactions of the bucket
+  for (uint32_t idx = 0; idx < filters.size(); idx += 2) {
+    matcher.remove(filters[idx]);
+  }
+  for (uint32_t idx = 0; idx < filters.size(); ++idx) {
+    std::string url = "http://x.com/banner/ad" + boost::lexical_cast<std::string>(idx) + ".gif";
+    auto result = matcher.matches_any(url, "IMAGE", "", false);
+    EXPECT_EQ(idx % 2 == 0 ? nullptr : filters[idx], result) << url;
+    EXPECT_EQ(idx % 2 != 0, matcher.has_filter(filters[idx]));
+  }
+
+  // Removed filters can come back
+  matcher.add(filters[0]);
+  EXPECT_EQ(filters[0], matcher.matches_any("http://x.com/banner/ad0.gif", "IMAGE", "", false));
+
+  for (uint32_t idx = 0; idx < filters.size(); ++idx) {
+    matcher.remove(filters[idx]);
+  }
+  EXPECT_EQ("", matcher.get_keyword(filters[1]));
+  EXPECT_TRUE(matcher.matches_any("http://x.com/banner/ad1.gif", "IMAGE", "", false) == nullptr);
+}
+
+TEST(MatcherTest, Prefilter) {
+  Matcher matcher;
+  std::vector<RegExpFilterPtr> filters;
+  for (uint32_t idx = 0; idx < 2000; ++idx) {
+    filters.push_back(regexp_filter("/kw" + boost::lexical_cast<std::string>(idx) + "/*"));
+    matcher.add(filters.back());
+  }
+  ASSERT_EQ("kw1999", matcher.get_keyword(filters[1999]));
+  // Grown with the keywords, the false positive rate stays low
+  EXPECT_GE(matcher.get_prefilter().get_capacity(), 2000u);
+
+  uint32_t passed = 0;
+  for (uint32_t idx = 0; idx < 10000; ++idx) {
+    std::string token = "other" + boost::lexical_cast<std::string>(idx);
+    passed += matcher.get_prefilter().may_contain(
+      Tokenizer::hash(token.data(), token.data() + token.length())) ? 1 : 0;
+  }
+  EXPECT_LT(passed, 1000u);
+
+  for (uint32_t idx = 0; idx < filters.size(); ++idx) {
+    std::string keyword = "kw" + boost::lexical_cast<std::string>(idx);
+    EXPECT_TRUE(matcher.get_prefilter().may_contain(
+      Tokenizer::hash(keyword.data(), keyword.data() + keyword.length())));
+  }
+
+  // Removing most keywords rebuilds it smaller, the rest still match
+  for (uint32_t idx = 100; idx < filters.size(); ++idx) {
+    matcher.remove(filters[idx]);
+  }
+  EXPECT_LT(matcher.get_prefilter().get_capacity(), 2000u);
+  for (uint32_t idx = 0; idx < filters.size(); idx += 50) {
+    std::string url = "http://x.com/kw" + boost::lexical_cast<std::string>(idx) + "/a.gif";
+    EXPECT_EQ(idx < 100 ? filters[idx] : nullptr,
+      matcher.matches_any(url, "IMAGE", "", false)) << url;
+  }
+  EXPECT_EQ(filters[7], matcher.check_entry_match("kw7",
+    Request("http://x.com/kw7/", TYPE_IMAGE, "", false)));
+  EXPECT_TRUE(matcher.check_entry_match("kw700",
+    Request("http://x.com/kw700/", TYPE_IMAGE, "", false)) == nullptr);
+}
+
+TEST(MatcherTest, Rebalance) {
+  Matcher matcher;
+  auto both = regexp_filter("/foo/bar/*");
+  auto foo = regexp_filter("/foo/*");
+  auto sample = regexp_filter("/abc/def/*");
+  matcher.add(both);
+  matcher.add(foo);
+  matcher.add(sample);
+  ASSERT_EQ("foo", matcher.get_keyword(both));
+  ASSERT_EQ("abc", matcher.get_keyword(sample));
+
+  std::vector<std::string> urls;
+  urls.push_back("http://x.com/abc/1.gif");
+  urls.push_back("http://x.com/abc/2.gif");
+  Matcher::RebalanceStats stats = matcher.rebalance(urls);
+
+  // The filter that can only use foo gets it alone, the sample URLs
+  // make abc more expensive than def
+  EXPECT_EQ("bar", matcher.get_keyword(both));
+  EXPECT_EQ("foo", matcher.get_keyword(foo));
+  EXPECT_EQ("def", matcher.get_keyword(sample));
+  EXPECT_EQ(2u, stats.before.buckets);
+  EXPECT_EQ(2u, stats.before.largest);
+  EXPECT_EQ(1u, stats.before.histogram[0]);
+  EXPECT_EQ(1u, stats.before.histogram[1]);
+  EXPECT_EQ(1.0, stats.before.expected_checks);
+  EXPECT_EQ(3u, stats.after.buckets);
+  EXPECT_EQ(1u, stats.after.largest);
+  ASSERT_EQ(1u, stats.after.histogram.size());
+  EXPECT_EQ(3u, stats.after.histogram[0]);
+  EXPECT_EQ(0.0, stats.after.expected_checks);
+
+  EXPECT_EQ(foo, matcher.matches_any("http://x.com/foo/a.gif", "IMAGE", "", false));
+  EXPECT_EQ(sample, matcher.matches_any("http://x.com/abc/def/a.gif", "IMAGE", "", false));
+}
+
+TEST(MatcherTest, SameAsFullScan) {
+  auto filters = easylist_regexp_filters();
+  if (filters.size() == 0) {
+    std::cout << "easylist.txt not found, skipping test" << std::endl;
+    return;
+  }
+
+  CombindMatcher matcher;
+  std::vector<RegExpFilterPtr> whitelist;
+  std::vector<RegExpFilterPtr> blacklist;
+  for (auto iter = filters.begin(); iter != filters.end(); ++iter) {
+    matcher.add(*iter);
+    if ((*iter)->get_type() == WHITELIST_FILTER) {
+      whitelist.push_back(*iter);
+    } else {
+      blacklist.push_back(*iter);
+    }
+  }
+
+  auto urls = test_util::load_urls();
+  if (urls.size() > 300) {
+    urls.resize(300);
+  }
+  const char *types[] = { "SCRIPT", "IMAGE", "SUBDOCUMENT" };
+  for (auto url = urls.begin(); url != urls.end(); ++url) {
+    for (uint32_t idx = 0; idx < 3; ++idx) {
+      bool whitelisted = false;
+      bool blocked = false;
+      for (auto iter = whitelist.begin(); iter != whitelist.end() && !whitelisted; ++iter) {
+        whitelisted = (*iter)->matches(*url, types[idx], "", true);
+      }
+      for (auto iter = blacklist.begin(); iter != blacklist.end() && !blocked; ++iter) {
+        blocked = (*iter)->matches(*url, types[idx], "", true);
+      }
+
+      auto result = matcher.matches_any(*url, types[idx], "", true);
+      if (whitelisted) {
+        ASSERT_TRUE(result != nullptr) << *url;
+        EXPECT_EQ(WHITELIST_FILTER, result->get_type()) << *url;
+      } else if (blocked) {
+        ASSERT_TRUE(result != nullptr) << *url;
+        EXPECT_EQ(BLOCKING_FILTER, result->get_type()) << *url;
+      } else {
+        EXPECT_TRUE(result == nullptr) << *url;
+      }
+    }
+  }
+}
+
+TEST(MatcherTest, ContentTypeMask) {
+  EXPECT_EQ(TYPE_SCRIPT, RegExpFilter::get_content_type("SCRIPT"));
+  EXPECT_EQ(0, RegExpFilter::get_content_type("UNKNOWN"));
+
+  auto filter = regexp_filter("/adscript.$script,stylesheet");
+  EXPECT_TRUE(filter->matches("http://x.com/adscript.js", TYPE_SCRIPT, "", false));
+  EXPECT_TRUE(filter->matches("http://x.com/adscript.js", TYPE_STYLESHEET, "", false));
+  EXPECT_FALSE(filter->matches("http://x.com/adscript.js", TYPE_IMAGE, "", false));
+  EXPECT_FALSE(filter->matches("http://x.com/adscript.js", "UNKNOWN", "", false));
+
+  CombindMatcher matcher;
+  matcher.add(filter);
+  EXPECT_EQ(filter, matcher.matches_any("http://x.com/adscript.js", TYPE_SCRIPT, "", false));
+  EXPECT_TRUE(matcher.matches_any("http://x.com/adscript.js", TYPE_IMAGE, "", false) == nullptr);
+  EXPECT_EQ(filter, matcher.matches_any("http://x.com/adscript.js", "SCRIPT", "", false));
+}
+
+TEST(ResultCacheTest, HitsMissesEvictions) {
+  ResultCache cache(8);
+  EXPECT_EQ(8u, cache.get_capacity());
+
+  auto filter = regexp_filter("/cached/ad.");
+  std::vector<std::string> urls;
+  for (uint32_t idx = 0; idx < 64; ++idx) {
+    urls.push_back("http://example.com/" + std::string(1, 'a' + idx % 26) +
+      std::string(idx / 26 + 1, 'x'));
+  }
+
+  RegExpFilterPtr result;
+  Request request(urls[0], TYPE_SCRIPT, "example.com", false);
+  EXPECT_FALSE(cache.find(request, result));
+  cache.insert(request, filter);
+  EXPECT_TRUE(cache.find(request, result));
+  EXPECT_EQ(filter, result);
+
+  // Same URL with another part of the tuple is a different entry
+  Request other(urls[0], TYPE_IMAGE, "example.com", false);
+  EXPECT_FALSE(cache.find(other, result));
+  other.set_content_type(TYPE_SCRIPT);
+  other.set_doc_domain("example.org");
+  EXPECT_FALSE(cache.find(other, result));
+  EXPECT_EQ(1u, cache.get_hits());
+  EXPECT_EQ(3u, cache.get_misses());
+
+  // Filling the cache evicts entries one at a time
+  for (auto url = urls.begin(); url != urls.end(); ++url) {
+    request.set_location(*url);
+    cache.insert(request, nullptr);
+  }
+  EXPECT_EQ(64u - 8u, cache.get_evictions());
+
+  uint32_t cached = 0;
+  for (auto url = urls.begin(); url != urls.end(); ++url) {
+    request.set_location(*url);
+    cached += cache.find(request, result) ? 1 : 0;
+  }
+  EXPECT_EQ(8u, cached);
+
+  cache.clear();
+  request.set_location(urls.back());
+  EXPECT_FALSE(cache.find(request, result));
+}
+
+TEST(ResultCacheTest, CombindMatcherCounters) {
+  CombindMatcher matcher;
+  matcher.set_cache_capacity(16);
+  auto filter = regexp_filter("/cached/ad.");
+  matcher.add(filter);
+
+  EXPECT_EQ(filter, matcher.matches_any("http://x.com/cached/ad.js", TYPE_SCRIPT, "", false));
+  EXPECT_EQ(filter, matcher.matches_any("http://x.com/cached/ad.js", TYPE_SCRIPT, "", false));
+  EXPECT_EQ(1u, matcher.get_cache().get_hits());
+  EXPECT_EQ(1u, matcher.get_cache().get_misses());
+
+  matcher.remove(filter);
+  EXPECT_TRUE(matcher.matches_any("http://x.com/cached/ad.js", TYPE_SCRIPT, "", false) == nullptr);
+}
+
+TEST(ResultCacheTest, Disabled) {
+  CombindMatcher matcher(0);
+  EXPECT_EQ(0u, matcher.get_cache().get_capacity());
+  auto filter = regexp_filter("/cached/ad.");
+  matcher.add(filter);
+
+  EXPECT_EQ(filter, matcher.matches_any("http://x.com/cached/ad.js", TYPE_SCRIPT, "", false));
+  EXPECT_EQ(filter, matcher.matches_any("http://x.com/cached/ad.js", TYPE_SCRIPT, "", false));
+  EXPECT_EQ(0u, matcher.get_cache().get_hits());
+  EXPECT_EQ(0u, matcher.get_cache().get_misses());
+
+  matcher.set_cache_capacity(4);
+  EXPECT_EQ(filter, matcher.matches_any("http://x.com/cached/ad.js", TYPE_SCRIPT, "", false));
+  EXPECT_EQ(1u, matcher.get_cache().get_misses());
+}
+
+TEST(ResultCacheTest, UpdateRemovesByText) {
+  CombindMatcher matcher;
+  matcher.set_cache_capacity(16);
+  auto filter = regexp_filter("||ads.com^");
+  matcher.add(filter);
+  EXPECT_EQ(filter, matcher.matches_any("http://ads.com/x.js", TYPE_SCRIPT, "", false));
+
+  // The list update parses its own object for the same text
+  auto same_text = boost::dynamic_pointer_cast<RegExpFilter>(
+    RegExpFilter::from_text("||ads.com^"));
+  ASSERT_TRUE(same_text != nullptr);
+  ASSERT_NE(filter, same_text);
+  EXPECT_EQ(1u, matcher.update(CombindMatcher::Filters(1, same_text), CombindMatcher::Filters()));
+  EXPECT_TRUE(matcher.matches_any("http://ads.com/x.js", TYPE_SCRIPT, "", false) == nullptr);
+}
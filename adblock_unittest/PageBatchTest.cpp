@@ -0,0 +1,132 @@
+#include "../adblock/Engine.h"
+#include "TestUtil.h"
+
+#include <iostream>
+#include <gtest/gtest.h>
+
+using namespace NS_ADBLOCK;
+
+
+namespace {
+
+  /**
+   * Host name of a URL, used as document domain of the test pages
+   */
+  std::string host_of(const std::string &url) {
+    size_t begin = url.find("://");
+    begin = begin == std::string::npos ? 0 : begin + 3;
+    size_t end = url.find_first_of("/:?#", begin);
+    return url.substr(begin, end == std::string::npos ? std::string::npos : end - begin);
+  }
+
+  const CONTENT_TYPE PageTypes[] = { TYPE_SCRIPT, TYPE_IMAGE, TYPE_STYLESHEET,
+    TYPE_SUBDOCUMENT, TYPE_XMLHTTPREQUEST };
+
+  const uint32_t PageSize = 100;
+
+}
+
+TEST(PageBatchTest, SameAsSingleRequests) {
+  const char *lines[] = {
+    "||ads.example.com^", "/banner/*.gif", "-ad-$domain=example.com",
+    "@@||ads.example.com/allowed^", "@@/banner/*$domain=example.org",
+    "&ad=$script,third-party", "^track^$image"
+  };
+  std::vector<std::string> list(lines, lines + sizeof(lines) / sizeof(lines[0]));
+  std::vector<std::string> easylist = test_util::read_lines("easylist.txt");
+  list.insert(list.end(), easylist.begin(), easylist.end());
+  EnginePtr engine = Engine::from_lines(list);
+
+  std::vector<std::string> urls = test_util::load_urls();
+  const char *extra[] = {
+    "http://ads.example.com/x.js", "http://ads.example.com/allowed/x.js",
+    "http://cdn.com/banner/x.gif", "http://cdn.com/x-ad-y.js",
+    "http://cdn.com/?q=1&ad=2", "http://cdn.com/a/track/b"
+  };
+  urls.insert(urls.end(), extra, extra + sizeof(extra) / sizeof(extra[0]));
+
+  const char *doc_domains[] = { "www.example.com", "example.org.", "" };
+  PageBatch batch;
+  for (uint32_t page = 0; page < sizeof(doc_domains) / sizeof(doc_domains[0]); ++page) {
+    batch.reset(doc_domains[page]);
+    for (uint32_t idx = 0; idx < urls.size(); ++idx) {
+      batch.add(urls[idx], PageTypes[idx % 5], idx % 3 != 0);
+    }
+    engine->matches_page(batch);
+
+    ASSERT_EQ(urls.size(), batch.size());
+    for (uint32_t idx = 0; idx < urls.size(); ++idx) {
+      Request request(urls[idx], PageTypes[idx % 5], doc_domains[page], idx % 3 != 0);
+      EXPECT_EQ(engine->matches_any(request), batch.get_result(idx))
+        << urls[idx] << " on " << doc_domains[page];
+    }
+  }
+
+  // A smaller batch doesn't keep the results of the previous one
+  batch.reset("example.com");
+  batch.add(urls.back(), TYPE_SCRIPT, false);
+  engine->matches_page(batch);
+  EXPECT_EQ(1u, batch.size());
+  EXPECT_TRUE(batch.get_result(0) == nullptr);
+}
+
+TEST(PageBatchTest, Benchmark) {
+  std::vector<std::string> lines = test_util::read_lines("easylist.txt");
+  if (lines.size() == 0) {
+    std::cout << "easylist.txt not found, skipping benchmark" << std::endl;
+    return;
+  }
+  EnginePtr engine = Engine::from_lines(lines);
+  std::vector<std::string> urls = test_util::load_urls();
+  const uint32_t page_count = (static_cast<uint32_t>(urls.size()) + PageSize - 1) / PageSize;
+
+  // One Request per URL, as matches_any() with strings does
+  uint32_t single_blocked = 0;
+  test_util::Timer single_timer;
+  for (uint32_t page = 0; page < page_count; ++page) {
+    std::string doc_domain = host_of(urls[page * PageSize]);
+    for (uint32_t idx = page * PageSize; idx < urls.size() && idx < (page + 1) * PageSize; ++idx) {
+      Request request(urls[idx], PageTypes[idx % 5], doc_domain, true);
+      single_blocked += engine->matches_any(request) != nullptr ? 1 : 0;
+    }
+  }
+  double single_us = single_timer.elapsed_us();
+
+  // One reused Request
+  uint32_t reused_blocked = 0;
+  Request request;
+  test_util::Timer reused_timer;
+  for (uint32_t page = 0; page < page_count; ++page) {
+    request.set_doc_domain(host_of(urls[page * PageSize]));
+    request.set_third_party(true);
+    for (uint32_t idx = page * PageSize; idx < urls.size() && idx < (page + 1) * PageSize; ++idx) {
+      request.set_location(urls[idx]);
+      request.set_content_type(PageTypes[idx % 5]);
+      reused_blocked += engine->matches_any(request) != nullptr ? 1 : 0;
+    }
+  }
+  double reused_us = reused_timer.elapsed_us();
+
+  uint32_t batch_blocked = 0;
+  PageBatch batch;
+  test_util::Timer batch_timer;
+  for (uint32_t page = 0; page < page_count; ++page) {
+    batch.reset(host_of(urls[page * PageSize]));
+    for (uint32_t idx = page * PageSize; idx < urls.size() && idx < (page + 1) * PageSize; ++idx) {
+      batch.add(urls[idx], PageTypes[idx % 5], true);
+    }
+    engine->matches_page(batch);
+    for (uint32_t idx = 0; idx < batch.size(); ++idx) {
+      batch_blocked += batch.get_result(idx) != nullptr ? 1 : 0;
+    }
+  }
+  double batch_us = batch_timer.elapsed_us();
+  EXPECT_EQ(single_blocked, batch_blocked);
+  EXPECT_EQ(reused_blocked, batch_blocked);
+
+  std::cout << std::dec << page_count << " pages of " << PageSize << " urls" << std::endl
+    << "request per url: " << single_us / urls.size() << " us/url" << std::endl
+    << "reused request:  " << reused_us / urls.size() << " us/url" << std::endl
+    << "page batch:      " << batch_us / urls.size() << " us/url, x"
+    << single_us / batch_us << std::endl;
+}
@@ -0,0 +1,145 @@
+#include "../adblock/Filter.h"
+#include "TestUtil.h"
+
+#include <iostream>
+#include <gtest/gtest.h>
+
+using namespace NS_ADBLOCK;
+
+
+namespace {
+
+  bool pattern_matches(const std::string &source, const std::string &location,
+    bool match_case = false)
+  {
+    Pattern pattern;
+    pattern.compile(source, match_case);
+    return pattern.matches(location);
+  }
+
+  RegExpFilterPtr regexp_filter(const std::string &text) {
+    return boost::dynamic_pointer_cast<RegExpFilter>(Filter::from_text(text));
+  }
+
+}
+
+TEST(PatternTest, Literal) {
+  EXPECT_TRUE(pattern_matches("/banner/", "http://example.com/banner/ad.gif"));
+  EXPECT_TRUE(pattern_matches("/BANNER/", "http://example.com/banner/ad.gif"));
+  EXPECT_FALSE(pattern_matches("/BANNER/", "http://example.com/banner/ad.gif", true));
+  EXPECT_FALSE(pattern_matches("/banner/", "http://example.com/banners/ad.gif"));
+  EXPECT_TRUE(pattern_matches("", "http://example.com/"));
+}
+
+TEST(PatternTest, Wildcards) {
+  EXPECT_TRUE(pattern_matches("/ads/*.gif", "http://example.com/ads/a/b.gif"));
+  EXPECT_TRUE(pattern_matches("**ads**gif**", "http://example.com/ads/a/b.gif"));
+  EXPECT_FALSE(pattern_matches("/ads/*.gif", "http://example.com/a.gif/ads/"));
+  EXPECT_TRUE(pattern_matches("a*b*a", "http://x/aba"));
+  EXPECT_FALSE(pattern_matches("a*b*a*b", "http://x/aba"));
+}
+
+TEST(PatternTest, Separator) {
+  EXPECT_TRUE(pattern_matches("example.com^", "http://example.com/"));
+  EXPECT_FALSE(pattern_matches("example^", "http://example.com/"));
+  EXPECT_TRUE(pattern_matches("/ad^", "http://example.com/ad?x=1"));
+  EXPECT_TRUE(pattern_matches("/ad^", "http://example.com/ad"));
+  EXPECT_FALSE(pattern_matches("/ad^", "http://example.com/ad-1"));
+  EXPECT_FALSE(pattern_matches("/ad^", "http://example.com/ad%20"));
+  EXPECT_TRUE(pattern_matches("^ad^", "http://example.com/ad/"));
+  EXPECT_TRUE(pattern_matches("/ad^^", "http://example.com/ad"));
+}
+
+TEST(PatternTest, Anchors) {
+  EXPECT_TRUE(pattern_matches("|http://ad.", "http://ad.example.com/"));
+  EXPECT_FALSE(pattern_matches("|http://ad.", "https://ad.example.com/"));
+  EXPECT_FALSE(pattern_matches("|http://ad.", "http://x.com/?http://ad."));
+  EXPECT_TRUE(pattern_matches(".gif|", "http://example.com/ad.gif"));
+  EXPECT_FALSE(pattern_matches(".gif|", "http://example.com/ad.gif?x"));
+  EXPECT_TRUE(pattern_matches("/ad^|", "http://example.com/ad"));
+  EXPECT_TRUE(pattern_matches("|http://example.com/|", "http://example.com/"));
+  EXPECT_FALSE(pattern_matches("|http://example.com/|", "http://example.com/a"));
+  EXPECT_TRUE(pattern_matches("|*.gif|", "http://example.com/a.gif"));
+  EXPECT_TRUE(pattern_matches("|", "http://example.com/"));
+}
+
+TEST(PatternTest, HostAnchor) {
+  EXPECT_TRUE(pattern_matches("||example.com^", "http://example.com/"));
+  EXPECT_TRUE(pattern_matches("||example.com^", "https://ads.example.com:8080/"));
+  EXPECT_TRUE(pattern_matches("||example.com^", "http://example.com"));
+  EXPECT_FALSE(pattern_matches("||example.com^", "http://badexample.com/"));
+  EXPECT_FALSE(pattern_matches("||example.com^", "http://example.com.org/"));
+  EXPECT_FALSE(pattern_matches("||example.com^", "http://x.org/example.com/"));
+  EXPECT_FALSE(pattern_matches("||example.com^", "example.com/"));
+  EXPECT_TRUE(pattern_matches("||ads.", "http://www.ads.example.com/"));
+  EXPECT_FALSE(pattern_matches("||com/", "http://a..com/"));
+  EXPECT_TRUE(pattern_matches("||example.com/banner|", "http://example.com/banner"));
+}
+
+TEST(PatternTest, SameAsRegex) {
+  const char *filters[] = {
+    "||example.com^", "|http://example.com/", "/ads/*/banner^", "-ad-*.gif|",
+    "^ad^", "||ads.*^track", "*/pixel.gif*", "&ad_type=", "||com/", "/ad^|",
+    "|||", "||", "|"
+  };
+  const char *urls[] = {
+    "http://example.com/", "http://ads.example.com/ads/x/banner?1",
+    "http://example.com/x-ad-1.gif", "http://x.com/ad/", "http://x.com/ad",
+    "https://cdn.ads.net/js/track.js", "http://x.org/pixel.gif?a=1",
+    "http://x.org/?q=1&ad_type=2", "http://a..com/", "HTTP://EXAMPLE.COM/ADS/"
+  };
+  for (size_t fidx = 0; fidx < sizeof(filters) / sizeof(filters[0]); ++fidx) {
+    auto filter = regexp_filter(filters[fidx]);
+    ASSERT_TRUE(filter != nullptr);
+    for (size_t uidx = 0; uidx < sizeof(urls) / sizeof(urls[0]); ++uidx) {
+      EXPECT_EQ(boost::regex_search(std::string(urls[uidx]), *filter->get_regex()),
+        filter->get_pattern().matches(urls[uidx])) << filters[fidx] << " " << urls[uidx];
+    }
+  }
+}
+
+TEST(PatternTest, Benchmark) {
+  std::vector<RegExpFilterPtr> filters;
+  std::vector<RegexPtr> regexes;
+  auto all = test_util::load_easylist();
+  for (auto iter = all.begin(); iter != all.end(); ++iter) {
+    auto filter = boost::dynamic_pointer_cast<RegExpFilter>(*iter);
+    if (filter != nullptr && !filter->is_regex()) {
+      // get_regex() compiles a new one on every call
+      regexes.push_back(filter->get_regex());
+      filters.push_back(filter);
+    }
+  }
+  if (filters.size() == 0) {
+    std::cout << "easylist.txt not found, skipping benchmark" << std::endl;
+    return;
+  }
+
+  auto urls = test_util::load_urls();
+  if (urls.size() > 200) {
+    urls.resize(200);
+  }
+
+  uint32_t regex_hits = 0;
+  test_util::Timer regex_timer;
+  for (auto url = urls.begin(); url != urls.end(); ++url) {
+    for (auto regex = regexes.begin(); regex != regexes.end(); ++regex) {
+      regex_hits += boost::regex_search(*url, **regex) ? 1 : 0;
+    }
+  }
+  double regex_us = regex_timer.elapsed_us();
+
+  uint32_t pattern_hits = 0;
+  test_util::Timer pattern_timer;
+  for (auto url = urls.begin(); url != urls.end(); ++url) {
+    for (auto filter = filters.begin(); filter != filters.end(); ++filter) {
+      pattern_hits += (*filter)->get_pattern().matches(*url) ? 1 : 0;
+    }
+  }
+  double pattern_us = pattern_timer.elapsed_us();
+
+  EXPECT_EQ(regex_hits, pattern_hits);
+  std::cout << std::dec << filters.size() << " filters, " << urls.size() << " urls" << std::endl
+    << "boost::regex: " << regex_us / urls.size() << " us/url" << std::endl
+    << "Pattern:      " << pattern_us / urls.size() << " us/url" << std::endl;
+}
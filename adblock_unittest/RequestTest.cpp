@@ -0,0 +1,127 @@
+#include "../adblock/Matcher.h"
+
+#include <new>
+#include <cstdlib>
+#include <gtest/gtest.h>
+
+using namespace NS_ADBLOCK;
+
+
+namespace {
+
+  /**
+   * Number of heap allocations made while counting is enabled
+   */
+  uint32_t allocation_count = 0;
+  bool count_allocations = false;
+
+  class AllocationCounter {
+  public:
+    AllocationCounter() {
+      allocation_count = 0;
+      count_allocations = true;
+    }
+    ~AllocationCounter() { count_allocations = false; }
+    uint32_t count() const { return allocation_count; }
+  };
+
+  RegExpFilterPtr regexp_filter(const std::string &text) {
+    return boost::dynamic_pointer_cast<RegExpFilter>(Filter::from_text(text));
+  }
+
+}
+
+void *operator new(size_t size) {
+  if (count_allocations) {
+    ++allocation_count;
+  }
+  void *ptr = std::malloc(size == 0 ? 1 : size);
+  if (ptr == nullptr) {
+    throw std::bad_alloc();
+  }
+  return ptr;
+}
+
+void operator delete(void *ptr) throw() {
+  std::free(ptr);
+}
+
+void *operator new[](size_t size) {
+  return operator new(size);
+}
+
+void operator delete[](void *ptr) throw() {
+  operator delete(ptr);
+}
+
+void operator delete(void *ptr, std::size_t) throw() {
+  operator delete(ptr);
+}
+
+void operator delete[](void *ptr, std::size_t) throw() {
+  operator delete(ptr);
+}
+
+TEST(RequestTest, Tokens) {
+  std::string url = "HTTP://Ads.Example.COM/a/b2c/%20x?id=1234&q=ab";
+  Request request(url, "SCRIPT", "www.Example.com", true);
+
+  EXPECT_EQ("http://ads.example.com/a/b2c/%20x?id=1234&q=ab",
+    request.get_lower_location().to_string());
+  EXPECT_EQ(url, request.get_location().to_string());
+  EXPECT_EQ("WWW.EXAMPLE.COM", request.get_doc_domain().to_string());
+
+  const char *expected[] = { "http", "ads", "example", "com", "b2c", "%20x", "1234" };
+  ASSERT_EQ(7u, request.get_token_count());
+  for (uint32_t idx = 0; idx < request.get_token_count(); ++idx) {
+    EXPECT_EQ(expected[idx], request.get_token(idx).to_string());
+  }
+}
+
+TEST(RequestTest, NoAllocationWhenMatching) {
+  CombindMatcher combined;
+  Matcher matcher;
+  const char *filters[] = {
+    "||ads.example.com^", "/banner/*.gif", "-ad-$domain=news.com|~sub.news.com",
+    "@@||ads.example.com/allowed^", "&ad=$script,third-party", "^track^"
+  };
+  for (uint32_t idx = 0; idx < sizeof(filters) / sizeof(filters[0]); ++idx) {
+    auto filter = regexp_filter(filters[idx]);
+    combined.add(filter);
+    matcher.add(filter);
+  }
+
+  const std::string urls[] = {
+    "http://ads.example.com/x.js",
+    "http://ads.example.com/allowed/x.js",
+    "http://cdn.com/banner/x.gif",
+    "http://cdn.com/x-ad-y.js",
+    "http://cdn.com/?q=1&ad=2",
+    "http://cdn.com/a/track/b",
+    "http://www.nothing-to-see.org/index.html"
+  };
+  const uint32_t count = sizeof(urls) / sizeof(urls[0]);
+
+  // Let the request buffers, lazily parsed filters and the cache warm up
+  Request request;
+  request.set_content_type("SCRIPT");
+  request.set_doc_domain("www.news.com");
+  request.set_third_party(true);
+  for (uint32_t idx = 0; idx < count; ++idx) {
+    request.set_location(urls[idx]);
+    matcher.matches_any(request);
+    combined.matches_any(request);
+  }
+
+  AllocationCounter counter;
+  uint32_t hits = 0;
+  for (uint32_t round = 0; round < 10; ++round) {
+    for (uint32_t idx = 0; idx < count; ++idx) {
+      request.set_location(urls[idx]);
+      hits += matcher.matches_any(request) != nullptr ? 1 : 0;
+      hits += combined.matches_any(request) != nullptr ? 1 : 0;
+    }
+  }
+  EXPECT_EQ(0u, counter.count());
+  EXPECT_EQ(10u * 12u, hits);
+}
@@ -0,0 +1,119 @@
+/*!
+ * \file TestUtil.h
+ *
+ * \author yorath
+ * \date October 21, 2013
+ *
+ * \details Helpers shared by the unit tests and benchmarks
+ */
+
+#pragma once
+
+
+#include "../adblock/Filter.h"
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <boost/chrono.hpp>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#endif
+
+
+namespace test_util {
+
+  /**
+   * Reads all lines of a file, returns an empty list if the file is missing
+   */
+  inline std::vector<std::string> read_lines(const std::string &path) {
+    std::vector<std::string> lines;
+    std::ifstream file(path.c_str());
+    std::string line;
+    while (std::getline(file, line)) {
+      lines.push_back(line);
+    }
+    return lines;
+  }
+
+  /**
+   * Parses easylist.txt from the working directory
+   */
+  inline std::vector<NS_ADBLOCK::FilterPtr> load_easylist() {
+    std::vector<NS_ADBLOCK::FilterPtr> filters;
+    std::vector<std::string> lines = read_lines("easylist.txt");
+    for (auto iter = lines.begin(); iter != lines.end(); ++iter) {
+      auto filter = NS_ADBLOCK::Filter::from_text(*iter);
+      if (filter != nullptr) {
+        filters.push_back(filter);
+      }
+    }
+    return filters;
+  }
+
+  /**
+   * URL corpus used by the benchmarks, urls.txt from the working directory
+   * or a small built-in sample if it is missing
+   */
+  inline std::vector<std::string> load_urls() {
+    std::vector<std::string> urls = read_lines("urls.txt");
+    if (urls.size() == 0) {
+      const char *sample[] = {
+        "http://www.google.com/",
+        "http://www.google-analytics.com/ga.js",
+        "https://ssl.gstatic.com/images/logo.png",
+        "http://ad.doubleclick.net/adj/N5762.example/B7000000;sz=728x90;ord=123",
+        "http://pagead2.googlesyndication.com/pagead/show_ads.js",
+        "http://static.example.com/css/main.css?v=20131021",
+        "http://cdn.example.org/banner/ad_728x90.gif",
+        "http://www.example.com/track/pixel.gif?uid=1234&ref=http%3A%2F%2Fexample.com",
+        "http://connect.facebook.net/en_US/all.js#xfbml=1",
+        "https://platform.twitter.com/widgets.js"
+      };
+      urls.assign(sample, sample + sizeof(sample) / sizeof(sample[0]));
+    }
+    return urls;
+  }
+
+  /**
+   * Resident set size of the process in bytes, 0 if it is unknown
+   */
+  inline uint64_t resident_bytes() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+      return counters.WorkingSetSize;
+    }
+    return 0;
+#else
+    std::ifstream statm("/proc/self/statm");
+    uint64_t size = 0;
+    uint64_t resident = 0;
+    statm >> size >> resident;
+    return resident * 4096;
+#endif
+  }
+
+  /**
+   * Measures wall time from construction
+   */
+  class Timer {
+  public:
+    Timer(): start_(boost::chrono::high_resolution_clock::now()) { }
+
+    /**
+     * Elapsed time in microseconds
+     */
+    double elapsed_us() const {
+      return boost::chrono::duration<double, boost::micro>(
+        boost::chrono::high_resolution_clock::now() - start_).count();
+    }
+
+  private:
+    boost::chrono::high_resolution_clock::time_point start_;
+  };
+
+}
@@ -0,0 +1,147 @@
+#include "../adblock/Engine.h"
+#include "../adblock/Tokenizer.h"
+#include "TestUtil.h"
+
+#include <iostream>
+#include <sstream>
+#include <gtest/gtest.h>
+
+using namespace NS_ADBLOCK;
+
+
+namespace {
+
+  const Tokenizer::KERNEL Kernels[] = {
+    Tokenizer::KERNEL_SCALAR, Tokenizer::KERNEL_SSE2, Tokenizer::KERNEL_AVX2
+  };
+
+  const char *KernelNames[] = { "scalar", "sse2", "avx2" };
+
+  const uint32_t KernelCount = sizeof(Kernels) / sizeof(Kernels[0]);
+
+  /**
+   * Lowercase text and tokens as "begin:length" pairs
+   */
+  std::string tokenize(Tokenizer::KERNEL kernel, const std::string &text) {
+    std::string lower(text.length(), '\0');
+    Tokenizer::Tokens tokens;
+    if (text.length() > 0) {
+      Tokenizer::tokenize(kernel, text.data(), static_cast<uint32_t>(text.length()),
+        &lower[0], tokens);
+    }
+    std::ostringstream result;
+    result << lower;
+    for (auto iter = tokens.begin(); iter != tokens.end(); ++iter) {
+      result << ' ' << iter->begin << ':' << iter->length;
+      const char *begin = lower.data() + iter->begin;
+      EXPECT_EQ(Tokenizer::hash(begin, begin + iter->length), iter->hash);
+    }
+    return result.str();
+  }
+
+}
+
+TEST(TokenizerTest, Tokens) {
+  EXPECT_EQ("http://ads.example.com/a%2fb/x_y.js?id=1234 0:4 7:3 11:7 19:3 23:5 39:4",
+    tokenize(Tokenizer::KERNEL_SCALAR, "HTTP://Ads.Example.COM/a%2Fb/x_y.js?ID=1234"));
+  EXPECT_EQ("", tokenize(Tokenizer::KERNEL_SCALAR, ""));
+  EXPECT_EQ("ab", tokenize(Tokenizer::KERNEL_SCALAR, "AB"));
+  EXPECT_EQ("abc 0:3", tokenize(Tokenizer::KERNEL_SCALAR, "ABC"));
+  EXPECT_TRUE(Tokenizer::is_supported(Tokenizer::KERNEL_SCALAR));
+  EXPECT_TRUE(Tokenizer::is_supported(Tokenizer::get_kernel()));
+  EXPECT_TRUE(Tokenizer::is_supported(Tokenizer::get_kernel(Tokenizer::Avx2MinLength)));
+  // AVX2 doesn't pay off on URL-length inputs
+  EXPECT_NE(Tokenizer::KERNEL_AVX2, Tokenizer::get_kernel(Tokenizer::Avx2MinLength - 1));
+}
+
+TEST(TokenizerTest, SameAsScalar) {
+  // Tokens crossing block boundaries, bytes above 0x7F and the characters
+  // next to the ranges of the classes
+  std::vector<std::string> texts = test_util::load_urls();
+  const char alphabet[] = "aZ@[`{/:09%$-.\x80\xC3\xFFXYzA";
+  uint32_t seed = 12345;
+  for (uint32_t length = 0; length < 100; ++length) {
+    for (uint32_t round = 0; round < 20; ++round) {
+      std::string text;
+      for (uint32_t idx = 0; idx < length; ++idx) {
+        seed = seed * 1103515245 + 12345;
+        // Mostly runs of token characters so tokens get long
+        uint32_t pick = (seed >> 16) % (sizeof(alphabet) - 1);
+        text.push_back(pick % 3 == 0 ? alphabet[pick] : 'a' + (seed >> 20) % 26);
+      }
+      texts.push_back(text);
+    }
+  }
+
+  for (uint32_t kernel = 1; kernel < KernelCount; ++kernel) {
+    if (!Tokenizer::is_supported(Kernels[kernel])) {
+      std::cout << KernelNames[kernel] << " not supported, skipping" << std::endl;
+      continue;
+    }
+    for (auto text = texts.begin(); text != texts.end(); ++text) {
+      ASSERT_EQ(tokenize(Tokenizer::KERNEL_SCALAR, *text), tokenize(Kernels[kernel], *text))
+        << KernelNames[kernel] << ": " << *text;
+    }
+  }
+}
+
+TEST(TokenizerTest, Benchmark) {
+  std::vector<std::string> urls = test_util::load_urls();
+  uint64_t total_length = 0;
+  for (auto url = urls.begin(); url != urls.end(); ++url) {
+    total_length += url->length();
+  }
+  uint32_t average_length = static_cast<uint32_t>(total_length / urls.size());
+  std::cout << std::dec << urls.size() << " urls, " << average_length
+    << " bytes on average, default kernel "
+    << KernelNames[Tokenizer::get_kernel(average_length)] << std::endl;
+
+  const uint32_t rounds = 20;
+  std::string lower;
+  Tokenizer::Tokens tokens;
+  double tokenize_us[KernelCount] = { 0 };
+  for (uint32_t kernel = 0; kernel < KernelCount; ++kernel) {
+    if (!Tokenizer::is_supported(Kernels[kernel])) {
+      continue;
+    }
+    uint64_t token_count = 0;
+    test_util::Timer timer;
+    for (uint32_t round = 0; round < rounds; ++round) {
+      for (auto url = urls.begin(); url != urls.end(); ++url) {
+        lower.resize(url->length());
+        tokens.clear();
+        if (url->length() > 0) {
+          Tokenizer::tokenize(Kernels[kernel], url->data(),
+            static_cast<uint32_t>(url->length()), &lower[0], tokens);
+        }
+        token_count += tokens.size();
+      }
+    }
+    tokenize_us[kernel] = timer.elapsed_us() / (rounds * urls.size());
+    std::cout << KernelNames[kernel] << ": " << tokenize_us[kernel] * 1000
+      << " ns/url, x" << tokenize_us[0] / tokenize_us[kernel] << ", "
+      << token_count / rounds << " tokens" << std::endl;
+  }
+
+  // Share of the tokenizer in the whole match
+  std::vector<std::string> lines = test_util::read_lines("easylist.txt");
+  if (lines.size() == 0) {
+    std::cout << "easylist.txt not found, skipping match benchmark" << std::endl;
+    return;
+  }
+  EnginePtr engine = Engine::from_lines(lines);
+  Request request;
+  request.set_content_type(TYPE_SCRIPT);
+  request.set_doc_domain("www.example.com");
+  request.set_third_party(true);
+  uint32_t blocked = 0;
+  test_util::Timer match_timer;
+  for (auto url = urls.begin(); url != urls.end(); ++url) {
+    request.set_location(*url);
+    blocked += engine->matches_any(request) != nullptr ? 1 : 0;
+  }
+  double match_us = match_timer.elapsed_us() / urls.size();
+  std::cout << "match: " << match_us << " us/url, tokenizer "
+    << tokenize_us[Tokenizer::get_kernel(average_length)] * 100 / match_us << "% of it, "
+    << blocked << " blocked" << std::endl;
+}